@@ -1,139 +1,1081 @@
+/**
+ * benchmark
+ * Time every operation of the library over a corpus of documents.
+ *
+ *	benchmark [options] corpus...
+ *
+ * Each corpus argument is a json file or a directory, whose .json files
+ * are taken in name order.  Every operation runs on every document it
+ * applies to, and reports:
+ *
+ *	MB/s		the document's text bytes over the mean time of a run
+ *	ns/doc		the mean time of a run
+ *	p50, p99	percentiles of the per run time of each sample
+ *	allocs		allocations (malloc and realloc) made by one run
+ *
+ * and, with -p, the cycles, instructions, cache misses and branch misses
+ * of a run from the perf_event_open counters.  Each measurement starts
+ * with a warmup, then takes samples of a batch of runs each, enough runs
+ * for a batch to last BATCH_MIN_NS, so that the timer is not what is
+ * measured; for small documents the percentiles are therefore of batch
+ * averages.  Sampling goes on until the measurement has taken at least
+ * the minimum time and MIN_SAMPLES samples.
+ *
+ * Options:
+ *	-o op,op	run these operations only (-l lists them)
+ *	-t seconds	minimum time per operation and document (0.2)
+ *	-w seconds	warmup per operation and document (0.05)
+ *	-p		read the cpu's performance counters
+ *	-j threads	threads for tobinary_parallel (the number of cores)
+ *	-r file		write the results as json, to compare later runs with
+ *	-b file		compare the medians with the results of an earlier run, and
+ *			exit with status 1 if an operation got slower than the
+ *			threshold
+ *	-x percent	the threshold for -b (10)
+ *	-S threads	instead, run tobinary_parallel on each document with 1 up
+ *			to this many threads, to see how it scales
+ */
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
-#include "hexdump.h"
 #include "dynbuffer.h"
 #include "jsonutil.h"
+#include "jsonbinary.h"
+#include "jsonnumber.h"
+#include "jsonlib.h"
 
-clock_t starttime;
-int iterations=0;
-uint8_t *source;
-size_t sourcelen;
+#include "jsonlex.inc.c"
 
-void start_timer()
+/* the recursive descent parser, to compare with the iterative one that
+ * json_validate_json uses */
+#define JSONPARSE_RECURSIVE 1
+#include "jsonparse.inc.c"
+
+#define BATCH_MIN_NS 20000
+#define MIN_SAMPLES 5
+
+/* the version of the results file */
+#define RESULTS_FORMAT 1
+
+typedef struct {
+	char *name;
+	uint8_t *text;
+	size_t len;
+
+	/* what the operations other than those on text need, prepared once;
+	 * empty when the document does not have any */
+	dynbuffer_t binary;
+	dynbuffer_t numbertext;		/* each number token, zero terminated */
+	size_t *numberstarts;
+	double *numbervalues;
+	size_t numbercount;
+	dynbuffer_t stringtext;		/* each string token, decoded */
+	size_t *stringstarts;		/* stringcount+1 entries */
+	size_t stringcount;
+	dynbuffer_t path;			/* of a value in the middle of the document */
+} doc_t;
+
+#define NEEDS_BINARY 0x01
+#define NEEDS_NUMBERS 0x02
+#define NEEDS_STRINGS 0x04
+#define NEEDS_PATH 0x08
+
+typedef struct {
+	const char *name;
+	const char *description;
+	int needs;
+	bool (*run)(doc_t *doc);
+} op_t;
+
+/* the perf_event_open counters read with -p */
+#define NCOUNTERS 4
+static const char *counter_names[NCOUNTERS]={"cycles", "instructions", "cache_misses", "branch_misses"};
+
+typedef struct {
+	const op_t *op;
+	const doc_t *doc;
+	uint64_t runs;
+	double seconds;
+	double p50;
+	double p99;
+	uint64_t allocs;
+	bool counted;
+	double counters[NCOUNTERS];	/* per run */
+} result_t;
+
+static int parallel_threads;
+
+/*** operations ***/
+
+static bool op_copy(doc_t *doc)
 {
-	starttime=clock();
+	dynbuffer_t dest=dynbuffer_init();
+
+	dynbuffer_append(&dest, doc->text, doc->len);
+	dynbuffer_destroy(&dest);
+	return true;
 }
 
-void print_stats()
+static bool op_lex(doc_t *doc)
 {
-	clock_t endtime=clock();
-	clock_t totaltime=endtime-starttime;
-	double avgMicros=totaltime / (double)iterations;
-	double times=totaltime / (double)CLOCKS_PER_SEC;
+	jsonlex_state_t lexstate;
+	jsonlex_token_t token;
 
-	printf("Total runtime %f.  Avg %fus\n", times, avgMicros);
+	jsonlex_init_io(&lexstate, doc->text, doc->len);
+	do {
+		token=jsonlex_next_token(&lexstate);
+		if (token==jsonlex_illegal_string || token==jsonlex_invalid_utf8 || token==jsonlex_unknown) break;
+	} while (token!=jsonlex_eof);
+	jsonlex_destroy(&lexstate);
+	return token==jsonlex_eof;
 }
 
-void test_json_to_json()
+static bool op_validate(doc_t *doc)
+{
+	return json_validate_json(doc->text, doc->len);
+}
+
+static bool op_validate_recursive(doc_t *doc)
+{
+	jsonparseinfo_t parseinfo;
+	bool result;
+
+	jsonlex_init_io(&parseinfo.lexstate, doc->text, doc->len);
+	result=jsonparse(&parseinfo);
+	jsonlex_destroy(&parseinfo.lexstate);
+	return result;
+}
+
+static bool op_tojson(doc_t *doc)
 {
 	dynbuffer_t dest=dynbuffer_init();
-	dynbuffer_ensure(&dest, sourcelen*2);
+	bool result;
 
-	if (!json_transcode_json_to_json(source, sourcelen, &dest)) {
-		printf("Error transcoding\n");
-		exit(2);
+	dynbuffer_ensure(&dest, doc->len*2);
+	result=json_transcode_json_to_json(doc->text, doc->len, &dest);
+	dynbuffer_destroy(&dest);
+	return result;
+}
+
+static bool op_tojson_utf8(doc_t *doc)
+{
+	bool result;
+
+	json_ascii_output=false;
+	result=op_tojson(doc);
+	json_ascii_output=true;
+	return result;
+}
+
+static bool op_tobinary(doc_t *doc)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	bool result;
+
+	dynbuffer_ensure(&dest, doc->len*2);
+	result=json_transcode_json_to_binary(doc->text, doc->len, &dest);
+	dynbuffer_destroy(&dest);
+	return result;
+}
+
+static bool op_tobinary_push(doc_t *doc)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	json_to_binary_push_t *push;
+	size_t pos, len;
+	bool result;
+
+	dynbuffer_ensure(&dest, doc->len*2);
+	push=json_transcode_json_to_binary_begin(&dest);
+	for (pos=0; pos<doc->len; pos+=len) {
+		len=doc->len-pos<4096 ? doc->len-pos : 4096;
+		json_transcode_json_to_binary_push(push, doc->text+pos, len);
 	}
+	result=json_transcode_json_to_binary_end(push);
 	dynbuffer_destroy(&dest);
+	return result;
 }
 
-void test_json_to_binary()
+static bool op_tobinary_parallel(doc_t *doc)
 {
 	dynbuffer_t dest=dynbuffer_init();
-	dynbuffer_ensure(&dest, sourcelen*2);
+	bool result;
 
-	if (!json_transcode_json_to_binary(source, sourcelen, &dest)) {
-		printf("Error transcoding\n");
-		exit(2);
+	dynbuffer_ensure(&dest, doc->len*2);
+	result=json_transcode_json_to_binary_parallel(doc->text, doc->len, parallel_threads, &dest);
+	dynbuffer_destroy(&dest);
+	return result;
+}
+
+static bool op_frombinary(doc_t *doc)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	bool result;
+
+	dynbuffer_ensure(&dest, doc->binary.pos*2);
+	result=json_transcode_binary_to_json(doc->binary.contents, doc->binary.pos, &dest);
+	dynbuffer_destroy(&dest);
+	return result;
+}
+
+static bool op_frombinary_utf8(doc_t *doc)
+{
+	bool result;
+
+	json_ascii_output=false;
+	result=op_frombinary(doc);
+	json_ascii_output=true;
+	return result;
+}
+
+static bool op_verifybinary(doc_t *doc)
+{
+	return json_verify_binary(doc->binary.contents, doc->binary.pos);
+}
+
+static bool escape_strings(doc_t *doc, bool ascii_only)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	size_t i;
+	bool result=true;
+
+	for (i=0; i<doc->stringcount && result; i++) {
+		dest.pos=0;
+		result=json_escape_string(&dest, doc->stringtext.contents+doc->stringstarts[i], doc->stringstarts[i+1]-doc->stringstarts[i], ascii_only, '"');
 	}
 	dynbuffer_destroy(&dest);
+	return result;
 }
 
-void dummy()
+static bool op_escape(doc_t *doc)
 {
-	void *target=malloc(sourcelen);
-	memcpy(target, source, sourcelen);
-	free(target);
+	return escape_strings(doc, true);
 }
 
-void test_validate()
+static bool op_escape_utf8(doc_t *doc)
 {
-	if (!json_validate_json(source, sourcelen)) {
-		printf("Validation failed\n");
-		exit(3);
+	return escape_strings(doc, false);
+}
+
+static bool op_parsenumbers(doc_t *doc)
+{
+	uint8_t *text;
+	double value;
+	size_t i;
+
+	for (i=0; i<doc->numbercount; i++) {
+		text=doc->numbertext.contents+doc->numberstarts[i];
+		if (!jsonnumber_parse_double(text, strlen((char*)text), false, &value)) return false;
+	}
+	return true;
+}
+
+static bool op_parsenumbers_libc(doc_t *doc)
+{
+	size_t i;
+
+	for (i=0; i<doc->numbercount; i++) {
+		strtod((char*)doc->numbertext.contents+doc->numberstarts[i], 0);
+	}
+	return true;
+}
+
+static bool op_formatnumbers(doc_t *doc)
+{
+	char buf[JSONNUMBER_FORMAT_MAX];
+	size_t i;
+
+	for (i=0; i<doc->numbercount; i++) {
+		jsonnumber_format_double(doc->numbervalues[i], buf);
 	}
+	return true;
 }
 
-void setup_binary_to_json()
+static bool op_formatnumbers_libc(doc_t *doc)
 {
-	dynbuffer_t bin=dynbuffer_init();
-	if (!json_transcode_json_to_binary(source, sourcelen, &bin)) {
-		printf("Could not parse to binary\n");
+	char buf[JSONNUMBER_FORMAT_MAX];
+	size_t i;
+
+	/* %.17g always reads back, but is not the shortest */
+	for (i=0; i<doc->numbercount; i++) {
+		snprintf(buf, sizeof(buf), "%.17g", doc->numbervalues[i]);
+	}
+	return true;
+}
+
+static bool op_path(doc_t *doc)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	bool found;
+	json_path_status_t status;
+
+	status=json_path_get(doc->binary.contents, doc->binary.pos, doc->path.contents, doc->path.pos, &dest, &found);
+	dynbuffer_destroy(&dest);
+	return status==JSON_PATH_OK && found;
+}
+
+static bool op_textextract(doc_t *doc)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	bool found;
+	json_path_status_t status;
+
+	status=json_text_extract(doc->text, doc->len, doc->path.contents, doc->path.pos, &dest, &found);
+	dynbuffer_destroy(&dest);
+	return status==JSON_PATH_OK && found;
+}
+
+static const op_t ops[]={
+	{"copy", "memcpy of the text, for scale", 0, op_copy},
+	{"lex", "tokenize", 0, op_lex},
+	{"validate", "json_validate_json", 0, op_validate},
+	{"validate_recursive", "the recursive descent parser", 0, op_validate_recursive},
+	{"tojson", "text to normalized text", 0, op_tojson},
+	{"tojson_utf8", "text to text, UTF-8 written as it is", 0, op_tojson_utf8},
+	{"tobinary", "text to binary", 0, op_tobinary},
+	{"tobinary_push", "text to binary in 4K chunks", 0, op_tobinary_push},
+	{"tobinary_parallel", "text to binary on -j threads", 0, op_tobinary_parallel},
+	{"frombinary", "binary to text", NEEDS_BINARY, op_frombinary},
+	{"frombinary_utf8", "binary to text, UTF-8 written as it is", NEEDS_BINARY, op_frombinary_utf8},
+	{"verifybinary", "json_verify_binary", NEEDS_BINARY, op_verifybinary},
+	{"escape", "escape every string", NEEDS_STRINGS, op_escape},
+	{"escape_utf8", "escape every string, UTF-8 written as it is", NEEDS_STRINGS, op_escape_utf8},
+	{"parsenumbers", "every number token to double", NEEDS_NUMBERS, op_parsenumbers},
+	{"parsenumbers_libc", "the same with strtod", NEEDS_NUMBERS, op_parsenumbers_libc},
+	{"formatnumbers", "every number back to text", NEEDS_NUMBERS, op_formatnumbers},
+	{"formatnumbers_libc", "the same with %.17g", NEEDS_NUMBERS, op_formatnumbers_libc},
+	{"path", "json_path_get of a value in the middle", NEEDS_BINARY|NEEDS_PATH, op_path},
+	{"textextract", "json_text_extract of the same path", NEEDS_PATH, op_textextract}
+};
+
+#define NOPS (sizeof(ops)/sizeof(ops[0]))
+
+/*** corpus ***/
+
+/**
+ * Collect the number and string tokens of the text
+ */
+static void setup_tokens(doc_t *doc)
+{
+	jsonlex_state_t lexstate;
+	jsonlex_token_t token;
+	size_t numbercapacity=64, stringcapacity=64, i;
+
+	doc->numberstarts=(size_t*)malloc(numbercapacity*sizeof(size_t));
+	doc->stringstarts=(size_t*)malloc((stringcapacity+1)*sizeof(size_t));
+	jsonlex_init_io(&lexstate, doc->text, doc->len);
+	while ((token=jsonlex_next_token(&lexstate))!=jsonlex_eof) {
+		if (token==jsonlex_illegal_string || token==jsonlex_invalid_utf8 || token==jsonlex_unknown) break;
+		if (token==jsonlex_integer || token==jsonlex_numeric) {
+			if (doc->numbercount==numbercapacity) {
+				numbercapacity*=2;
+				doc->numberstarts=(size_t*)realloc(doc->numberstarts, numbercapacity*sizeof(size_t));
+			}
+			doc->numberstarts[doc->numbercount++]=doc->numbertext.pos;
+			dynbuffer_append(&doc->numbertext, lexstate.token, lexstate.token_len);
+			dynbuffer_append_byte(&doc->numbertext, 0);
+		} else if (token==jsonlex_string) {
+			if (doc->stringcount==stringcapacity) {
+				stringcapacity*=2;
+				doc->stringstarts=(size_t*)realloc(doc->stringstarts, (stringcapacity+1)*sizeof(size_t));
+			}
+			doc->stringstarts[doc->stringcount++]=doc->stringtext.pos;
+			dynbuffer_append(&doc->stringtext, lexstate.token, lexstate.token_len);
+		}
+	}
+	jsonlex_destroy(&lexstate);
+	doc->stringstarts[doc->stringcount]=doc->stringtext.pos;
+
+	doc->numbervalues=(double*)malloc((doc->numbercount+1)*sizeof(double));
+	for (i=0; i<doc->numbercount; i++) {
+		doc->numbervalues[i]=strtod((char*)doc->numbertext.contents+doc->numberstarts[i], 0);
+	}
+}
+
+typedef struct {
+	bool object;
+	uint32_t index;
+	size_t base;		/* length of the path to the container */
+	bool inexpressible;	/* the path to the current member cannot be written */
+	bool parent_inexpressible;
+} path_frame_t;
+
+/**
+ * A path can only name labels that are not empty and have no dot, bracket
+ * or zero byte
+ */
+static bool path_label_ok(const uint8_t *label, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (label[i]=='.' || label[i]=='[' || label[i]==0) return false;
+	}
+	return len>0;
+}
+
+/**
+ * Walk the tokens of the text keeping the path to the current value in
+ * doc->path.  Counts the scalars below the top level whose path can be
+ * written, and stops at number target (from 1) leaving its path.
+ * @return the count, or 0 if the text does not lex
+ */
+static size_t walk_paths(doc_t *doc, size_t target)
+{
+	jsonlex_state_t lexstate;
+	jsonlex_token_t token;
+	path_frame_t *stack=(path_frame_t*)malloc(sizeof(path_frame_t)*(json_max_depth+1));
+	path_frame_t *frame=NULL;
+	int depth=0;
+	bool expect_label=false;
+	size_t count=0;
+	char indextext[16];
+
+	doc->path.pos=0;
+	jsonlex_init_io(&lexstate, doc->text, doc->len);
+	while ((token=jsonlex_next_token(&lexstate))!=jsonlex_eof) {
+		switch (token) {
+		case jsonlex_comma:
+			if (frame && frame->object) expect_label=true;
+			else if (frame) frame->index++;
+			continue;
+		case jsonlex_colon:
+			continue;
+		case jsonlex_rbrace:
+		case jsonlex_rbracket:
+			if (!depth) goto fail;
+			frame=--depth ? &stack[depth-1] : NULL;
+			continue;
+		case jsonlex_string:
+			if (expect_label) {
+				expect_label=false;
+				doc->path.pos=frame->base;
+				if (frame->base) dynbuffer_append_byte(&doc->path, '.');
+				dynbuffer_append(&doc->path, lexstate.token, lexstate.token_len);
+				frame->inexpressible=frame->parent_inexpressible || !path_label_ok(lexstate.token, lexstate.token_len);
+				continue;
+			}
+			break;
+		case jsonlex_lbrace:
+		case jsonlex_lbracket:
+		case jsonlex_identifier:
+		case jsonlex_integer:
+		case jsonlex_numeric:
+			break;
+		default:
+			goto fail;
+		}
+
+		/* a value: the path of an array element is written here, that of
+		 * an object member at its label */
+		if (frame && !frame->object) {
+			doc->path.pos=frame->base;
+			snprintf(indextext, sizeof(indextext), "[%u]", frame->index);
+			dynbuffer_append(&doc->path, indextext, strlen(indextext));
+		}
+
+		if (token==jsonlex_lbrace || token==jsonlex_lbracket) {
+			if (depth==json_max_depth) goto fail;
+			stack[depth].object=token==jsonlex_lbrace;
+			stack[depth].index=0;
+			stack[depth].base=doc->path.pos;
+			stack[depth].parent_inexpressible=frame && frame->inexpressible;
+			stack[depth].inexpressible=stack[depth].parent_inexpressible;
+			frame=&stack[depth++];
+			expect_label=frame->object;
+		} else if (frame && !frame->inexpressible && ++count==target) {
+			break;
+		}
+	}
+
+	jsonlex_destroy(&lexstate);
+	free(stack);
+	return count;
+
+fail:
+	jsonlex_destroy(&lexstate);
+	free(stack);
+	return 0;
+}
+
+static doc_t *load_doc(const char *filename)
+{
+	FILE *input=fopen(filename, "r");
+	dynbuffer_t text=dynbuffer_init();
+	doc_t *doc;
+	const char *base;
+	size_t count;
+
+	if (!input) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
 		exit(2);
 	}
-	source=bin.contents;
-	sourcelen=bin.pos;
+	dynbuffer_read_file(&text, input);
+	fclose(input);
+
+	doc=(doc_t*)calloc(1, sizeof(doc_t));
+	base=strrchr(filename, '/');
+	doc->name=strdup(base ? base+1 : filename);
+	doc->text=text.contents;
+	doc->len=text.pos;
+
+	if (!json_transcode_json_to_binary(doc->text, doc->len, &doc->binary)) doc->binary.pos=0;
+	setup_tokens(doc);
+	count=walk_paths(doc, 0);
+	if (!count || !walk_paths(doc, count/2+1)) doc->path.pos=0;
+	return doc;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
 }
 
-void test_json_from_binary()
+/**
+ * Add the document at path, or the .json files of the directory at path
+ */
+static void load_corpus(const char *path, doc_t ***docs, size_t *ndocs)
 {
+	struct stat st;
+	DIR *dir;
+	struct dirent *entry;
+	char **names=NULL;
+	size_t nnames=0, len, i;
+	char *filename;
+
+	if (stat(path, &st)!=0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+
+	if (!S_ISDIR(st.st_mode)) {
+		*docs=(doc_t**)realloc(*docs, (*ndocs+1)*sizeof(doc_t*));
+		(*docs)[(*ndocs)++]=load_doc(path);
+		return;
+	}
+
+	dir=opendir(path);
+	if (!dir) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(2);
+	}
+	while ((entry=readdir(dir))) {
+		len=strlen(entry->d_name);
+		if (len<5 || strcmp(entry->d_name+len-5, ".json")!=0) continue;
+		names=(char**)realloc(names, (nnames+1)*sizeof(char*));
+		names[nnames++]=strdup(entry->d_name);
+	}
+	closedir(dir);
+	if (nnames) qsort(names, nnames, sizeof(char*), compare_names);
+
+	*docs=(doc_t**)realloc(*docs, (*ndocs+nnames)*sizeof(doc_t*));
+	for (i=0; i<nnames; i++) {
+		filename=(char*)malloc(strlen(path)+strlen(names[i])+2);
+		sprintf(filename, "%s/%s", path, names[i]);
+		(*docs)[(*ndocs)++]=load_doc(filename);
+		free(filename);
+		free(names[i]);
+	}
+	free(names);
+}
+
+static bool op_applies(const op_t *op, const doc_t *doc)
+{
+	if ((op->needs & NEEDS_BINARY) && !doc->binary.pos) return false;
+	if ((op->needs & NEEDS_NUMBERS) && !doc->numbercount) return false;
+	if ((op->needs & NEEDS_STRINGS) && !doc->stringcount) return false;
+	if ((op->needs & NEEDS_PATH) && !doc->path.pos) return false;
+	return true;
+}
+
+/*** measurement ***/
+
+static double wall_seconds()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* allocations are counted for one run through the library's hooks */
+static uint64_t allocation_count;
+
+static void *counting_malloc(size_t size)
+{
+	allocation_count++;
+	return malloc(size);
+}
+
+static void *counting_realloc(void *ptr, size_t size)
+{
+	allocation_count++;
+	return realloc(ptr, size);
+}
+
+static int counter_fds[NCOUNTERS]={-1, -1, -1, -1};
+static bool counters_open=false;
+
+/**
+ * Open the hardware counters for this process, threads started later
+ * included.  Not every system allows it (see perf_event_paranoid), in
+ * which case the results simply do not have them.
+ */
+static void open_counters()
+{
+	#ifdef __linux__
+	static const uint64_t configs[NCOUNTERS]={
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	struct perf_event_attr attr;
+	int i;
+
+	for (i=0; i<NCOUNTERS; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.size=sizeof(attr);
+		attr.config=configs[i];
+		attr.disabled=1;
+		attr.inherit=1;
+		attr.exclude_kernel=1;
+		attr.exclude_hv=1;
+		attr.read_format=PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		counter_fds[i]=(int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if (counter_fds[i]<0) {
+			fprintf(stderr, "performance counters unavailable: %s\n", strerror(errno));
+			while (i-->0) close(counter_fds[i]);
+			return;
+		}
+	}
+	counters_open=true;
+	#else
+	fprintf(stderr, "performance counters are only read on linux\n");
+	#endif
+}
+
+static void start_counters()
+{
+	#ifdef __linux__
+	int i;
+
+	for (i=0; i<NCOUNTERS && counters_open; i++) {
+		ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	#endif
+}
+
+/**
+ * Stop the counters and read them, scaled up if the kernel had to share
+ * the hardware between them
+ * @return false if they are not open or could not be read
+ */
+static bool stop_counters(double *values)
+{
+	#ifdef __linux__
+	uint64_t data[3];
+	int i;
+
+	if (!counters_open) return false;
+	for (i=0; i<NCOUNTERS; i++) ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	for (i=0; i<NCOUNTERS; i++) {
+		if (read(counter_fds[i], data, sizeof(data))!=sizeof(data) || !data[2]) return false;
+		values[i]=(double)data[0]*((double)data[1]/data[2]);
+	}
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x=*(const double*)a, y=*(const double*)b;
+
+	return x<y ? -1 : x>y;
+}
+
+/**
+ * The nearest rank percentile of sorted samples
+ */
+static double percentile(const double *sorted, size_t n, double p)
+{
+	size_t rank=(size_t)(p/100*n+0.999999);
+
+	if (rank<1) rank=1;
+	if (rank>n) rank=n;
+	return sorted[rank-1];
+}
+
+static bool measure(const op_t *op, doc_t *doc, double min_seconds, double warmup_seconds, result_t *result)
+{
+	double started, elapsed, batchstart, sample, total=0;
+	uint64_t warmup_runs=0, batch, i;
+	double *samples;
+	size_t nsamples=0, capacity=64;
+	int c;
+
+	memset(result, 0, sizeof(result_t));
+	result->op=op;
+	result->doc=doc;
+
+	/* warmup, which also sizes the batches */
+	started=wall_seconds();
+	do {
+		if (!op->run(doc)) return false;
+		warmup_runs++;
+		elapsed=wall_seconds()-started;
+	} while (elapsed<warmup_seconds);
+	batch=(uint64_t)(BATCH_MIN_NS/(elapsed*1e9/warmup_runs+1))+1;
+
+	jsonlib_set_allocator(counting_malloc, counting_realloc, free);
+	allocation_count=0;
+	op->run(doc);
+	result->allocs=allocation_count;
+	jsonlib_set_allocator(malloc, realloc, free);
+
+	samples=(double*)malloc(capacity*sizeof(double));
+	start_counters();
+	while (total<min_seconds || nsamples<MIN_SAMPLES) {
+		batchstart=wall_seconds();
+		for (i=0; i<batch; i++) op->run(doc);
+		sample=wall_seconds()-batchstart;
+
+		if (nsamples==capacity) {
+			capacity*=2;
+			samples=(double*)realloc(samples, capacity*sizeof(double));
+		}
+		samples[nsamples++]=sample*1e9/batch;
+		total+=sample;
+		result->runs+=batch;
+	}
+	result->counted=stop_counters(result->counters);
+	for (c=0; c<NCOUNTERS && result->counted; c++) result->counters[c]/=result->runs;
+
+	qsort(samples, nsamples, sizeof(double), compare_doubles);
+	result->seconds=total;
+	result->p50=percentile(samples, nsamples, 50);
+	result->p99=percentile(samples, nsamples, 99);
+	free(samples);
+	return true;
+}
+
+static void print_header(bool counters)
+{
+	printf("%-18s %-24s %10s %9s %12s %12s %12s %7s", "operation", "document", "bytes", "MB/s", "ns/doc", "p50", "p99", "allocs");
+	if (counters) printf(" %12s %5s %9s %9s", "cycles", "IPC", "cache-miss", "br-miss");
+	printf("\n");
+}
+
+static void print_result(const result_t *r)
+{
+	double ns=r->seconds*1e9/r->runs;
+
+	printf("%-18s %-24s %10lu %9.1f %12.0f %12.0f %12.0f %7lu", r->op->name, r->doc->name,
+			(unsigned long)r->doc->len, r->doc->len/ns*1e9/(1024*1024), ns, r->p50, r->p99, (unsigned long)r->allocs);
+	if (r->counted) {
+		printf(" %12.0f %5.2f %9.1f %9.1f", r->counters[0], r->counters[1]/r->counters[0], r->counters[2], r->counters[3]);
+	}
+	printf("\n");
+}
+
+/**
+ * An operation's throughput over the whole corpus: all of the text over
+ * the time to go through every document once
+ */
+static void print_total(const op_t *op, const result_t *results, size_t nresults)
+{
+	double bytes=0, ns=0;
+	size_t i;
+
+	for (i=0; i<nresults; i++) {
+		bytes+=results[i].doc->len;
+		ns+=results[i].seconds*1e9/results[i].runs;
+	}
+	printf("%-18s %-24s %10.0f %9.1f %12.0f\n", op->name, "(all)", bytes, bytes/ns*1e9/(1024*1024), ns);
+}
+
+/*** results file ***/
+
+static void write_string(FILE *out, const char *s)
+{
+	dynbuffer_t escaped=dynbuffer_init();
+
+	json_escape_string(&escaped, (const uint8_t*)s, strlen(s), true, '"');
+	fprintf(out, "\"%.*s\"", (int)escaped.pos, (char*)escaped.contents);
+	dynbuffer_destroy(&escaped);
+}
+
+static bool write_results(const char *filename, const result_t *results, size_t nresults, double min_seconds)
+{
+	FILE *out=fopen(filename, "w");
+	char stamp[32];
+	time_t now=time(NULL);
+	size_t i;
+	int c;
+
+	if (!out) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return false;
+	}
+
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+	fprintf(out, "{\n\t\"format\": %d,\n\t\"time\": \"%s\",\n\t\"min_time\": %g,\n\t\"results\": [", RESULTS_FORMAT, stamp, min_seconds);
+	for (i=0; i<nresults; i++) {
+		const result_t *r=&results[i];
+		double ns=r->seconds*1e9/r->runs;
+
+		fprintf(out, "%s\n\t\t{\"op\": ", i ? "," : "");
+		write_string(out, r->op->name);
+		fprintf(out, ", \"document\": ");
+		write_string(out, r->doc->name);
+		fprintf(out, ", \"bytes\": %lu, \"runs\": %lu, \"mb_per_s\": %.2f, \"ns_per_doc\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"allocs_per_doc\": %lu",
+				(unsigned long)r->doc->len, (unsigned long)r->runs, r->doc->len/ns*1e9/(1024*1024), ns, r->p50, r->p99, (unsigned long)r->allocs);
+		for (c=0; c<NCOUNTERS && r->counted; c++) {
+			fprintf(out, ", \"%s_per_doc\": %.1f", counter_names[c], r->counters[c]);
+		}
+		fprintf(out, "}");
+	}
+	fprintf(out, "\n\t]\n}\n");
+
+	if (fclose(out)!=0) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Look up a field of results[index] in a results file read as binary.
+ * @return false if there is no such result
+ */
+static bool baseline_field(dynbuffer_t *baseline, size_t index, const char *field, dynbuffer_t *value)
+{
+	dynbuffer_t found=dynbuffer_init();
+	char path[64];
+	bool present;
+	uint8_t type;
+	uint8_t *data;
+	uint32_t len;
+
+	snprintf(path, sizeof(path), "results[%lu].%s", (unsigned long)index, field);
+	if (json_path_get(baseline->contents, baseline->pos, (uint8_t*)path, strlen(path), &found, &present)!=JSON_PATH_OK
+			|| !present
+			|| !jsonbinary_extract_type_length(found.contents, found.contents+found.pos, &type, &data, &len)) {
+		dynbuffer_destroy(&found);
+		return false;
+	}
+
+	/* strings and number text, zero terminated */
+	value->pos=0;
+	dynbuffer_append(value, data, len);
+	dynbuffer_append_byte(value, 0);
+	dynbuffer_destroy(&found);
+	return true;
+}
+
+/**
+ * Print how much the median time of each operation and document changed
+ * since the run that wrote the results file.  The median is compared
+ * rather than the mean, which a few interrupted samples can move.
+ * @return the number that got slower by more than threshold percent, or
+ * -1 if the file cannot be read
+ */
+static int compare_baseline(const char *filename, const result_t *results, size_t nresults, double threshold)
+{
+	FILE *input=fopen(filename, "r");
+	dynbuffer_t text=dynbuffer_init();
+	dynbuffer_t baseline=dynbuffer_init();
+	dynbuffer_t op=dynbuffer_init(), document=dynbuffer_init(), p50=dynbuffer_init();
+	double before, after, change;
+	size_t i, j;
+	int regressions=0;
+
+	if (!input) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	dynbuffer_read_file(&text, input);
+	fclose(input);
+	if (!json_transcode_json_to_binary(text.contents, text.pos, &baseline)) {
+		fprintf(stderr, "%s: %s\n", filename, (char*)baseline.contents);
+		return -1;
+	}
+
+	printf("\nCompared with %s (slower by more than %g%% marked):\n", filename, threshold);
+	printf("%-18s %-24s %12s %12s %8s\n", "operation", "document", "p50 was", "p50", "change");
+	for (i=0; baseline_field(&baseline, i, "op", &op); i++) {
+		if (!baseline_field(&baseline, i, "document", &document) || !baseline_field(&baseline, i, "p50_ns", &p50)) continue;
+		for (j=0; j<nresults; j++) {
+			if (strcmp(results[j].op->name, (char*)op.contents)==0 && strcmp(results[j].doc->name, (char*)document.contents)==0) break;
+		}
+		if (j==nresults) continue;
+
+		before=strtod((char*)p50.contents, 0);
+		after=results[j].p50;
+		change=(after-before)/before*100;
+		printf("%-18s %-24s %12.0f %12.0f %+7.1f%%%s\n", (char*)op.contents, (char*)document.contents, before, after, change, change>threshold ? "  slower" : "");
+		if (change>threshold) regressions++;
+	}
+
+	dynbuffer_destroy(&text);
+	dynbuffer_destroy(&baseline);
+	dynbuffer_destroy(&op);
+	dynbuffer_destroy(&document);
+	dynbuffer_destroy(&p50);
+	return regressions;
+}
+
+/*** scaling ***/
+
+/**
+ * -S: transcode with 1 up to maxthreads threads, for about a second each,
+ * and report the throughput and speedup.  The binary is checked against
+ * the sequential transcoder's first.
+ */
+static void parallel_scaling(doc_t *doc, int maxthreads)
+{
+	dynbuffer_t expected=dynbuffer_init();
 	dynbuffer_t dest=dynbuffer_init();
-	dynbuffer_ensure(&dest, sourcelen*2);
+	double started, seconds, rate, baseline=0;
+	int nthreads, runs;
 
-	if (!json_transcode_binary_to_json(source, sourcelen, &dest)) {
+	printf("%s:\n", doc->name);
+	if (!json_transcode_json_to_binary(doc->text, doc->len, &expected)) {
 		printf("Error transcoding\n");
 		exit(2);
 	}
+
+	for (nthreads=1; nthreads<=maxthreads; nthreads++) {
+		runs=0;
+		started=wall_seconds();
+		do {
+			dest.pos=0;
+			if (!json_transcode_json_to_binary_parallel(doc->text, doc->len, nthreads, &dest)) {
+				printf("Error transcoding\n");
+				exit(2);
+			}
+			runs++;
+			seconds=wall_seconds()-started;
+		} while (seconds<1);
+
+		if (dest.pos!=expected.pos || memcmp(dest.contents, expected.contents, dest.pos)!=0) {
+			printf("Binary differs from the sequential transcoder's with %d threads\n", nthreads);
+			exit(2);
+		}
+
+		rate=doc->len*(double)runs/seconds;
+		if (nthreads==1) baseline=rate;
+		printf("%2d threads: %8.1f MB/s  speedup %.2f\n", nthreads, rate/(1024*1024), rate/baseline);
+	}
+	dynbuffer_destroy(&expected);
 	dynbuffer_destroy(&dest);
 }
 
+static void usage()
+{
+	fprintf(stderr, "usage: benchmark [-o op,op] [-t seconds] [-w seconds] [-p] [-j threads]\n"
+			"                 [-r results.json] [-b baseline.json] [-x percent] [-S threads] corpus...\n"
+			"corpus is json files and directories of them; -l lists the operations\n");
+}
+
 int main(int argc, char **argv)
 {
-	dynbuffer_t sourcebuf=dynbuffer_init();
-	dynbuffer_t dest=dynbuffer_init();
-	void (*testproc)();
-	char *testname;
+	doc_t **docs=NULL;
+	size_t ndocs=0, nresults=0, first, i, d;
+	result_t *results;
+	bool selected[NOPS];
+	const char *resultsfile=NULL, *baselinefile=NULL;
+	char *name;
+	double min_seconds=0.2, warmup_seconds=0.05, threshold=10;
+	bool counters=false;
+	int scaling=0, regressions=0, opt;
+
+	parallel_threads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+	for (i=0; i<NOPS; i++) selected[i]=true;
 
-	if (argc<3) {
-		printf("Expected test and input file\n");
-		return 3;
+	while ((opt=getopt(argc, argv, "o:t:w:pj:r:b:x:S:l"))!=-1) {
+		switch (opt) {
+		case 'o':
+			for (i=0; i<NOPS; i++) selected[i]=false;
+			for (name=strtok(optarg, ","); name; name=strtok(NULL, ",")) {
+				for (i=0; i<NOPS && strcmp(ops[i].name, name)!=0; i++);
+				if (i==NOPS) {
+					fprintf(stderr, "unknown operation %s\n", name);
+					return 2;
+				}
+				selected[i]=true;
+			}
+			break;
+		case 't': min_seconds=atof(optarg); break;
+		case 'w': warmup_seconds=atof(optarg); break;
+		case 'p': counters=true; break;
+		case 'j': parallel_threads=atoi(optarg); break;
+		case 'r': resultsfile=optarg; break;
+		case 'b': baselinefile=optarg; break;
+		case 'x': threshold=atof(optarg); break;
+		case 'S': scaling=atoi(optarg); break;
+		case 'l':
+			for (i=0; i<NOPS; i++) printf("%-18s %s\n", ops[i].name, ops[i].description);
+			return 0;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind>=argc || parallel_threads<1) {
+		usage();
+		return 2;
 	}
 
-	testname=argv[2];
+	for (; optind<argc; optind++) load_corpus(argv[optind], &docs, &ndocs);
+	if (!ndocs) {
+		fprintf(stderr, "no documents\n");
+		return 2;
+	}
 
-	stdin=fopen(argv[1], "r");
-	if (!stdin) {
-		printf("Error opening file\n");
-		return 3;
+	if (scaling>0) {
+		for (d=0; d<ndocs; d++) parallel_scaling(docs[d], scaling);
+		return 0;
 	}
 
-	dynbuffer_read_file(&sourcebuf, stdin);
-	source=sourcebuf.contents;
-	sourcelen=sourcebuf.pos;
+	if (counters) open_counters();
+	print_header(counters_open);
 
-	if (strcmp("tojson", testname)==0) testproc=test_json_to_json;
-	else if (strcmp("tobinary", testname)==0) testproc=test_json_to_binary;
-	else if (strcmp("dummy", testname)==0) testproc=dummy;
-	else if (strcmp("validate", testname)==0) testproc=test_validate;
-	else if (strcmp("frombinary", testname)==0) {
-		setup_binary_to_json();
-		testproc=test_json_from_binary;
+	results=(result_t*)malloc(NOPS*ndocs*sizeof(result_t));
+	for (i=0; i<NOPS; i++) {
+		if (!selected[i]) continue;
+		first=nresults;
+		for (d=0; d<ndocs; d++) {
+			if (!op_applies(&ops[i], docs[d])) continue;
+			if (!measure(&ops[i], docs[d], min_seconds, warmup_seconds, &results[nresults])) {
+				printf("%-18s %-24s failed\n", ops[i].name, docs[d]->name);
+				continue;
+			}
+			print_result(&results[nresults++]);
+		}
+		if (nresults-first>1) print_total(&ops[i], results+first, nresults-first);
+		fflush(stdout);
 	}
-	else {
-		printf("Unrecognized test name\n");
-		return 4;
-	}
-
-	testproc();
 
-	start_timer();
-	for (iterations=0; iterations<100000; iterations++) {
-		testproc();
+	if (resultsfile && !write_results(resultsfile, results, nresults, min_seconds)) return 2;
+	if (baselinefile) {
+		regressions=compare_baseline(baselinefile, results, nresults, threshold);
+		if (regressions<0) return 2;
 	}
-	print_stats();
-	return 0;
+	return regressions ? 1 : 0;
 }
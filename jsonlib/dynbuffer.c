@@ -20,6 +20,18 @@ void dynbuffer_realloc(dynbuffer_t *buffer, size_t needed_capacity)
 	buffer->capacity=new_capacity;
 }
 
+void dynbuffer_resize(dynbuffer_t *buffer, size_t capacity)
+{
+	size_t allocheader=buffer->allocheader;
+
+	if (buffer->contents) {
+		buffer->contents=(uint8_t*)JSON_realloc(buffer->contents-allocheader, capacity+allocheader)+allocheader;
+	} else {
+		buffer->contents=(uint8_t*)JSON_malloc(capacity+allocheader)+allocheader;
+	}
+	buffer->capacity=capacity;
+}
+
 bool dynbuffer_read_file(dynbuffer_t *buffer, FILE *input)
 {
 	size_t r;
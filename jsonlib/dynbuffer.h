@@ -21,6 +21,7 @@ typedef struct {
 } dynbuffer_t;
 
 extern void dynbuffer_realloc(dynbuffer_t *buffer, size_t needed_capacity);
+extern void dynbuffer_resize(dynbuffer_t *buffer, size_t capacity);
 
 /**
  * Initialize a dynbuffer that starts with zero capacity
@@ -37,6 +38,13 @@ extern void dynbuffer_realloc(dynbuffer_t *buffer, size_t needed_capacity);
 	
 #define dynbuffer_ensure_delta(dynbuffer, more_capacity) \
 	dynbuffer_ensure(dynbuffer, (dynbuffer)->pos+more_capacity);
+
+/**
+ * Grow to exactly needed_capacity, for a caller that knows (or has a good
+ * estimate of) the final size.  dynbuffer_resize also shrinks.
+ */
+#define dynbuffer_ensure_exact(dynbuffer, needed_capacity) {\
+	if ((dynbuffer)->capacity<needed_capacity) dynbuffer_resize(dynbuffer, needed_capacity); }
 	
 #define dynbuffer_allocbuffer(dynbuffer) \
 	((dynbuffer)->contents-(dynbuffer)->allocheader)
@@ -0,0 +1,232 @@
+#include "jsonutil.h"
+#include "jsonbinary.h"
+#include "jsonpacked.h"
+#include "jsontable.h"
+
+typedef enum {
+	ARRAY_FORM_REGULAR,
+	ARRAY_FORM_PACKED,
+	ARRAY_FORM_TABLE
+} array_form_t;
+
+typedef struct {
+	array_form_t form;
+	jsonpacked_t packed;
+	jsontable_t table;
+} array_t;
+
+/**
+ * Open the top level value of source.  For a packed array or table, the
+ * matching member of array is filled in.  Otherwise data/datalen bound the
+ * elements of a regular array.
+ */
+static json_array_status_t open_array(uint8_t *source, size_t sourcelen, array_t *array, uint8_t **outdata, uint32_t *outdatalen)
+{
+	uint8_t typecode;
+
+	if (!jsonbinary_extract_type_length(source, source+sourcelen, &typecode, outdata, outdatalen))
+		return JSON_ARRAY_CORRUPT;
+
+	array->form=ARRAY_FORM_REGULAR;
+	if (typecode==JSONBINARY_TYPE_ARRAY) return JSON_ARRAY_OK;
+	if (typecode!=JSONBINARY_TYPE_EXTENDED) return JSON_ARRAY_NOT_ARRAY;
+
+	if (*outdatalen && **outdata==JSONBINARY_EXT_TABLE) {
+		if (!jsontable_open(*outdata, *outdatalen, &array->table)) return JSON_ARRAY_CORRUPT;
+		array->form=ARRAY_FORM_TABLE;
+		return JSON_ARRAY_OK;
+	}
+
+	if (!jsonpacked_open(*outdata, *outdatalen, &array->packed)) return JSON_ARRAY_CORRUPT;
+	array->form=ARRAY_FORM_PACKED;
+	return JSON_ARRAY_OK;
+}
+
+/**
+ * Iterate the elements of a regular array, parsing each as a number.
+ * Sets *outvalue and advances *cursor.
+ */
+static json_array_status_t next_number(uint8_t **cursor, uint8_t *limit, double *outvalue)
+{
+	uint8_t typecode;
+	uint8_t *data;
+	uint32_t datalen;
+
+	if (!jsonbinary_extract_type_length(*cursor, limit, &typecode, &data, &datalen)) return JSON_ARRAY_CORRUPT;
+	*cursor=data+datalen;
+
+	if (typecode!=JSONBINARY_TYPE_NUMBER) return JSON_ARRAY_NOT_NUMERIC;
+	if (!jsonpacked_parse_double(data, datalen, false, outvalue)) return JSON_ARRAY_NOT_NUMERIC;
+	return JSON_ARRAY_OK;
+}
+
+json_array_status_t json_array_length(uint8_t *source, size_t sourcelen, uint32_t *outcount)
+{
+	array_t array;
+	uint8_t *data, *limit;
+	uint32_t datalen;
+	uint8_t typecode;
+	uint32_t count=0;
+	json_array_status_t status;
+
+	status=open_array(source, sourcelen, &array, &data, &datalen);
+	if (status!=JSON_ARRAY_OK) return status;
+
+	if (array.form==ARRAY_FORM_PACKED) {
+		*outcount=array.packed.count;
+		return JSON_ARRAY_OK;
+	}
+	if (array.form==ARRAY_FORM_TABLE) {
+		*outcount=array.table.rows;
+		return JSON_ARRAY_OK;
+	}
+
+	limit=data+datalen;
+	while (data<limit) {
+		if (!jsonbinary_extract_type_length(data, limit, &typecode, &data, &datalen)) return JSON_ARRAY_CORRUPT;
+		data+=datalen;
+		count++;
+	}
+
+	*outcount=count;
+	return JSON_ARRAY_OK;
+}
+
+json_array_status_t json_array_sum(uint8_t *source, size_t sourcelen, double *outsum)
+{
+	array_t array;
+	uint8_t *data, *limit;
+	uint32_t datalen;
+	double value, sum=0;
+	json_array_status_t status;
+
+	status=open_array(source, sourcelen, &array, &data, &datalen);
+	if (status!=JSON_ARRAY_OK) return status;
+
+	if (array.form==ARRAY_FORM_PACKED) {
+		*outsum=jsonpacked_sum(&array.packed);
+		return JSON_ARRAY_OK;
+	}
+	if (array.form==ARRAY_FORM_TABLE) return JSON_ARRAY_NOT_NUMERIC;
+
+	limit=data+datalen;
+	while (data<limit) {
+		status=next_number(&data, limit, &value);
+		if (status!=JSON_ARRAY_OK) return status;
+		sum+=value;
+	}
+
+	*outsum=sum;
+	return JSON_ARRAY_OK;
+}
+
+json_array_status_t json_array_minmax(uint8_t *source, size_t sourcelen, uint32_t *outcount, double *outmin, double *outmax)
+{
+	array_t array;
+	uint8_t *data, *limit;
+	uint32_t datalen;
+	uint32_t count=0;
+	double value;
+	json_array_status_t status;
+
+	status=open_array(source, sourcelen, &array, &data, &datalen);
+	if (status!=JSON_ARRAY_OK) return status;
+
+	if (array.form==ARRAY_FORM_PACKED) {
+		*outcount=array.packed.count;
+		jsonpacked_minmax(&array.packed, outmin, outmax);
+		return JSON_ARRAY_OK;
+	}
+	if (array.form==ARRAY_FORM_TABLE) return JSON_ARRAY_NOT_NUMERIC;
+
+	limit=data+datalen;
+	while (data<limit) {
+		status=next_number(&data, limit, &value);
+		if (status!=JSON_ARRAY_OK) return status;
+		if (!count || value<*outmin) *outmin=value;
+		if (!count || value>*outmax) *outmax=value;
+		count++;
+	}
+
+	*outcount=count;
+	return JSON_ARRAY_OK;
+}
+
+json_array_status_t json_array_contains_number(uint8_t *source, size_t sourcelen, double value, bool *outfound)
+{
+	array_t array;
+	uint8_t *data, *limit;
+	uint32_t datalen;
+	double element;
+	json_array_status_t status;
+
+	status=open_array(source, sourcelen, &array, &data, &datalen);
+	if (status!=JSON_ARRAY_OK) return status;
+
+	if (array.form==ARRAY_FORM_PACKED) {
+		*outfound=jsonpacked_contains(&array.packed, value);
+		return JSON_ARRAY_OK;
+	}
+
+	/* tables hold only objects */
+	*outfound=false;
+	if (array.form==ARRAY_FORM_TABLE) return JSON_ARRAY_OK;
+	limit=data+datalen;
+	while (data<limit) {
+		status=next_number(&data, limit, &element);
+		if (status==JSON_ARRAY_CORRUPT) return status;
+		if (status==JSON_ARRAY_OK && element==value) {
+			*outfound=true;
+			break;
+		}
+	}
+
+	return JSON_ARRAY_OK;
+}
+
+json_array_status_t json_array_element(uint8_t *source, size_t sourcelen, uint32_t index, dynbuffer_t *dest, bool *outfound)
+{
+	array_t array;
+	uint8_t *data, *limit, *element;
+	uint32_t datalen;
+	uint8_t typecode;
+	char number[JSONPACKED_FORMAT_MAX];
+	uint32_t count=0;
+	json_array_status_t status;
+
+	status=open_array(source, sourcelen, &array, &data, &datalen);
+	if (status!=JSON_ARRAY_OK) return status;
+
+	*outfound=false;
+	if (array.form==ARRAY_FORM_PACKED) {
+		if (index<array.packed.count) {
+			jsonbinary_write_value(dest, JSONBINARY_TYPE_NUMBER, (uint8_t*)number, jsonpacked_format(&array.packed, index, number));
+			*outfound=true;
+		}
+		return JSON_ARRAY_OK;
+	}
+	if (array.form==ARRAY_FORM_TABLE) {
+		if (index<array.table.rows) {
+			if (!jsontable_write_row(&array.table, index, dest)) return JSON_ARRAY_CORRUPT;
+			*outfound=true;
+		}
+		return JSON_ARRAY_OK;
+	}
+
+	limit=data+datalen;
+	while (data<limit) {
+		element=data;
+		if (!jsonbinary_extract_type_length(element, limit, &typecode, &data, &datalen)) return JSON_ARRAY_CORRUPT;
+		data+=datalen;
+
+		if (count==index) {
+			/* copy the element including its type and length */
+			dynbuffer_append(dest, element, data-element);
+			*outfound=true;
+			break;
+		}
+		count++;
+	}
+
+	return JSON_ARRAY_OK;
+}
@@ -0,0 +1,94 @@
+#include "jsonutil.h"
+
+/* only where the failing token starts matters, not the values */
+#define JSONLEX_TRACK_POSITION 1
+#define JSONLEX_CHECK_ONLY 1
+
+#define JSONPARSE_EXTRA_DECL \
+	const char *error; \
+	jsonlex_token_t error_token;
+
+#define JSONPARSE_ACTION_ERROR(msg, got) \
+	parsestate->error=msg; \
+	parsestate->error_token=got;
+
+#include "jsonlex.inc.c"
+#include "jsonparse.inc.c"
+
+/* bytes of text shown either side of the error */
+#define DIAGNOSE_EXCERPT 24
+
+bool json_diagnose_json(uint8_t *source, size_t sourcelen, dynbuffer_t *dest)
+{
+	return json_diagnose_json_at(source, sourcelen, 1, dest);
+}
+
+bool json_diagnose_json_at(uint8_t *source, size_t sourcelen, uint64_t firstline, dynbuffer_t *dest)
+{
+	jsonparseinfo_t parseinfo;
+	uint8_t *sourcelimit=source+sourcelen;
+	uint8_t *pos, *p, *linestart, *lineend, *from, *to;
+	uint64_t line=firstline;
+	int column=1;
+	bool valid;
+	char excerpt[2*DIAGNOSE_EXCERPT+1];
+	char message[256];
+	int i, len;
+
+	jsonlex_init_io(&parseinfo.lexstate, source, sourcelen);
+	parseinfo.error=NULL;
+
+	valid=jsonparse(&parseinfo);
+
+	/* a string goes wrong at the character the lexer stopped after rather
+	 * than at its quote */
+	pos=parseinfo.lexstate.token_start;
+	if (parseinfo.error && parseinfo.error_token==jsonlex_illegal_string && parseinfo.lexstate.source>pos)
+		pos=parseinfo.lexstate.source-1;
+
+	jsonlex_destroy(&parseinfo.lexstate);
+	if (valid) return false;
+
+	/* columns count characters, not the continuation bytes of UTF-8 */
+	linestart=source;
+	for (p=source; p<pos; p++) {
+		if (*p=='\n') {
+			line++;
+			linestart=p+1;
+		}
+	}
+	for (p=linestart; p<pos; p++) {
+		if ((*p&0xc0)!=0x80) column++;
+	}
+
+	/* the excerpt stays on the line and does not split characters */
+	lineend=memchr(pos, '\n', sourcelimit-pos);
+	if (!lineend) lineend=sourcelimit;
+	from=pos-linestart>DIAGNOSE_EXCERPT ? pos-DIAGNOSE_EXCERPT : linestart;
+	to=lineend-pos>DIAGNOSE_EXCERPT ? pos+DIAGNOSE_EXCERPT : lineend;
+	while (from<pos && (*from&0xc0)==0x80) from++;
+	while (to>pos && to<lineend && (*to&0xc0)==0x80) to--;
+
+	/* the error may be in the encoding, so bytes that are not valid UTF-8
+	 * are shown as ?, and control characters as spaces */
+	len=to-from;
+	valid=jsonutf8_valid(from, len);
+	for (i=0; i<len; i++) {
+		if (from[i]<0x20) excerpt[i]=' ';
+		else if (from[i]>=0x80 && !valid) excerpt[i]='?';
+		else excerpt[i]=from[i];
+	}
+	excerpt[len]=0;
+
+	if (!parseinfo.error) {
+		len=snprintf(message, sizeof(message), "Invalid json at line %llu, column %d: \"%s\"",
+				(unsigned long long)line, column, excerpt);
+	} else {
+		len=snprintf(message, sizeof(message), "%s (got %s) at line %llu, column %d: \"%s\"",
+				parseinfo.error, jsonlex_token_str(parseinfo.error_token), (unsigned long long)line, column, excerpt);
+	}
+	if (len>=(int)sizeof(message)) len=sizeof(message)-1;
+	dynbuffer_append(dest, message, len);
+	dynbuffer_append_byte(dest, 0);
+	return true;
+}
@@ -0,0 +1,645 @@
+#include "jsonutil.h"
+#include "jsonbinary.h"
+#include "jsonpacked.h"
+#include "jsontable.h"
+#include "jsonpath.h"
+
+static json_path_status_t path_eval(uint8_t *value, uint8_t *valuelimit, path_step_t *steps, int nsteps, dynbuffer_t *dest, uint32_t *outcount);
+
+bool json_path_parse(const uint8_t *path, size_t pathlen, path_step_t *steps, int *outnsteps, bool *outwildcard)
+{
+	const uint8_t *p=path, *limit=path+pathlen;
+	int nsteps=0;
+	uint32_t index;
+
+	*outwildcard=false;
+	while (p<limit) {
+		if (*p=='[') {
+			p++;
+			if (p<limit && *p=='*') {
+				p++;
+				steps[nsteps].kind=PATH_STEP_WILDCARD;
+				*outwildcard=true;
+			} else {
+				if (p>=limit || *p<'0' || *p>'9') return false;
+				index=0;
+				while (p<limit && *p>='0' && *p<='9') {
+					if (index>(UINT32_MAX-9)/10) return false;
+					index=index*10 + (*(p++)-'0');
+				}
+				steps[nsteps].kind=PATH_STEP_INDEX;
+				steps[nsteps].index=index;
+			}
+			if (p>=limit || *(p++)!=']') return false;
+		} else {
+			/* a label, optionally preceded by a dot unless it is first */
+			if (*p=='.') {
+				if (!nsteps) return false;
+				p++;
+			} else if (nsteps) {
+				return false;
+			}
+			steps[nsteps].kind=PATH_STEP_LABEL;
+			steps[nsteps].label=p;
+			while (p<limit && *p!='.' && *p!='[') p++;
+			steps[nsteps].labellen=p-steps[nsteps].label;
+			if (!steps[nsteps].labellen) return false;
+		}
+		nsteps++;
+	}
+
+	*outnsteps=nsteps;
+	return true;
+}
+
+/**
+ * Evaluate the remaining steps against a value that is not in the source,
+ * such as a number expanded from a packed array or a row rebuilt from a
+ * table.
+ */
+static json_path_status_t path_eval_scratch(dynbuffer_t *scratch, path_step_t *steps, int nsteps, dynbuffer_t *dest, uint32_t *outcount)
+{
+	return path_eval(scratch->contents, scratch->contents+scratch->pos, steps, nsteps, dest, outcount);
+}
+
+/**
+ * Find label in the object whose data is [data, datalimit)
+ */
+static json_path_status_t find_label(uint8_t *data, uint8_t *datalimit, const uint8_t *label, size_t labellen, uint8_t **outvalue, uint8_t **outvaluelimit)
+{
+	uint8_t *current;
+	uint8_t typecode;
+	uint8_t *valuedata;
+	uint32_t valuelen;
+
+	*outvalue=0;
+	while (data<datalimit) {
+		current=data;
+		while (data<datalimit && *data) data++;
+		if (data>=datalimit) return JSON_PATH_CORRUPT;
+		data++;
+
+		if (!jsonbinary_extract_type_length(data, datalimit, &typecode, &valuedata, &valuelen)) return JSON_PATH_CORRUPT;
+		if ((size_t)(data-current-1)==labellen && memcmp(current, label, labellen)==0) {
+			*outvalue=data;
+			*outvaluelimit=valuedata+valuelen;
+			return JSON_PATH_OK;
+		}
+		data=valuedata+valuelen;
+	}
+	return JSON_PATH_OK;
+}
+
+/**
+ * Evaluate [*] followed by steps over a table.  When the next step is a
+ * label only that column is read.
+ */
+static json_path_status_t table_wildcard(jsontable_t *table, path_step_t *steps, int nsteps, dynbuffer_t *dest, uint32_t *outcount)
+{
+	jsontable_column_t column;
+	dynbuffer_t scratch=dynbuffer_init();
+	uint8_t *value;
+	uint32_t valuelen, row;
+	bool found;
+	json_path_status_t status=JSON_PATH_OK;
+
+	if (nsteps && steps[0].kind==PATH_STEP_LABEL) {
+		if (!jsontable_find_column(table, steps[0].label, steps[0].labellen, &column, &found)) return JSON_PATH_CORRUPT;
+		if (!found) return JSON_PATH_OK;
+
+		for (row=0; row<table->rows; row++) {
+			if (!jsontable_cell(&column, row, &value, &valuelen)) return JSON_PATH_CORRUPT;
+			if (!value) continue;
+			status=path_eval(value, value+valuelen, steps+1, nsteps-1, dest, outcount);
+			if (status!=JSON_PATH_OK) return status;
+		}
+		return JSON_PATH_OK;
+	}
+
+	for (row=0; row<table->rows && status==JSON_PATH_OK; row++) {
+		dynbuffer_clear(&scratch);
+		if (!jsontable_write_row(table, row, &scratch)) status=JSON_PATH_CORRUPT;
+		else status=path_eval_scratch(&scratch, steps, nsteps, dest, outcount);
+	}
+	dynbuffer_destroy(&scratch);
+	return status;
+}
+
+static json_path_status_t extended_step(uint8_t *data, uint32_t datalen, path_step_t *steps, int nsteps, dynbuffer_t *dest, uint32_t *outcount)
+{
+	jsonpacked_t packed;
+	jsontable_t table;
+	dynbuffer_t scratch=dynbuffer_init();
+	char number[JSONPACKED_FORMAT_MAX];
+	uint32_t first, last, index;
+	json_path_status_t status=JSON_PATH_OK;
+
+	if (datalen && *data==JSONBINARY_EXT_TABLE) {
+		if (!jsontable_open(data, datalen, &table)) return JSON_PATH_CORRUPT;
+		if (steps[0].kind==PATH_STEP_WILDCARD) return table_wildcard(&table, steps+1, nsteps-1, dest, outcount);
+		if (steps[0].kind!=PATH_STEP_INDEX || steps[0].index>=table.rows) return JSON_PATH_OK;
+
+		if (!jsontable_write_row(&table, steps[0].index, &scratch)) status=JSON_PATH_CORRUPT;
+		else status=path_eval_scratch(&scratch, steps+1, nsteps-1, dest, outcount);
+		dynbuffer_destroy(&scratch);
+		return status;
+	}
+
+	if (!jsonpacked_open(data, datalen, &packed)) return JSON_PATH_CORRUPT;
+	if (steps[0].kind==PATH_STEP_WILDCARD) {
+		first=0;
+		last=packed.count;
+	} else if (steps[0].kind==PATH_STEP_INDEX && steps[0].index<packed.count) {
+		first=steps[0].index;
+		last=first+1;
+	} else {
+		return JSON_PATH_OK;
+	}
+
+	for (index=first; index<last && status==JSON_PATH_OK; index++) {
+		dynbuffer_clear(&scratch);
+		jsonbinary_write_value(&scratch, JSONBINARY_TYPE_NUMBER, (uint8_t*)number, jsonpacked_format(&packed, index, number));
+		status=path_eval_scratch(&scratch, steps+1, nsteps-1, dest, outcount);
+	}
+	dynbuffer_destroy(&scratch);
+	return status;
+}
+
+/**
+ * Evaluate steps against the value (type, length and data) at
+ * [value, valuelimit), appending each match to dest.
+ */
+static json_path_status_t path_eval(uint8_t *value, uint8_t *valuelimit, path_step_t *steps, int nsteps, dynbuffer_t *dest, uint32_t *outcount)
+{
+	uint8_t typecode;
+	uint8_t *data, *datalimit, *element, *found, *foundlimit;
+	uint32_t datalen, index;
+	json_path_status_t status;
+
+	JSON_CHECK_STACK();
+	if (!nsteps) {
+		dynbuffer_append(dest, value, valuelimit-value);
+		(*outcount)++;
+		return JSON_PATH_OK;
+	}
+
+	if (!jsonbinary_extract_type_length(value, valuelimit, &typecode, &data, &datalen)) return JSON_PATH_CORRUPT;
+	datalimit=data+datalen;
+
+	switch (steps[0].kind) {
+	case PATH_STEP_LABEL:
+		if (typecode!=JSONBINARY_TYPE_OBJECT) return JSON_PATH_OK;
+		status=find_label(data, datalimit, steps[0].label, steps[0].labellen, &found, &foundlimit);
+		if (status!=JSON_PATH_OK || !found) return status;
+		return path_eval(found, foundlimit, steps+1, nsteps-1, dest, outcount);
+
+	case PATH_STEP_INDEX:
+	case PATH_STEP_WILDCARD:
+		if (typecode==JSONBINARY_TYPE_EXTENDED) return extended_step(data, datalen, steps, nsteps, dest, outcount);
+		if (typecode!=JSONBINARY_TYPE_ARRAY) return JSON_PATH_OK;
+
+		index=0;
+		while (data<datalimit) {
+			element=data;
+			if (!jsonbinary_extract_type_length(element, datalimit, &typecode, &data, &datalen)) return JSON_PATH_CORRUPT;
+			data+=datalen;
+
+			if (steps[0].kind==PATH_STEP_WILDCARD || index==steps[0].index) {
+				status=path_eval(element, data, steps+1, nsteps-1, dest, outcount);
+				if (status!=JSON_PATH_OK || steps[0].kind==PATH_STEP_INDEX) return status;
+			}
+			index++;
+		}
+		return JSON_PATH_OK;
+	}
+
+	return JSON_PATH_OK;
+}
+
+json_path_status_t json_path_get(uint8_t *source, size_t sourcelen, const uint8_t *path, size_t pathlen, dynbuffer_t *dest, bool *outfound)
+{
+	path_step_t *steps;
+	int nsteps;
+	bool wildcard;
+	uint32_t count=0;
+	uint32_t startpos=0;
+	json_path_status_t status;
+
+	*outfound=false;
+	steps=(path_step_t*)JSON_malloc(sizeof(path_step_t) * (pathlen+1));
+	if (!json_path_parse(path, pathlen, steps, &nsteps, &wildcard)) {
+		JSON_free(steps);
+		return JSON_PATH_SYNTAX;
+	}
+
+	if (wildcard) startpos=jsonbinary_begin_container(dest);
+	status=path_eval(source, source+sourcelen, steps, nsteps, dest, &count);
+	if (wildcard) jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+
+	JSON_free(steps);
+	*outfound=wildcard || count>0;
+	return status;
+}
+
+/*** projection ***/
+
+/**
+ * The paths given to json_project are merged into a trie of steps.  A
+ * terminal node selects its whole value.  Nodes are kept in one array and
+ * linked by index.
+ */
+typedef struct {
+	path_step_t step;
+	bool terminal;
+	int firstchild;
+	int nextsibling;
+} trie_node_t;
+
+typedef struct {
+	trie_node_t *nodes;
+	int count;
+	int capacity;
+} path_trie_t;
+
+static bool step_equals(path_step_t *a, path_step_t *b)
+{
+	if (a->kind!=b->kind) return false;
+	if (a->kind==PATH_STEP_LABEL) return a->labellen==b->labellen && memcmp(a->label, b->label, a->labellen)==0;
+	if (a->kind==PATH_STEP_INDEX) return a->index==b->index;
+	return true;
+}
+
+static int trie_child(path_trie_t *trie, int parent, path_step_t *step, bool create)
+{
+	int child;
+
+	for (child=trie->nodes[parent].firstchild; child>=0; child=trie->nodes[child].nextsibling) {
+		if (step_equals(&trie->nodes[child].step, step)) return child;
+	}
+	if (!create) return -1;
+
+	if (trie->count==trie->capacity) {
+		trie->capacity*=2;
+		trie->nodes=(trie_node_t*)JSON_realloc(trie->nodes, sizeof(trie_node_t)*trie->capacity);
+	}
+	child=trie->count++;
+	trie->nodes[child].step=*step;
+	trie->nodes[child].terminal=false;
+	trie->nodes[child].firstchild=-1;
+	trie->nodes[child].nextsibling=trie->nodes[parent].firstchild;
+	trie->nodes[parent].firstchild=child;
+	return child;
+}
+
+/**
+ * Add everything selected under src to dst, so that an element picked by
+ * [n] also gets what [*] selects.
+ */
+static void trie_merge(path_trie_t *trie, int dst, int src)
+{
+	path_step_t step;
+	int child, dstchild;
+
+	if (trie->nodes[src].terminal) trie->nodes[dst].terminal=true;
+	for (child=trie->nodes[src].firstchild; child>=0; child=trie->nodes[child].nextsibling) {
+		/* copied, since adding a node may move the array */
+		step=trie->nodes[child].step;
+		dstchild=trie_child(trie, dst, &step, true);
+		trie_merge(trie, dstchild, child);
+	}
+}
+
+static void trie_merge_wildcards(path_trie_t *trie, int node)
+{
+	path_step_t wildcardstep;
+	int wildcard, child;
+
+	wildcardstep.kind=PATH_STEP_WILDCARD;
+	wildcard=trie_child(trie, node, &wildcardstep, false);
+	for (child=trie->nodes[node].firstchild; child>=0; child=trie->nodes[child].nextsibling) {
+		if (wildcard>=0 && trie->nodes[child].step.kind==PATH_STEP_INDEX) trie_merge(trie, child, wildcard);
+		trie_merge_wildcards(trie, child);
+	}
+}
+
+/**
+ * The child for an array element: [index] (which includes what [*]
+ * selects) or else [*]
+ */
+static int trie_element_child(path_trie_t *trie, int node, uint32_t index)
+{
+	path_step_t step;
+	int child;
+
+	step.kind=PATH_STEP_INDEX;
+	step.index=index;
+	child=trie_child(trie, node, &step, false);
+	if (child>=0) return child;
+
+	step.kind=PATH_STEP_WILDCARD;
+	return trie_child(trie, node, &step, false);
+}
+
+static json_path_status_t project_value(path_trie_t *trie, int node, uint8_t *value, uint8_t *valuelimit, dynbuffer_t *dest, bool *produced);
+
+/**
+ * Project a value that is not in the source, such as a row rebuilt from a
+ * table
+ */
+static json_path_status_t project_scratch(path_trie_t *trie, int node, dynbuffer_t *scratch, dynbuffer_t *dest, bool *produced)
+{
+	return project_value(trie, node, scratch->contents, scratch->contents+scratch->pos, dest, produced);
+}
+
+/**
+ * If the only child of node is [*] and every child of that is a terminal
+ * label, the table can be projected by copying the selected columns whole.
+ * @return the [*] node or -1
+ */
+static int table_column_subset(path_trie_t *trie, int node)
+{
+	int wildcard=trie->nodes[node].firstchild;
+	int child;
+
+	if (wildcard<0 || trie->nodes[wildcard].nextsibling>=0) return -1;
+	if (trie->nodes[wildcard].step.kind!=PATH_STEP_WILDCARD || trie->nodes[wildcard].terminal) return -1;
+
+	for (child=trie->nodes[wildcard].firstchild; child>=0; child=trie->nodes[child].nextsibling) {
+		if (trie->nodes[child].step.kind!=PATH_STEP_LABEL || !trie->nodes[child].terminal) return -1;
+	}
+	return wildcard;
+}
+
+/**
+ * Count the columns of table selected under wildcard and check whether
+ * every row has at least one of them
+ */
+static json_path_status_t table_selected_columns(path_trie_t *trie, int wildcard, jsontable_t *table, uint32_t *selected, bool *everyrow)
+{
+	jsontable_column_t column;
+	dynbuffer_t covered=dynbuffer_init();
+	uint8_t *cursor=table->columns;
+	uint8_t *labelcursor=table->labels;
+	uint32_t col, row, index;
+	uint32_t bitmapsize=(table->rows+7)/8;
+	path_step_t step;
+
+	dynbuffer_ensure(&covered, bitmapsize);
+	if (bitmapsize) memset(covered.contents, 0, bitmapsize);
+
+	step.kind=PATH_STEP_LABEL;
+	*selected=0;
+	for (col=0; col<table->cols; col++) {
+		if (!jsontable_read_column(table, &cursor, &labelcursor, &column)) {
+			dynbuffer_destroy(&covered);
+			return JSON_PATH_CORRUPT;
+		}
+		step.label=column.label;
+		step.labellen=column.labellen;
+		if (trie_child(trie, wildcard, &step, false)<0) continue;
+		(*selected)++;
+		for (index=0; index<bitmapsize; index++) covered.contents[index]|=column.present[index];
+	}
+
+	*everyrow=true;
+	for (row=0; row<table->rows && *everyrow; row++) *everyrow=JSONTABLE_BIT(covered.contents, row);
+	dynbuffer_destroy(&covered);
+	return JSON_PATH_OK;
+}
+
+/**
+ * Project the rows of a table.  If table_column_subset applies and every
+ * row has a selected column, the selected columns are copied whole and
+ * *ascolumns is set.  Otherwise each row is rebuilt and projected as an
+ * element of a plain array would be, so that rows without a selected key
+ * are dropped the same way whichever way the array is stored.
+ */
+static json_path_status_t project_table(path_trie_t *trie, int node, jsontable_t *table, dynbuffer_t *dest, bool *ascolumns)
+{
+	jsontable_column_t column;
+	dynbuffer_t scratch=dynbuffer_init();
+	uint8_t *cursor, *labelcursor, *columnstart;
+	uint32_t col, selected, row;
+	int wildcard, child;
+	path_step_t step;
+	bool produced, everyrow=false;
+	json_path_status_t status=JSON_PATH_OK;
+
+	*ascolumns=false;
+	wildcard=table_column_subset(trie, node);
+	if (wildcard>=0) {
+		status=table_selected_columns(trie, wildcard, table, &selected, &everyrow);
+		if (status!=JSON_PATH_OK) return status;
+		/* no row has a selected key, so the result is an empty array */
+		if (!selected) return JSON_PATH_OK;
+	}
+
+	if (wildcard>=0 && everyrow) {
+		/* copy the selected labels and column bodies */
+		dynbuffer_append_byte(dest, JSONBINARY_EXT_TABLE);
+		jsonbinary_write_varint(dest, table->rows);
+		jsonbinary_write_varint(dest, selected);
+		step.kind=PATH_STEP_LABEL;
+		labelcursor=table->labels;
+		for (col=0; col<table->cols; col++) {
+			step.label=labelcursor;
+			step.labellen=strlen((char*)labelcursor);
+			if (trie_child(trie, wildcard, &step, false)>=0) dynbuffer_append(dest, labelcursor, step.labellen+1);
+			labelcursor+=step.labellen+1;
+		}
+
+		cursor=table->columns;
+		labelcursor=table->labels;
+		for (col=0; col<table->cols; col++) {
+			columnstart=cursor;
+			if (!jsontable_read_column(table, &cursor, &labelcursor, &column)) return JSON_PATH_CORRUPT;
+			step.label=column.label;
+			step.labellen=column.labellen;
+			if (trie_child(trie, wildcard, &step, false)>=0) dynbuffer_append(dest, columnstart, cursor-columnstart);
+		}
+		*ascolumns=true;
+		return JSON_PATH_OK;
+	}
+
+	/* rebuild each selected row and project it */
+	for (row=0; row<table->rows && status==JSON_PATH_OK; row++) {
+		child=trie_element_child(trie, node, row);
+		if (child<0) continue;
+		dynbuffer_clear(&scratch);
+		if (!jsontable_write_row(table, row, &scratch)) status=JSON_PATH_CORRUPT;
+		else status=project_scratch(trie, child, &scratch, dest, &produced);
+	}
+	dynbuffer_destroy(&scratch);
+	return status;
+}
+
+/**
+ * Write the projection of value under node to dest.  *produced is false if
+ * nothing under node applies to the value, in which case dest is unchanged.
+ */
+static json_path_status_t project_value(path_trie_t *trie, int node, uint8_t *value, uint8_t *valuelimit, dynbuffer_t *dest, bool *produced)
+{
+	uint8_t typecode, elementtype;
+	uint8_t *data, *datalimit, *label, *element;
+	uint32_t datalen, index, startpos, memberpos;
+	size_t restorepos=dest->pos;
+	dynbuffer_t scratch=dynbuffer_init();
+	jsonpacked_t packed;
+	jsontable_t table;
+	char number[JSONPACKED_FORMAT_MAX];
+	path_step_t step;
+	int child, firstchild=trie->nodes[node].firstchild;
+	bool labels=false, elements=false;
+	bool childproduced, anyproduced=false, ascolumns;
+	json_path_status_t status=JSON_PATH_OK;
+
+	JSON_CHECK_STACK();
+	*produced=false;
+	if (trie->nodes[node].terminal) {
+		dynbuffer_append(dest, value, valuelimit-value);
+		*produced=true;
+		return JSON_PATH_OK;
+	}
+
+	if (!jsonbinary_extract_type_length(value, valuelimit, &typecode, &data, &datalen)) return JSON_PATH_CORRUPT;
+	datalimit=data+datalen;
+
+	/* labels apply to objects, indexes and [*] to arrays */
+	for (child=firstchild; child>=0; child=trie->nodes[child].nextsibling) {
+		if (trie->nodes[child].step.kind==PATH_STEP_LABEL) labels=true;
+		else elements=true;
+	}
+	if (typecode==JSONBINARY_TYPE_OBJECT ? !labels :
+			!(elements && (typecode==JSONBINARY_TYPE_ARRAY || typecode==JSONBINARY_TYPE_EXTENDED)))
+		return JSON_PATH_OK;
+
+	startpos=jsonbinary_begin_container(dest);
+	switch (typecode) {
+	case JSONBINARY_TYPE_OBJECT:
+		step.kind=PATH_STEP_LABEL;
+		while (data<datalimit) {
+			label=data;
+			while (data<datalimit && *data) data++;
+			if (data>=datalimit) return JSON_PATH_CORRUPT;
+			data++;
+
+			element=data;
+			if (!jsonbinary_extract_type_length(element, datalimit, &elementtype, &data, &datalen)) return JSON_PATH_CORRUPT;
+			data+=datalen;
+
+			step.label=label;
+			step.labellen=element-label-1;
+			child=trie_child(trie, node, &step, false);
+			if (child<0) continue;
+
+			memberpos=dest->pos;
+			dynbuffer_append(dest, label, element-label);
+			status=project_value(trie, child, element, data, dest, &childproduced);
+			if (status!=JSON_PATH_OK) return status;
+			if (!childproduced) dest->pos=memberpos;
+			anyproduced=anyproduced || childproduced;
+		}
+
+		/* an object none of whose selected keys matched is not produced */
+		if (!anyproduced) {
+			dest->pos=restorepos;
+			return JSON_PATH_OK;
+		}
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_OBJECT, startpos);
+		break;
+
+	case JSONBINARY_TYPE_ARRAY:
+		index=0;
+		while (data<datalimit) {
+			element=data;
+			if (!jsonbinary_extract_type_length(element, datalimit, &elementtype, &data, &datalen)) return JSON_PATH_CORRUPT;
+			data+=datalen;
+
+			child=trie_element_child(trie, node, index++);
+			if (child<0) continue;
+			status=project_value(trie, child, element, data, dest, &childproduced);
+			if (status!=JSON_PATH_OK) return status;
+		}
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		break;
+
+	case JSONBINARY_TYPE_EXTENDED:
+		/* [*] alone selects every element unchanged */
+		if (trie->nodes[firstchild].step.kind==PATH_STEP_WILDCARD && trie->nodes[firstchild].terminal
+				&& trie->nodes[firstchild].nextsibling<0) {
+			dest->pos=restorepos;
+			dynbuffer_append(dest, value, valuelimit-value);
+			*produced=true;
+			return JSON_PATH_OK;
+		}
+
+		if (datalen && *data==JSONBINARY_EXT_TABLE) {
+			if (!jsontable_open(data, datalen, &table)) return JSON_PATH_CORRUPT;
+			status=project_table(trie, node, &table, dest, &ascolumns);
+			if (status!=JSON_PATH_OK) return status;
+			jsonbinary_finalize_container(dest, ascolumns ? JSONBINARY_TYPE_EXTENDED : JSONBINARY_TYPE_ARRAY, startpos);
+			break;
+		}
+
+		if (!jsonpacked_open(data, datalen, &packed)) return JSON_PATH_CORRUPT;
+		for (index=0; index<packed.count && status==JSON_PATH_OK; index++) {
+			child=trie_element_child(trie, node, index);
+			if (child<0) continue;
+			dynbuffer_clear(&scratch);
+			jsonbinary_write_value(&scratch, JSONBINARY_TYPE_NUMBER, (uint8_t*)number, jsonpacked_format(&packed, index, number));
+			status=project_scratch(trie, child, &scratch, dest, &childproduced);
+		}
+		dynbuffer_destroy(&scratch);
+		if (status!=JSON_PATH_OK) return status;
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		break;
+	}
+
+	*produced=true;
+	return JSON_PATH_OK;
+}
+
+json_path_status_t json_project(uint8_t *source, size_t sourcelen, const uint8_t **paths, const size_t *pathlens, int npaths, dynbuffer_t *dest, bool *outfound)
+{
+	path_trie_t trie;
+	path_step_t *steps;
+	int nsteps, i, step, node;
+	size_t maxpathlen=0;
+	bool wildcard;
+	json_path_status_t status=JSON_PATH_OK;
+
+	*outfound=false;
+	for (i=0; i<npaths; i++) {
+		if (pathlens[i]>maxpathlen) maxpathlen=pathlens[i];
+	}
+
+	trie.capacity=16;
+	trie.count=1;
+	trie.nodes=(trie_node_t*)JSON_malloc(sizeof(trie_node_t)*trie.capacity);
+	trie.nodes[0].terminal=false;
+	trie.nodes[0].firstchild=-1;
+	trie.nodes[0].nextsibling=-1;
+
+	/* steps point into the paths, so the trie can keep them */
+	steps=(path_step_t*)JSON_malloc(sizeof(path_step_t) * (maxpathlen+1));
+	for (i=0; i<npaths; i++) {
+		if (!json_path_parse(paths[i], pathlens[i], steps, &nsteps, &wildcard)) {
+			status=JSON_PATH_SYNTAX;
+			break;
+		}
+		node=0;
+		for (step=0; step<nsteps; step++) {
+			node=trie_child(&trie, node, &steps[step], true);
+		}
+		trie.nodes[node].terminal=true;
+	}
+	JSON_free(steps);
+
+	if (status==JSON_PATH_OK) {
+		trie_merge_wildcards(&trie, 0);
+		status=project_value(&trie, 0, source, source+sourcelen, dest, outfound);
+	}
+
+	JSON_free(trie.nodes);
+	return status;
+}
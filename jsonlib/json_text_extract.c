@@ -0,0 +1,130 @@
+#include "jsonutil.h"
+#include "jsonpath.h"
+
+/* values off the path are passed over with jsonlex_skip_value */
+#define JSONLEX_SKIP 1
+#include "jsonlex.inc.c"
+
+typedef struct {
+	jsonlex_state_t lexstate;
+	dynbuffer_t *dest;
+	bool wildcard;
+	uint32_t count;
+	bool done;		/* set once the single target has been copied */
+} extractstate_t;
+
+/**
+ * Skip whitespace and return the next character without consuming it
+ */
+static int peek_char(jsonlex_state_arg lexstate)
+{
+	int charin;
+
+	for (;;) {
+		charin=JSONLEX_GETC();
+		if (charin<0) return charin;
+		if ((JSONLEX_CC_TABLE[charin]&JSONLEX_CC_CLASSMASK)!=JSONLEX_CC_WHITE) break;
+	}
+	JSONLEX_UNGETC(charin);
+	return charin;
+}
+
+static json_path_status_t extract_value(extractstate_t *state, path_step_t *steps, int nsteps)
+{
+	jsonlex_state_arg lexstate=&state->lexstate;
+	jsonlex_token_t token;
+	uint8_t *start;
+	uint32_t index;
+	bool match;
+	json_path_status_t status;
+	int charin=peek_char(lexstate);
+
+	if (charin<0) return JSON_PATH_CORRUPT;
+
+	if (!nsteps) {
+		/* the target - copy its text as it is */
+		start=lexstate->source;
+		if (!jsonlex_skip_value(lexstate)) return JSON_PATH_CORRUPT;
+		if (state->wildcard && state->count) dynbuffer_append_byte(state->dest, ',');
+		dynbuffer_append(state->dest, start, lexstate->source-start);
+		state->count++;
+		if (!state->wildcard) state->done=true;
+		return JSON_PATH_OK;
+	}
+
+	if (steps[0].kind==PATH_STEP_LABEL) {
+		if (charin!='{') return jsonlex_skip_value(lexstate) ? JSON_PATH_OK : JSON_PATH_CORRUPT;
+		(void)JSONLEX_GETC();
+
+		for (;;) {
+			token=jsonlex_next_token(lexstate);
+			if (token==jsonlex_rbrace) break;
+			if (token!=jsonlex_string && token!=jsonlex_identifier) return JSON_PATH_CORRUPT;
+			match=lexstate->token_len==steps[0].labellen && memcmp(lexstate->token, steps[0].label, steps[0].labellen)==0;
+			if (jsonlex_next_token(lexstate)!=jsonlex_colon) return JSON_PATH_CORRUPT;
+
+			if (match) {
+				status=extract_value(state, steps+1, nsteps-1);
+				if (status!=JSON_PATH_OK || state->done) return status;
+			} else if (!jsonlex_skip_value(lexstate)) {
+				return JSON_PATH_CORRUPT;
+			}
+
+			token=jsonlex_next_token(lexstate);
+			if (token==jsonlex_rbrace) break;
+			if (token!=jsonlex_comma) return JSON_PATH_CORRUPT;
+		}
+		return JSON_PATH_OK;
+	}
+
+	if (charin!='[') return jsonlex_skip_value(lexstate) ? JSON_PATH_OK : JSON_PATH_CORRUPT;
+	(void)JSONLEX_GETC();
+	if (peek_char(lexstate)==']') {
+		(void)JSONLEX_GETC();
+		return JSON_PATH_OK;
+	}
+
+	for (index=0;; index++) {
+		if (steps[0].kind==PATH_STEP_WILDCARD || index==steps[0].index) {
+			status=extract_value(state, steps+1, nsteps-1);
+			if (status!=JSON_PATH_OK || state->done) return status;
+		} else if (!jsonlex_skip_value(lexstate)) {
+			return JSON_PATH_CORRUPT;
+		}
+
+		token=jsonlex_next_token(lexstate);
+		if (token==jsonlex_rbracket) break;
+		if (token!=jsonlex_comma) return JSON_PATH_CORRUPT;
+	}
+	return JSON_PATH_OK;
+}
+
+json_path_status_t json_text_extract(uint8_t *source, size_t sourcelen, const uint8_t *path, size_t pathlen, dynbuffer_t *dest, bool *outfound)
+{
+	extractstate_t state;
+	path_step_t *steps;
+	int nsteps;
+	json_path_status_t status;
+
+	*outfound=false;
+	steps=(path_step_t*)JSON_malloc(sizeof(path_step_t) * (pathlen+1));
+	if (!json_path_parse(path, pathlen, steps, &nsteps, &state.wildcard)) {
+		JSON_free(steps);
+		return JSON_PATH_SYNTAX;
+	}
+
+	jsonlex_init_io(&state.lexstate, source, sourcelen);
+	state.dest=dest;
+	state.count=0;
+	state.done=false;
+
+	if (state.wildcard) dynbuffer_append_byte(dest, '[');
+	status=extract_value(&state, steps, nsteps);
+	if (state.wildcard) dynbuffer_append_byte(dest, ']');
+
+	jsonlex_destroy(&state.lexstate);
+	JSON_free(steps);
+
+	*outfound=state.wildcard || state.count>0;
+	return status;
+}
@@ -1,62 +1,11 @@
 #include "jsonutil.h"
-#include "jsonbinaryconst.h"
+#include "jsonbinary.h"
+#include "jsonpacked.h"
+#include "jsontable.h"
 
-static bool extract_type_length(uint8_t *source, uint8_t *sourcelimit, uint8_t *outtypecode, uint8_t **outdata, uint32_t *outlength)
-{
-	uint8_t typespec;
-	uint32_t lencont;
-	uint32_t length;
-
-	/* decode type byte */
-	if (source>=sourcelimit) return false;
-	typespec=*source;
-	source++;
-	*outtypecode=(typespec>>JSONBINARY_TYPE_SHIFT);
-	length=typespec & 0x0f;
-
-	/* length byte 1 */
-	if (typespec&JSONBINARY_TYPE_LENGTHCONT) {
-		if (source>=sourcelimit) return false;
-		lencont=*(source++);
-		length|=(lencont&0x7f)<<4;
-
-		/* length byte 2 */
-		if (lencont&0x80) {
-			if (source>=sourcelimit) return false;
-			lencont=*(source++);
-			length|=(lencont&0x7f)<<11;
-
-			/* length byte 3 */
-			if (lencont&0x80) {
-				if (source>=sourcelimit) return false;
-				lencont=*(source++);
-				length|=(lencont&0x7f)<<18;
-
-				/* length byte 4 */
-				if (lencont&0x80) {
-					if (source>=sourcelimit) return false;
-					lencont=*(source++);
-					length|=(lencont&0x7f)<<25;
-
-					/* make sure high bit not set on last byte */
-					if (lencont&0x80) return false;
-				}
-			}
-		}
-	}
-
-	/* validate length */
-	if ((source+length)>sourcelimit) return false;
-
-	*outdata=source;
-	*outlength=length;
+static bool output_value(uint8_t *source, uint8_t *sourcelimit, uint8_t typecode, dynbuffer_t *dest, bool ascii_only);
 
-	return true;
-}
-
-static bool output_value(uint8_t *source, uint8_t *sourcelimit, uint8_t typecode, dynbuffer_t *dest);
-
-static bool output_object(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest)
+static bool output_object(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest, bool ascii_only)
 {
 	int index=0;
    uint8_t typecode;
@@ -76,15 +25,15 @@ static bool output_object(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *de
 
 		/* output label */
 		dynbuffer_append_byte(dest, '"');
-		json_escape_string(dest, label, source-label-1, true, '"');
+		json_escape_string(dest, label, source-label-1, ascii_only, '"');
 		dynbuffer_append(dest, "\":", 2);
 
 		/* decode type length */
-		if (!extract_type_length(source, sourcelimit, &typecode, &data, &datalen)) return false;
+		if (!jsonbinary_extract_type_length(source, sourcelimit, &typecode, &data, &datalen)) return false;
 
 		/* output value */
 		source=data+datalen;
-		if (!output_value(data, source, typecode, dest)) return false;
+		if (!output_value(data, source, typecode, dest, ascii_only)) return false;
 
 		index++;
 	}
@@ -93,7 +42,7 @@ static bool output_object(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *de
 	return true;
 }
 
-static bool output_array(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest)
+static bool output_array(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest, bool ascii_only)
 {
 	int index=0;
 
@@ -104,14 +53,14 @@ static bool output_array(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *des
 		uint8_t typecode;
 		uint8_t *data;
 		uint32_t datalen;
-		if (!extract_type_length(source, sourcelimit, &typecode, &data, &datalen)) return false;
+		if (!jsonbinary_extract_type_length(source, sourcelimit, &typecode, &data, &datalen)) return false;
 
 		/* comma */
 		if (index>0) dynbuffer_append_byte(dest, ',');
 
 		/* output value */
 		source=data+datalen;
-		if (!output_value(data, source, typecode, dest)) return false;
+		if (!output_value(data, source, typecode, dest, ascii_only)) return false;
 
 		index++;
 	}
@@ -121,19 +70,94 @@ static bool output_array(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *des
 	return true;
 }
 
-static bool output_value(uint8_t *source, uint8_t *sourcelimit, uint8_t typecode, dynbuffer_t *dest)
+static bool output_table(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest, bool ascii_only)
+{
+	jsontable_t table;
+	jsontable_column_t *columns;
+	uint8_t *cursor, *labelcursor;
+	uint8_t *value, *data;
+	uint32_t valuelen, datalen;
+	uint8_t typecode;
+	uint32_t row, col;
+	int index;
+	bool result=false;
+
+	if (!jsontable_open(source, sourcelimit-source, &table)) return false;
+
+	/* read all column headers, then walk them in step row by row */
+	columns=(jsontable_column_t*)JSON_malloc(sizeof(jsontable_column_t) * (table.cols ? table.cols : 1));
+	cursor=table.columns;
+	labelcursor=table.labels;
+	for (col=0; col<table.cols; col++) {
+		if (!jsontable_read_column(&table, &cursor, &labelcursor, &columns[col])) goto done;
+	}
+
+	dynbuffer_append_byte(dest, '[');
+	for (row=0; row<table.rows; row++) {
+		if (row>0) dynbuffer_append_byte(dest, ',');
+		dynbuffer_append_byte(dest, '{');
+		index=0;
+		for (col=0; col<table.cols; col++) {
+			if (!jsontable_cell(&columns[col], row, &value, &valuelen)) goto done;
+			if (!value) continue;
+
+			if (index>0) dynbuffer_append_byte(dest, ',');
+			dynbuffer_append_byte(dest, '"');
+			json_escape_string(dest, columns[col].label, columns[col].labellen, ascii_only, '"');
+			dynbuffer_append(dest, "\":", 2);
+
+			if (!jsonbinary_extract_type_length(value, value+valuelen, &typecode, &data, &datalen)) goto done;
+			if (!output_value(data, data+datalen, typecode, dest, ascii_only)) goto done;
+			index++;
+		}
+		dynbuffer_append_byte(dest, '}');
+	}
+	dynbuffer_append_byte(dest, ']');
+	result=true;
+
+done:
+	JSON_free(columns);
+	return result;
+}
+
+static bool output_extended(uint8_t *source, uint8_t *sourcelimit, dynbuffer_t *dest, bool ascii_only)
+{
+	jsonpacked_t packed;
+	char number[JSONPACKED_FORMAT_MAX];
+	uint32_t index;
+
+	if (source<sourcelimit && *source==JSONBINARY_EXT_TABLE)
+		return output_table(source, sourcelimit, dest, ascii_only);
+
+	if (!jsonpacked_open(source, sourcelimit-source, &packed)) return false;
+
+	dynbuffer_append_byte(dest, '[');
+	for (index=0; index<packed.count; index++) {
+		if (index>0) dynbuffer_append_byte(dest, ',');
+		dynbuffer_append(dest, number, jsonpacked_format(&packed, index, number));
+	}
+	dynbuffer_append_byte(dest, ']');
+
+	return true;
+}
+
+static bool output_value(uint8_t *source, uint8_t *sourcelimit, uint8_t typecode, dynbuffer_t *dest, bool ascii_only)
 {
 	uint8_t subtype;
 
+	JSON_CHECK_STACK();
+
 	/* switch on type */
 	switch (typecode) {
 	case JSONBINARY_TYPE_OBJECT:
-		return output_object(source, sourcelimit, dest);
+		return output_object(source, sourcelimit, dest, ascii_only);
 	case JSONBINARY_TYPE_ARRAY:
-		return output_array(source, sourcelimit, dest);
+		return output_array(source, sourcelimit, dest, ascii_only);
+	case JSONBINARY_TYPE_EXTENDED:
+		return output_extended(source, sourcelimit, dest, ascii_only);
 	case JSONBINARY_TYPE_STRING:
 		dynbuffer_append_byte(dest, '"');
-		json_escape_string(dest, source, sourcelimit-source, true, '"');
+		json_escape_string(dest, source, sourcelimit-source, ascii_only, '"');
 		dynbuffer_append_byte(dest, '"');
 		break;
 	case JSONBINARY_TYPE_NUMBER:
@@ -174,7 +198,280 @@ bool json_transcode_binary_to_json(uint8_t *source, size_t sourcelen, dynbuffer_
 	uint8_t *data;
 	uint32_t datalen;
 
-	if (!extract_type_length(source, source+sourcelen, &typecode, &data, &datalen)) return false;
+	if (!jsonbinary_extract_type_length(source, source+sourcelen, &typecode, &data, &datalen)) return false;
 
-	return output_value(data, data+datalen, typecode, dest);
+	/* the text is rarely more than a quarter longer than the binary, so
+	 * allocating that up front saves growing dest a step at a time */
+	dynbuffer_ensure_exact(dest, dest->pos+sourcelen+sourcelen/4+1);
+	return output_value(data, data+datalen, typecode, dest, json_ascii_output);
+}
+
+/*
+ * Streaming output.  The same walk as above, but with the open containers
+ * kept on an explicit stack so that it can stop once a chunk is full and
+ * carry on from there on the next call.
+ */
+enum {
+	STREAM_OBJECT,
+	STREAM_ARRAY,
+	STREAM_TABLE,
+	STREAM_PACKED,
+	STREAM_STRING
+};
+
+typedef struct {
+	int kind;
+	uint8_t *cursor;		/* next child, or the rest of a string */
+	uint8_t *limit;
+	uint32_t index;			/* children written, or fields in the table row */
+	bool label;				/* string: it is an object label */
+	bool value_pending;		/* object: the label is written, not the value */
+
+	/* STREAM_TABLE */
+	jsontable_t table;
+	jsontable_column_t *columns;
+	uint32_t row, col;
+
+	/* STREAM_PACKED */
+	jsonpacked_t packed;
+} stream_frame_t;
+
+struct json_from_binary_stream {
+	bool ascii_only;
+	bool started;
+	bool failed;
+	uint8_t typecode;		/* the top level value */
+	uint8_t *data;
+	uint32_t datalen;
+
+	stream_frame_t *stack;
+	int depth;
+	int capacity;
+};
+
+static stream_frame_t *stream_push(json_from_binary_stream_t *stream, int kind, uint8_t *source, uint8_t *sourcelimit)
+{
+	stream_frame_t *frame;
+
+	if (stream->depth==stream->capacity) {
+		if (stream->stack) {
+			stream->capacity*=2;
+			stream->stack=(stream_frame_t*)JSON_realloc(stream->stack, sizeof(stream_frame_t)*stream->capacity);
+		} else {
+			stream->capacity=16;
+			stream->stack=(stream_frame_t*)JSON_malloc(sizeof(stream_frame_t)*stream->capacity);
+		}
+	}
+	frame=&stream->stack[stream->depth++];
+	frame->kind=kind;
+	frame->cursor=source;
+	frame->limit=sourcelimit;
+	frame->index=0;
+	frame->label=false;
+	frame->value_pending=false;
+	frame->columns=0;
+	return frame;
+}
+
+static void stream_pop(json_from_binary_stream_t *stream)
+{
+	stream_frame_t *frame=&stream->stack[--stream->depth];
+
+	if (frame->columns) JSON_free(frame->columns);
+}
+
+/**
+ * Write the start of a value: all of a number or constant, the opening
+ * of a string or container, whose contents are then written from the
+ * frame pushed for it.
+ */
+static bool stream_value(json_from_binary_stream_t *stream, uint8_t *source, uint8_t *sourcelimit, uint8_t typecode, dynbuffer_t *dest)
+{
+	stream_frame_t *frame;
+	uint32_t col;
+	uint8_t *cursor, *labelcursor;
+
+	switch (typecode) {
+	case JSONBINARY_TYPE_OBJECT:
+		dynbuffer_append_byte(dest, '{');
+		stream_push(stream, STREAM_OBJECT, source, sourcelimit);
+		return true;
+	case JSONBINARY_TYPE_ARRAY:
+		dynbuffer_append_byte(dest, '[');
+		stream_push(stream, STREAM_ARRAY, source, sourcelimit);
+		return true;
+	case JSONBINARY_TYPE_STRING:
+		dynbuffer_append_byte(dest, '"');
+		stream_push(stream, STREAM_STRING, source, sourcelimit);
+		return true;
+	case JSONBINARY_TYPE_EXTENDED:
+		if (source<sourcelimit && *source==JSONBINARY_EXT_TABLE) {
+			frame=stream_push(stream, STREAM_TABLE, source, sourcelimit);
+			if (!jsontable_open(source, sourcelimit-source, &frame->table)) return false;
+			frame->columns=(jsontable_column_t*)JSON_malloc(sizeof(jsontable_column_t) * (frame->table.cols ? frame->table.cols : 1));
+			cursor=frame->table.columns;
+			labelcursor=frame->table.labels;
+			for (col=0; col<frame->table.cols; col++) {
+				if (!jsontable_read_column(&frame->table, &cursor, &labelcursor, &frame->columns[col])) return false;
+			}
+			frame->row=0;
+			frame->col=0;
+		} else {
+			frame=stream_push(stream, STREAM_PACKED, source, sourcelimit);
+			if (!jsonpacked_open(source, sourcelimit-source, &frame->packed)) return false;
+		}
+		dynbuffer_append_byte(dest, '[');
+		return true;
+	default:
+		/* the rest are small enough to write whole */
+		return output_value(source, sourcelimit, typecode, dest, stream->ascii_only);
+	}
+}
+
+/**
+ * Take one step in the innermost open value
+ */
+static bool stream_step(json_from_binary_stream_t *stream, dynbuffer_t *dest, size_t room)
+{
+	stream_frame_t *frame=&stream->stack[stream->depth-1];
+	uint8_t typecode;
+	uint8_t *data, *label, *end, *value;
+	uint32_t datalen, valuelen;
+	char number[JSONPACKED_FORMAT_MAX];
+
+	switch (frame->kind) {
+	case STREAM_OBJECT:
+		if (frame->value_pending) {
+			frame->value_pending=false;
+			if (!jsonbinary_extract_type_length(frame->cursor, frame->limit, &typecode, &data, &datalen)) return false;
+			frame->cursor=data+datalen;
+			return stream_value(stream, data, data+datalen, typecode, dest);
+		}
+		if (frame->cursor>=frame->limit) {
+			dynbuffer_append_byte(dest, '}');
+			stream_pop(stream);
+			return true;
+		}
+		label=frame->cursor;
+		for (;;) {
+			if (frame->cursor>=frame->limit) return false;	/* short */
+			if (*(frame->cursor++)==0) break;
+		}
+		if (frame->index++>0) dynbuffer_append_byte(dest, ',');
+		frame->value_pending=true;
+		/* the label is written as a string, which ends with the colon */
+		dynbuffer_append_byte(dest, '"');
+		frame=stream_push(stream, STREAM_STRING, label, frame->cursor-1);
+		frame->label=true;
+		return true;
+
+	case STREAM_ARRAY:
+		if (frame->cursor>=frame->limit) {
+			dynbuffer_append_byte(dest, ']');
+			stream_pop(stream);
+			return true;
+		}
+		if (!jsonbinary_extract_type_length(frame->cursor, frame->limit, &typecode, &data, &datalen)) return false;
+		if (frame->index++>0) dynbuffer_append_byte(dest, ',');
+		frame->cursor=data+datalen;
+		return stream_value(stream, data, data+datalen, typecode, dest);
+
+	case STREAM_TABLE:
+		/* one cell per step, index counting the fields of the current row */
+		if (frame->row>=frame->table.rows) {
+			dynbuffer_append_byte(dest, ']');
+			stream_pop(stream);
+			return true;
+		}
+		if (frame->col==0 && frame->index==0) {
+			if (frame->row>0) dynbuffer_append_byte(dest, ',');
+			dynbuffer_append_byte(dest, '{');
+		}
+		while (frame->col<frame->table.cols) {
+			jsontable_column_t *column=&frame->columns[frame->col++];
+
+			if (!jsontable_cell(column, frame->row, &value, &valuelen)) return false;
+			if (!value) continue;
+
+			if (frame->index++>0) dynbuffer_append_byte(dest, ',');
+			dynbuffer_append_byte(dest, '"');
+			json_escape_string(dest, column->label, column->labellen, stream->ascii_only, '"');
+			dynbuffer_append(dest, "\":", 2);
+			if (!jsonbinary_extract_type_length(value, value+valuelen, &typecode, &data, &datalen)) return false;
+			return stream_value(stream, data, data+datalen, typecode, dest);
+		}
+		dynbuffer_append_byte(dest, '}');
+		frame->row++;
+		frame->col=0;
+		frame->index=0;
+		return true;
+
+	case STREAM_PACKED:
+		if (frame->index>=frame->packed.count) {
+			dynbuffer_append_byte(dest, ']');
+			stream_pop(stream);
+			return true;
+		}
+		if (frame->index>0) dynbuffer_append_byte(dest, ',');
+		dynbuffer_append(dest, number, jsonpacked_format(&frame->packed, frame->index, number));
+		frame->index++;
+		return true;
+
+	case STREAM_STRING:
+		/* as much as there is room for, ending on a character boundary */
+		if (room>=(size_t)(frame->limit-frame->cursor)) {
+			end=frame->limit;
+		} else {
+			end=frame->cursor+room;
+			while (end<frame->limit && (*end&0xc0)==0x80) end++;
+		}
+		json_escape_string(dest, frame->cursor, end-frame->cursor, stream->ascii_only, '"');
+		frame->cursor=end;
+		if (end==frame->limit) {
+			if (frame->label) dynbuffer_append(dest, "\":", 2);
+			else dynbuffer_append_byte(dest, '"');
+			stream_pop(stream);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+json_from_binary_stream_t *json_transcode_binary_to_json_begin(uint8_t *source, size_t sourcelen)
+{
+	json_from_binary_stream_t *stream=(json_from_binary_stream_t*)JSON_malloc(sizeof(json_from_binary_stream_t));
+
+	stream->ascii_only=json_ascii_output;
+	stream->started=false;
+	stream->failed=!jsonbinary_extract_type_length(source, source+sourcelen, &stream->typecode, &stream->data, &stream->datalen);
+	stream->stack=0;
+	stream->depth=0;
+	stream->capacity=0;
+
+	return stream;
+}
+
+bool json_transcode_binary_to_json_next(json_from_binary_stream_t *stream, dynbuffer_t *dest, size_t chunk, bool *outdone)
+{
+	size_t start=dest->pos;
+
+	if (!stream->started && !stream->failed) {
+		stream->started=true;
+		stream->failed=!stream_value(stream, stream->data, stream->data+stream->datalen, stream->typecode, dest);
+	}
+
+	while (!stream->failed && stream->depth>0 && dest->pos-start<chunk) {
+		stream->failed=!stream_step(stream, dest, chunk-(dest->pos-start));
+	}
+
+	*outdone=stream->failed || stream->depth==0;
+	return !stream->failed;
+}
+
+void json_transcode_binary_to_json_end(json_from_binary_stream_t *stream)
+{
+	while (stream->depth>0) stream_pop(stream);
+	if (stream->stack) JSON_free(stream->stack);
+	JSON_free(stream);
 }
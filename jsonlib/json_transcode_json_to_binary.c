@@ -1,205 +1,126 @@
 #include "jsonutil.h"
-#include "jsonbinaryconst.h"
+#include "jsonbinary.h"
+#include "jsonpacked.h"
+#include "jsontable.h"
 
+/**
+ * number_count, integer_count and object_count count the number and object
+ * values that are direct children of the innermost open container.  Each
+ * container saves the counts of its parent in its parser frame and restores
+ * them at its end.  An array whose elements were all numbers is finalized
+ * as a packed array and one whose elements were all objects as a table.
+ *
+ * When outer_counts is set (json_transcode_json_to_binary_begin_segment),
+ * the outermost array is always written as a plain container and its
+ * counts are stored there instead, for the caller to finalize it.
+ */
 #define JSONPARSE_EXTRA_DECL \
 	dynbuffer_t *dest; \
+	json_array_counts_t *outer_counts; \
+	uint32_t number_count; \
+	uint32_t integer_count; \
+	uint32_t object_count; \
 	char error_message[256];
 
-#define DEST (parsestate->dest)
-
-/* number of bytes of length to reserve for objects and arrays */
-#define RESERVE_LENGTH 1
-
-/**
- * Write type and length bytes
- */
-static void write_type_length(dynbuffer_t *dest, uint8_t type, uint32_t length)
-{
-	int i;
-	uint32_t lenchunk;
-	uint8_t nextbyte;
-
-	/* reserve 5 bytes so we can do unchecked writes */
-	dynbuffer_ensure_delta(dest, 5);
-
-	/* byte 1: Type spec */
-	lenchunk=(length&0x0f);
-	length>>=4;
-	nextbyte=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk;
-	if (!length) {
-		/* 4 bit length */
-		dynbuffer_append_byte_nocheck(dest, nextbyte);
-		return;
-	} else {
-		dynbuffer_append_byte_nocheck(dest, nextbyte | JSONBINARY_TYPE_LENGTHCONT);
-	}
-
-	/* byte 2-5 */
-	/* the compiler should unroll this loop */
-	for (i=0; i<4; i++) {
-		lenchunk=length & 0x7f;
-		length>>=7;
-		if (!length) {
-			/* 11 bit length */
-			dynbuffer_append_byte_nocheck(dest, lenchunk);
-			return;
-		} else {
-			dynbuffer_append_byte_nocheck(dest, lenchunk | 0x80);
-		}
-	}
-}
-
-/**
- * finalizes an object or array given the startpos and RESERVE_LENGTH.
- * goes back and writes the type+length bytes, moving the buffer as necessary
- * to ensure length alignment
- */
-static void finalize_object_array(dynbuffer_t *dest, uint8_t type, uint32_t startpos)
-{
-	uint32_t actlen=dest->pos - startpos - RESERVE_LENGTH - 1;
-	uint32_t lenchunk;
-	uint32_t lenshift;
-	uint8_t lenbytes[4];
-	uint32_t lenindex;
-
-	/* ensure we have max needed room to grow */
-	dynbuffer_ensure_delta(dest, 5);
-
-	/* fast path for empty object/array */
-	if (!actlen) {
-		dest->pos=startpos;
-		dynbuffer_append_byte_nocheck(dest, (type<<JSONBINARY_TYPE_SHIFT));
-		return;
-	}
-
-	/* write the type code+4bit length */
-	lenchunk=actlen&0x0f;
-	lenshift=actlen>>4;
-
-	if (!lenshift) {
-		dest->contents[startpos]=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk;
-		if (RESERVE_LENGTH>0) {
-			/* move left by RESERVE_LENGTH */
-			memmove(dest->contents+startpos+1, dest->contents+startpos+1+RESERVE_LENGTH, actlen);
-			dest->pos-=RESERVE_LENGTH;
-		}
-		return;
-	} else {
-		/* more than the typespec byte - write typespec with continue bit set */
-		dest->contents[startpos]=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk | JSONBINARY_TYPE_LENGTHCONT;
-	}
+/* per container: where it starts, the element count of arrays, and the
+ * counts of the parent to restore at the end */
+#define JSONPARSE_FRAME_DECL \
+	uint32_t startpos; \
+	uint32_t elementcount; \
+	uint32_t saved_number_count; \
+	uint32_t saved_integer_count; \
+	uint32_t saved_object_count;
 
-	/* write bytes 2-5 */
-	for (lenindex=0; lenindex<4; lenindex++) {
-		lenchunk=lenshift&0x7f;
-		lenshift>>=7;
-
-		if (!lenshift) {
-			/* end of length */
-			lenbytes[lenindex]=lenchunk;
-			lenindex++;
-			break;
-		} else {
-			/* continues */
-			lenbytes[lenindex]=lenchunk | 0x80;
-		}
-	}
-
-	/* now determine how much to move the buffer */
-	if (lenindex==RESERVE_LENGTH) {
-		/* reserved byte count was correct guess */
-		/* add the lenbytes and return - all pointers are correct */
-		memcpy(dest->contents+startpos+1, lenbytes, RESERVE_LENGTH);
-		return;
-	} else {
-		/* move the object contents forward or back */
-		memmove(dest->contents+startpos+1+lenindex, dest->contents+startpos+1+RESERVE_LENGTH, actlen);
-
-		/* adjust pos */
-		if (lenindex>RESERVE_LENGTH) dest->pos+=(lenindex-RESERVE_LENGTH);
-		else dest->pos-=(RESERVE_LENGTH-lenindex);
-
-		/* add the lenbytes */
-		memcpy(dest->contents+startpos+1, lenbytes, lenindex);
-		return;
-	}
-}
-
-/**
- * append a string to dest as modified utf8
- */
-static void write_object_label(dynbuffer_t *dest, uint8_t *s, size_t len)
-{
-	size_t index;
-	uint8_t c;
-
-	/* reserve len*2 bytes - the neurotic case of all nulls */
-	dynbuffer_ensure_delta(dest, len*2+1);
-
-	for (index=0; index<len; index++) {
-		c=s[index];
-		if (c) dynbuffer_append_byte_nocheck(dest, c);
-		else {
-			dynbuffer_append_byte_nocheck(dest, 0xc0);
-			dynbuffer_append_byte_nocheck(dest, 0x80);
-		}
-	}
-	dynbuffer_append_byte_nocheck(dest, 0);
-}
+#define DEST (parsestate->dest)
+#define FRAME JSONPARSE_FRAME
 
 /* actions */
 #define JSONPARSE_ACTION_OBJECT_START() \
-	uint32_t startpos=DEST->pos; \
-	DEST->pos+=RESERVE_LENGTH+1;
+	FRAME->startpos=jsonbinary_begin_container(DEST); \
+	FRAME->saved_number_count=parsestate->number_count; \
+	FRAME->saved_integer_count=parsestate->integer_count; \
+	FRAME->saved_object_count=parsestate->object_count;
 #define JSONPARSE_ACTION_OBJECT_LABEL(fieldindex, s, len) \
-	write_object_label(DEST, s, len);
+	jsonbinary_write_label(DEST, s, len);
 #define JSONPARSE_ACTION_OBJECT_END() \
-	finalize_object_array(DEST, JSONBINARY_TYPE_OBJECT, startpos);
+	jsonbinary_finalize_container(DEST, JSONBINARY_TYPE_OBJECT, FRAME->startpos); \
+	parsestate->number_count=FRAME->saved_number_count; \
+	parsestate->integer_count=FRAME->saved_integer_count; \
+	parsestate->object_count=FRAME->saved_object_count+1;
 
 
 #define JSONPARSE_ACTION_ARRAY_START() \
-	uint32_t startpos=DEST->pos; \
-	DEST->pos+=RESERVE_LENGTH+1;
+	FRAME->startpos=jsonbinary_begin_container(DEST); \
+	FRAME->saved_number_count=parsestate->number_count; \
+	FRAME->saved_integer_count=parsestate->integer_count; \
+	FRAME->saved_object_count=parsestate->object_count; \
+	FRAME->elementcount=0; \
+	parsestate->number_count=0; \
+	parsestate->integer_count=0; \
+	parsestate->object_count=0;
+#define JSONPARSE_ACTION_ARRAY_ELEMENT(elementindex) \
+	FRAME->elementcount=elementindex+1;
 #define JSONPARSE_ACTION_ARRAY_END() \
-	finalize_object_array(DEST, JSONBINARY_TYPE_ARRAY, startpos);
-
-
-#define JSONPARSE_ACTION_VALUE_NULL() {\
-	dynbuffer_ensure_delta(DEST, 2); \
-	dynbuffer_append_byte_nocheck(DEST, JSONBINARY_SS_PREFIX); \
-	dynbuffer_append_byte_nocheck(DEST, JSONBINARY_SS_DATA_NULL); \
-	}
-
-#define JSONPARSE_ACTION_VALUE_UNDEFINED() {\
-	dynbuffer_ensure_delta(DEST, 2); \
-	dynbuffer_append_byte_nocheck(DEST, JSONBINARY_SS_PREFIX); \
-	dynbuffer_append_byte_nocheck(DEST, JSONBINARY_SS_DATA_UNDEFINED); \
-	}
-
-#define JSONPARSE_ACTION_VALUE_BOOL(bl) {\
-	dynbuffer_ensure_delta(DEST, 2); \
-	dynbuffer_append_byte_nocheck(DEST, JSONBINARY_SS_PREFIX); \
-	dynbuffer_append_byte_nocheck(DEST, (bl ? JSONBINARY_SS_DATA_TRUE : JSONBINARY_SS_DATA_FALSE)); \
-	}
-
-#define JSONPARSE_ACTION_VALUE_NUMERIC(s, len) {\
-	write_type_length(DEST, JSONBINARY_TYPE_NUMBER, len); \
-	dynbuffer_append(DEST, s, len); \
-	}
-
-#define JSONPARSE_ACTION_VALUE_STRING(s, len) {\
-	write_type_length(DEST, JSONBINARY_TYPE_STRING, len); \
-	dynbuffer_append(DEST, s, len); \
-	}
+	if (parsestate->outer_counts && parsestate->depth==1) { \
+		parsestate->outer_counts->elements=FRAME->elementcount; \
+		parsestate->outer_counts->numbers=parsestate->number_count; \
+		parsestate->outer_counts->integers=parsestate->integer_count; \
+		parsestate->outer_counts->objects=parsestate->object_count; \
+		jsonbinary_finalize_container(DEST, JSONBINARY_TYPE_ARRAY, FRAME->startpos); \
+	} else if (FRAME->elementcount && parsestate->number_count==FRAME->elementcount) \
+		jsonpacked_finalize_array(DEST, FRAME->startpos, FRAME->elementcount, parsestate->integer_count==FRAME->elementcount); \
+	else if (FRAME->elementcount && parsestate->object_count==FRAME->elementcount) \
+		jsontable_finalize_array(DEST, FRAME->startpos, FRAME->elementcount); \
+	else \
+		jsonbinary_finalize_container(DEST, JSONBINARY_TYPE_ARRAY, FRAME->startpos); \
+	parsestate->number_count=FRAME->saved_number_count; \
+	parsestate->integer_count=FRAME->saved_integer_count; \
+	parsestate->object_count=FRAME->saved_object_count;
+
+
+#define JSONPARSE_ACTION_VALUE_NULL() \
+	jsonbinary_write_ss(DEST, JSONBINARY_SS_DATA_NULL);
+
+#define JSONPARSE_ACTION_VALUE_UNDEFINED() \
+	jsonbinary_write_ss(DEST, JSONBINARY_SS_DATA_UNDEFINED);
+
+#define JSONPARSE_ACTION_VALUE_BOOL(bl) \
+	jsonbinary_write_ss(DEST, (bl ? JSONBINARY_SS_DATA_TRUE : JSONBINARY_SS_DATA_FALSE));
+
+#define JSONPARSE_ACTION_VALUE_INTEGER(s, len) \
+	jsonbinary_write_value(DEST, JSONBINARY_TYPE_NUMBER, s, len); \
+	parsestate->number_count++; \
+	parsestate->integer_count++;
+
+#define JSONPARSE_ACTION_VALUE_NUMERIC(s, len) \
+	jsonbinary_write_value(DEST, JSONBINARY_TYPE_NUMBER, s, len); \
+	parsestate->number_count++;
+
+#define JSONPARSE_ACTION_VALUE_STRING(s, len) \
+	jsonbinary_write_value(DEST, JSONBINARY_TYPE_STRING, s, len);
 
 #define JSONPARSE_ACTION_ERROR(msg, got) \
 	snprintf(parsestate->error_message, sizeof(parsestate->error_message), \
 			"Error: %s (got %s)", msg, jsonlex_token_str(got));
 
 
+/* json_transcode_json_to_binary_begin/push/end parse chunked input */
+#define JSONPARSE_PUSH 1
+
 #include "jsonlex.inc.c"
 #include "jsonparse.inc.c"
 
+void json_transcode_json_to_binary_finalize_array(dynbuffer_t *dest, uint32_t startpos, const json_array_counts_t *counts)
+{
+	/* the same choice as JSONPARSE_ACTION_ARRAY_END */
+	if (counts->elements && counts->numbers==counts->elements)
+		jsonpacked_finalize_array(dest, startpos, counts->elements, counts->integers==counts->elements);
+	else if (counts->elements && counts->objects==counts->elements)
+		jsontable_finalize_array(dest, startpos, counts->elements);
+	else
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+}
+
 bool json_transcode_json_to_binary(uint8_t *source, size_t sourcelen, dynbuffer_t *dest)
 {
 	bool result;
@@ -208,6 +129,10 @@ bool json_transcode_json_to_binary(uint8_t *source, size_t sourcelen, dynbuffer_
 	/* init the lexer */
 	jsonlex_init_io(&parseinfo.lexstate, source, sourcelen);
 	parseinfo.dest=dest;
+	parseinfo.outer_counts=0;
+	parseinfo.number_count=0;
+	parseinfo.integer_count=0;
+	parseinfo.object_count=0;
 	parseinfo.error_message[0]=0;
 
 	result=jsonparse(&parseinfo);
@@ -224,3 +149,58 @@ bool json_transcode_json_to_binary(uint8_t *source, size_t sourcelen, dynbuffer_
 	return result;
 }
 
+struct json_to_binary_push {
+	jsonparseinfo_t parseinfo;
+	bool failed;
+};
+
+json_to_binary_push_t *json_transcode_json_to_binary_begin(dynbuffer_t *dest)
+{
+	return json_transcode_json_to_binary_begin_segment(dest, 0);
+}
+
+json_to_binary_push_t *json_transcode_json_to_binary_begin_segment(dynbuffer_t *dest, json_array_counts_t *outer_counts)
+{
+	json_to_binary_push_t *push=(json_to_binary_push_t*)JSON_malloc(sizeof(json_to_binary_push_t));
+
+	jsonparse_push_begin(&push->parseinfo);
+	push->parseinfo.dest=dest;
+	push->parseinfo.outer_counts=outer_counts;
+	push->parseinfo.number_count=0;
+	push->parseinfo.integer_count=0;
+	push->parseinfo.object_count=0;
+	push->parseinfo.error_message[0]=0;
+	push->failed=false;
+
+	return push;
+}
+
+static bool push_chunk(json_to_binary_push_t *push, uint8_t *chunk, size_t len, bool final)
+{
+	dynbuffer_t *dest=push->parseinfo.dest;
+
+	if (push->failed) return false;
+	if (jsonparse_push(&push->parseinfo, chunk, len, final)==JSONPARSE_ERROR) {
+		push->failed=true;
+		dest->pos=0;
+		dynbuffer_append(dest, push->parseinfo.error_message, strlen(push->parseinfo.error_message));
+		dynbuffer_append_byte(dest, 0);
+		return false;
+	}
+	return true;
+}
+
+bool json_transcode_json_to_binary_push(json_to_binary_push_t *push, uint8_t *chunk, size_t len)
+{
+	return push_chunk(push, chunk, len, false);
+}
+
+bool json_transcode_json_to_binary_end(json_to_binary_push_t *push)
+{
+	bool result=push_chunk(push, 0, 0, true);
+
+	jsonparse_push_end(&push->parseinfo);
+	JSON_free(push);
+
+	return result;
+}
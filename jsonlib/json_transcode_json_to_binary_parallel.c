@@ -0,0 +1,287 @@
+/**
+ * json_transcode_json_to_binary_parallel.c
+ * Transcode one big document, an array at the top level, on several
+ * threads.
+ *
+ * The text is cut into ranges of equal size, and each is scanned twice in
+ * parallel with jsonindex.  The first scan counts the unescaped double
+ * quotes of each range; their parity, added up in order, gives whether
+ * each range starts inside a string.  The second scan, knowing that,
+ * finds the depth change over each range and its first comma at each
+ * level above its start; added up, the depths give the first comma
+ * between top level elements in each range.  Those commas cut the array
+ * into segments, each transcoded by a thread as an array of its own
+ * elements, whose contents are then joined under one array header.
+ *
+ * The split is speculative.  If every segment parses as a nonempty array,
+ * the document is that array of all of their elements, wherever the cuts
+ * fell, so the result is the same as json_transcode_json_to_binary's.
+ * Anything else (a parse error, an empty segment from a stray comma, a
+ * single quoted string the scan cannot follow) falls back to the
+ * sequential transcoder, which also writes the usual error message.
+ */
+#include <string.h>
+#include <pthread.h>
+#include "jsonutil.h"
+#include "jsonbinary.h"
+#include "jsonindex.h"
+
+#ifndef JSON_THREADSAFE
+#error "json_transcode_json_to_binary_parallel.c is only built into the standalone library, with JSON_THREADSAFE"
+#endif
+
+/* ranges per thread, so that a thread with dense segments does not hold
+ * up the others, and the smallest range worth a thread */
+#define PARALLEL_RANGES_PER_THREAD 4
+#ifndef PARALLEL_MIN_RANGE
+#define PARALLEL_MIN_RANGE (1024*1024)
+#endif
+
+/* commas are noted at up to this many levels above the start of a range;
+ * a range starting deeper than that is joined to the one before */
+#define PARALLEL_SPLIT_LEVELS 16
+
+typedef struct {
+	const uint8_t *start;
+	const uint8_t *limit;
+	bool escaped;			/* start follows an odd run of backslashes */
+
+	/* first scan */
+	bool parity;			/* odd number of unescaped double quotes */
+
+	/* second scan */
+	bool instring;			/* start is inside a string */
+	bool unknown;			/* single quoted string, depths unknown */
+	int32_t depth_change;
+	const uint8_t *first_comma[PARALLEL_SPLIT_LEVELS];	/* at each level up from start */
+} range_t;
+
+typedef struct {
+	const uint8_t *start;
+	const uint8_t *limit;
+	bool first;				/* starts with the array's own [ */
+	bool last;				/* ends with the array's own ] */
+	dynbuffer_t dest;
+	json_array_counts_t counts;
+	bool ok;
+} segment_t;
+
+typedef struct job job_t;
+
+struct job {
+	pthread_mutex_t lock;
+	size_t next;
+	size_t count;
+	void (*work)(job_t *job, size_t i);
+
+	int max_depth;			/* the caller's, for every worker */
+	range_t *ranges;
+	segment_t *segments;
+};
+
+static size_t claim(job_t *job)
+{
+	size_t i;
+
+	pthread_mutex_lock(&job->lock);
+	i=job->next<job->count ? job->next++ : job->count;
+	pthread_mutex_unlock(&job->lock);
+	return i;
+}
+
+static void *worker(void *arg)
+{
+	job_t *job=(job_t*)arg;
+	size_t i;
+
+	json_max_depth=job->max_depth;
+	while ((i=claim(job))<job->count) job->work(job, i);
+	return NULL;
+}
+
+/**
+ * Run work for 0..count-1 on nthreads threads, the calling one included.
+ * Too few threads starting only makes it slower.
+ */
+static void run_parallel(job_t *job, int nthreads, size_t count, void (*work)(job_t *job, size_t i))
+{
+	pthread_t *threads=(pthread_t*)JSON_malloc(sizeof(pthread_t)*nthreads);
+	int started, i;
+
+	job->next=0;
+	job->count=count;
+	job->work=work;
+	for (started=0; started<nthreads-1; started++) {
+		if (pthread_create(&threads[started], NULL, worker, job)!=0) break;
+	}
+	worker(job);
+	for (i=0; i<started; i++) pthread_join(threads[i], NULL);
+	JSON_free(threads);
+}
+
+static void scan_parity(job_t *job, size_t i)
+{
+	range_t *range=&job->ranges[i];
+	jsonindex_t index;
+
+	jsonindex_init_state(&index, range->start, range->limit-range->start, false, range->escaped);
+	while (jsonindex_next_block(&index));
+	range->parity=index.carry_instring!=0;
+}
+
+static void scan_depth(job_t *job, size_t i)
+{
+	range_t *range=&job->ranges[i];
+	jsonindex_t index;
+	int32_t depth=0;
+	uint64_t bits, bit;
+	int offset;
+
+	jsonindex_init_state(&index, range->start, range->limit-range->start, range->instring, range->escaped);
+	while (jsonindex_next_block(&index)) {
+		if (index.paritylimit<index.sourcelimit) {
+			range->unknown=true;
+			return;
+		}
+
+		bits=index.open | index.close | index.comma;
+		while (bits) {
+			offset=__builtin_ctzll(bits);
+			bit=(uint64_t)1 << offset;
+			if (index.open & bit) {
+				depth++;
+			} else if (index.close & bit) {
+				depth--;
+			} else if (depth<=0 && depth>-PARALLEL_SPLIT_LEVELS && !range->first_comma[-depth]) {
+				range->first_comma[-depth]=index.block+offset;
+			}
+			bits&=bits-1;
+		}
+	}
+	range->depth_change=depth;
+}
+
+static void transcode_segment(job_t *job, size_t i)
+{
+	segment_t *segment=&job->segments[i];
+	json_to_binary_push_t *push;
+	bool ok;
+
+	push=json_transcode_json_to_binary_begin_segment(&segment->dest, &segment->counts);
+	ok=(segment->first || json_transcode_json_to_binary_push(push, (uint8_t*)"[", 1))
+		&& json_transcode_json_to_binary_push(push, (uint8_t*)segment->start, segment->limit-segment->start)
+		&& (segment->last || json_transcode_json_to_binary_push(push, (uint8_t*)"]", 1));
+	ok=json_transcode_json_to_binary_end(push) && ok;
+
+	/* an empty segment is a stray comma (or a wrong cut) */
+	segment->ok=ok && segment->counts.elements>0;
+}
+
+/**
+ * Cut the text into segments at the first top level comma of each range
+ * @return the number of segments, 1 if it cannot be cut
+ */
+static size_t find_segments(job_t *job, uint8_t *source, size_t sourcelen, size_t nranges, int nthreads)
+{
+	range_t *ranges=job->ranges;
+	segment_t *segments=job->segments;
+	const uint8_t *p, *cut;
+	size_t i, nsegments;
+	bool instring=false;
+	int32_t depth=0;
+
+	memset(ranges, 0, sizeof(range_t)*nranges);
+	for (i=0; i<nranges; i++) {
+		ranges[i].start=source+sourcelen/nranges*i;
+		ranges[i].limit=i+1<nranges ? source+sourcelen/nranges*(i+1) : source+sourcelen;
+		for (p=ranges[i].start; p>source && p[-1]=='\\'; p--)
+			ranges[i].escaped=!ranges[i].escaped;
+	}
+
+	run_parallel(job, nthreads, nranges, scan_parity);
+	for (i=0; i<nranges; i++) {
+		ranges[i].instring=instring;
+		instring^=ranges[i].parity;
+	}
+
+	run_parallel(job, nthreads, nranges, scan_depth);
+
+	memset(segments, 0, sizeof(segment_t)*nranges);
+	segments[0].start=source;
+	segments[0].first=true;
+	nsegments=1;
+	for (i=0; i<nranges; i++) {
+		if (ranges[i].unknown) return 1;
+
+		/* a comma at depth 1 is between top level elements */
+		cut=i && depth>=1 && depth<=PARALLEL_SPLIT_LEVELS ? ranges[i].first_comma[depth-1] : NULL;
+		if (cut) {
+			segments[nsegments-1].limit=cut;
+			segments[nsegments].start=cut+1;
+			nsegments++;
+		}
+		depth+=ranges[i].depth_change;
+	}
+	segments[nsegments-1].limit=source+sourcelen;
+	segments[nsegments-1].last=true;
+	return nsegments;
+}
+
+bool json_transcode_json_to_binary_parallel(uint8_t *source, size_t sourcelen, int nthreads, dynbuffer_t *dest)
+{
+	job_t job;
+	json_array_counts_t counts;
+	size_t nranges, nsegments, i;
+	const uint8_t *p;
+	uint8_t type;
+	uint8_t *data;
+	uint32_t length, startpos;
+	bool ok=true;
+
+	nranges=nthreads>1 ? (size_t)nthreads*PARALLEL_RANGES_PER_THREAD : 1;
+	if (nranges>sourcelen/PARALLEL_MIN_RANGE) nranges=sourcelen/PARALLEL_MIN_RANGE;
+
+	for (p=source; p<source+sourcelen && (*p==' ' || *p=='\t' || *p=='\n' || *p=='\r'); p++);
+	if (nranges<2 || p==source+sourcelen || *p!='[')
+		return json_transcode_json_to_binary(source, sourcelen, dest);
+
+	memset(&job, 0, sizeof(job));
+	pthread_mutex_init(&job.lock, NULL);
+	job.max_depth=json_max_depth;
+	job.ranges=(range_t*)JSON_malloc(sizeof(range_t)*nranges);
+	job.segments=(segment_t*)JSON_malloc(sizeof(segment_t)*nranges);
+
+	nsegments=find_segments(&job, source, sourcelen, nranges, nthreads);
+	if (nsegments>1) {
+		run_parallel(&job, nthreads, nsegments, transcode_segment);
+		for (i=0; i<nsegments; i++) ok=ok && job.segments[i].ok;
+	}
+
+	if (nsegments>1 && ok) {
+		/* join the contents of the segments' arrays */
+		memset(&counts, 0, sizeof(counts));
+		startpos=jsonbinary_begin_container(dest);
+		for (i=0; i<nsegments; i++) {
+			segment_t *segment=&job.segments[i];
+
+			jsonbinary_extract_type_length(segment->dest.contents, segment->dest.contents+segment->dest.pos, &type, &data, &length);
+			dynbuffer_append(dest, data, length);
+			dynbuffer_destroy(&segment->dest);
+			counts.elements+=segment->counts.elements;
+			counts.numbers+=segment->counts.numbers;
+			counts.integers+=segment->counts.integers;
+			counts.objects+=segment->counts.objects;
+		}
+		json_transcode_json_to_binary_finalize_array(dest, startpos, &counts);
+	} else {
+		for (i=0; i<nsegments; i++) {
+			dynbuffer_destroy(&job.segments[i].dest);
+		}
+		ok=json_transcode_json_to_binary(source, sourcelen, dest);
+	}
+
+	JSON_free(job.ranges);
+	JSON_free(job.segments);
+	pthread_mutex_destroy(&job.lock);
+	return ok;
+}
@@ -2,6 +2,7 @@
 
 #define JSONPARSE_EXTRA_DECL \
 	bool pretty; \
+	bool ascii_only; \
 	const char *indent; \
 	int level; \
 	dynbuffer_t *dest; \
@@ -25,7 +26,7 @@
 	if (fieldindex) dynbuffer_append_byte(DEST, ','); \
 	if (JSONOUT_PRETTY_PRINT&&parsestate->pretty) jsonout_indent(parsestate->dest, parsestate->level, parsestate->indent); \
 	dynbuffer_append_byte(DEST, '\"'); \
-	dynbuffer_append(DEST, s, len); \
+	json_escape_string(DEST, s, len, parsestate->ascii_only, '"'); \
 	dynbuffer_append(DEST, "\":", 2); \
 	}
 #define JSONPARSE_ACTION_OBJECT_END() {\
@@ -72,7 +73,7 @@
 
 #define JSONPARSE_ACTION_VALUE_STRING(s, len) {\
 	dynbuffer_append_byte(DEST, '\"'); \
-	json_escape_string(DEST, s, len, true, '"'); \
+	json_escape_string(DEST, s, len, parsestate->ascii_only, '"'); \
 	dynbuffer_append_byte(DEST, '\"'); \
 	}
 
@@ -90,6 +91,9 @@ static void jsonout_indent(dynbuffer_t *dest, int level, const char *indent)
 	}
 }
 
+/* json_transcode_json_to_json_begin/push/end parse chunked input */
+#define JSONPARSE_PUSH 1
+
 #include "jsonlex.inc.c"
 #include "jsonparse.inc.c"
 
@@ -103,6 +107,7 @@ bool json_transcode_json_to_json(uint8_t *source, size_t sourcelen, dynbuffer_t
 	parseinfo.dest=dest;
 	parseinfo.error_message[0]=0;
 	parseinfo.pretty=false;
+	parseinfo.ascii_only=json_ascii_output;
 	parseinfo.indent=0;
 	parseinfo.level=0;
 
@@ -120,3 +125,53 @@ bool json_transcode_json_to_json(uint8_t *source, size_t sourcelen, dynbuffer_t
 	return result;
 }
 
+struct json_to_json_push {
+	jsonparseinfo_t parseinfo;
+	bool failed;
+};
+
+json_to_json_push_t *json_transcode_json_to_json_begin(dynbuffer_t *dest)
+{
+	json_to_json_push_t *push=(json_to_json_push_t*)JSON_malloc(sizeof(json_to_json_push_t));
+
+	jsonparse_push_begin(&push->parseinfo);
+	push->parseinfo.dest=dest;
+	push->parseinfo.error_message[0]=0;
+	push->parseinfo.pretty=false;
+	push->parseinfo.ascii_only=json_ascii_output;
+	push->parseinfo.indent=0;
+	push->parseinfo.level=0;
+	push->failed=false;
+
+	return push;
+}
+
+static bool push_chunk(json_to_json_push_t *push, uint8_t *chunk, size_t len, bool final)
+{
+	dynbuffer_t *dest=push->parseinfo.dest;
+
+	if (push->failed) return false;
+	if (jsonparse_push(&push->parseinfo, chunk, len, final)==JSONPARSE_ERROR) {
+		push->failed=true;
+		dest->pos=0;
+		dynbuffer_append(dest, push->parseinfo.error_message, strlen(push->parseinfo.error_message));
+		dynbuffer_append_byte(dest, 0);
+		return false;
+	}
+	return true;
+}
+
+bool json_transcode_json_to_json_push(json_to_json_push_t *push, uint8_t *chunk, size_t len)
+{
+	return push_chunk(push, chunk, len, false);
+}
+
+bool json_transcode_json_to_json_end(json_to_json_push_t *push)
+{
+	bool result=push_chunk(push, 0, 0, true);
+
+	jsonparse_push_end(&push->parseinfo);
+	JSON_free(push);
+
+	return result;
+}
@@ -1,5 +1,7 @@
 #include "jsonutil.h"
 
+/* nothing reads the values, so strings are checked without being copied */
+#define JSONLEX_CHECK_ONLY 1
 #include "jsonlex.inc.c"
 #include "jsonparse.inc.c"
 
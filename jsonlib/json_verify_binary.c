@@ -0,0 +1,255 @@
+#include <string.h>
+#include "jsonutil.h"
+#include "jsonbinary.h"
+#include "jsonpacked.h"
+#include "jsontable.h"
+#include "jsonutf8.h"
+
+/*
+ * Binary from outside (json_recv) is checked before anything reads it.  The
+ * walk is one pass over the bytes, with the open containers on an explicit
+ * stack so that a deeply nested value cannot exhaust the C stack.  Every
+ * value carries its own length, so a container is done when its children
+ * exactly fill it.
+ */
+enum {
+	VERIFY_OBJECT,
+	VERIFY_ARRAY,
+	VERIFY_TABLE
+};
+
+typedef struct {
+	int kind;
+	int depth;				/* nesting depth as json text */
+	uint8_t *cursor;		/* next child */
+	uint8_t *limit;
+
+	/* VERIFY_TABLE: cursor and limit are those of the current column */
+	jsontable_t table;
+	uint8_t *columncursor, *labelcursor;
+	uint32_t col;
+	uint32_t remaining;		/* values still to come in the column */
+} verify_frame_t;
+
+typedef struct {
+	verify_frame_t *stack;
+	int depth;
+	int capacity;
+} verify_state_t;
+
+/**
+ * Labels are modified UTF-8: a zero is written as c0 80, a byte that
+ * otherwise never occurs in UTF-8
+ */
+static bool verify_label(const uint8_t *s, size_t len)
+{
+	const uint8_t *zero;
+	size_t seglen;
+
+	while ((zero=(const uint8_t*)memchr(s, 0xc0, len))) {
+		seglen=zero-s;
+		if (!jsonutf8_valid(s, seglen)) return false;
+		if (seglen+1>=len || zero[1]!=0x80) return false;
+		s+=seglen+2;
+		len-=seglen+2;
+	}
+	return jsonutf8_valid(s, len);
+}
+
+#define IS_DIGIT(c) ((c)>='0' && (c)<='9')
+#define IS_NUMBER_START(c) (IS_DIGIT(c) || (c)=='-' || (c)=='+')
+
+/**
+ * Numbers are kept as the text the lexer read, and the lexer is lenient
+ * about their form (it keeps 1. and -, for example).  Accept what it can
+ * produce: a sign or digit then digits, an optional fraction, and an
+ * optional exponent whose first character is again a sign or digit.
+ */
+static bool verify_number(const uint8_t *s, uint32_t len)
+{
+	const uint8_t *limit=s+len;
+
+	if (s==limit || !IS_NUMBER_START(*s)) return false;
+	for (s++; s<limit && IS_DIGIT(*s); s++);
+
+	if (s<limit && *s=='.') {
+		for (s++; s<limit && IS_DIGIT(*s); s++);
+	}
+
+	if (s<limit && (*s=='E' || *s=='e')) {
+		s++;
+		if (s==limit || !IS_NUMBER_START(*s)) return false;
+		for (s++; s<limit && IS_DIGIT(*s); s++);
+	}
+
+	return s==limit;
+}
+
+static bool verify_packed(const uint8_t *data, uint32_t len)
+{
+	jsonpacked_t packed;
+	const uint8_t *p;
+	uint32_t index;
+
+	if (!jsonpacked_open(data, len, &packed)) return false;
+	if (packed.subtype!=JSONBINARY_EXT_PACKED_DOUBLE) return true;
+
+	/* json has no infinities or NaNs: the exponent must not be all ones */
+	for (index=0, p=packed.data; index<packed.count; index++, p+=8) {
+		if ((p[7]&0x7f)==0x7f && (p[6]&0xf0)==0xf0) return false;
+	}
+	return true;
+}
+
+static verify_frame_t *verify_push(verify_state_t *state, int kind, int depth, uint8_t *data, uint32_t datalen)
+{
+	verify_frame_t *frame;
+
+	if (depth>json_max_depth) return NULL;
+
+	if (state->depth==state->capacity) {
+		if (state->stack) {
+			state->capacity*=2;
+			state->stack=(verify_frame_t*)JSON_realloc(state->stack, sizeof(verify_frame_t)*state->capacity);
+		} else {
+			state->capacity=16;
+			state->stack=(verify_frame_t*)JSON_malloc(sizeof(verify_frame_t)*state->capacity);
+		}
+	}
+
+	frame=&state->stack[state->depth++];
+	frame->kind=kind;
+	frame->depth=depth;
+	frame->cursor=data;
+	frame->limit=data+datalen;
+	return frame;
+}
+
+/**
+ * Move a table frame on to its next column, checking the column header and
+ * counting the values the bitmaps say it holds
+ * @return false on corrupt data
+ */
+static bool verify_next_column(verify_frame_t *frame)
+{
+	jsontable_column_t column;
+	uint32_t bitmapsize=(frame->table.rows+7)/8;
+	uint32_t i;
+	uint8_t bits;
+
+	if (!jsontable_read_column(&frame->table, &frame->columncursor, &frame->labelcursor, &column)) return false;
+	if (!verify_label(column.label, column.labellen)) return false;
+
+	/* rows that have the key and are not null have a value */
+	frame->remaining=0;
+	for (i=0; i<bitmapsize; i++) {
+		bits=column.present[i] & ~column.nulls[i];
+		if (i==bitmapsize-1 && (frame->table.rows&7)) bits&=(1<<(frame->table.rows&7))-1;
+		frame->remaining+=__builtin_popcount(bits);
+	}
+
+	frame->cursor=column.values;
+	frame->limit=column.limit;
+	frame->col++;
+	return true;
+}
+
+/**
+ * Check a value, pushing a frame for its children if it is a container
+ * @return false on corrupt data
+ */
+static bool verify_value(verify_state_t *state, int depth, uint8_t typecode, uint8_t *data, uint32_t datalen)
+{
+	verify_frame_t *frame;
+
+	switch (typecode) {
+	case JSONBINARY_TYPE_OBJECT:
+		return verify_push(state, VERIFY_OBJECT, depth+1, data, datalen)!=NULL;
+	case JSONBINARY_TYPE_ARRAY:
+		return verify_push(state, VERIFY_ARRAY, depth+1, data, datalen)!=NULL;
+	case JSONBINARY_TYPE_STRING:
+		return jsonutf8_valid(data, datalen);
+	case JSONBINARY_TYPE_NUMBER:
+		return verify_number(data, datalen);
+	case JSONBINARY_TYPE_SS:
+		return datalen==1 && data[0]<=JSONBINARY_SS_DATA_UNDEFINED;
+	case JSONBINARY_TYPE_EXTENDED:
+		if (!datalen || data[0]!=JSONBINARY_EXT_TABLE) return verify_packed(data, datalen);
+
+		/* a table is an array of objects */
+		frame=verify_push(state, VERIFY_TABLE, depth+2, data, 0);
+		if (!frame) return false;
+		if (!jsontable_open(data, datalen, &frame->table)) return false;
+
+		/* the bitmap size is computed in 32 bits */
+		if (frame->table.rows>UINT32_MAX-7) return false;
+		frame->columncursor=frame->table.columns;
+		frame->labelcursor=frame->table.labels;
+		frame->col=0;
+		frame->remaining=0;
+		if (frame->table.cols==0) {
+			/* nothing may follow the header */
+			return frame->table.columns==frame->table.limit;
+		}
+		return verify_next_column(frame);
+	default:
+		return false;
+	}
+}
+
+bool json_verify_binary(uint8_t *source, size_t sourcelen)
+{
+	verify_state_t state;
+	verify_frame_t *frame;
+	uint8_t typecode;
+	uint8_t *data, *label;
+	uint32_t datalen;
+	bool result=false;
+
+	memset(&state, 0, sizeof(state));
+
+	if (!jsonbinary_extract_type_length(source, source+sourcelen, &typecode, &data, &datalen)) return false;
+	if (data+datalen!=source+sourcelen) return false;
+	if (!verify_value(&state, 0, typecode, data, datalen)) goto done;
+
+	while (state.depth>0) {
+		frame=&state.stack[state.depth-1];
+
+		if (frame->cursor==frame->limit) {
+			if (frame->kind==VERIFY_TABLE) {
+				/* every value in the column is accounted for, and the
+				 * last column ends the table */
+				if (frame->remaining) goto done;
+				if (frame->col<frame->table.cols) {
+					if (!verify_next_column(frame)) goto done;
+					continue;
+				}
+				if (frame->columncursor!=frame->table.limit) goto done;
+			}
+			state.depth--;
+			continue;
+		}
+
+		if (frame->kind==VERIFY_OBJECT) {
+			label=frame->cursor;
+			frame->cursor=(uint8_t*)memchr(label, 0, frame->limit-label);
+			if (!frame->cursor) goto done;
+			if (!verify_label(label, frame->cursor-label)) goto done;
+			frame->cursor++;
+		} else if (frame->kind==VERIFY_TABLE) {
+			if (!frame->remaining) goto done;
+			frame->remaining--;
+		}
+
+		if (!jsonbinary_extract_type_length(frame->cursor, frame->limit, &typecode, &data, &datalen)) goto done;
+		frame->cursor=data+datalen;
+
+		/* may move the stack */
+		if (!verify_value(&state, frame->depth, typecode, data, datalen)) goto done;
+	}
+	result=true;
+
+done:
+	if (state.stack) JSON_free(state.stack);
+	return result;
+}
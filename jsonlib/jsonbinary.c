@@ -0,0 +1,230 @@
+#include "jsonbinary.h"
+
+void jsonbinary_write_type_length(dynbuffer_t *dest, uint8_t type, uint32_t length)
+{
+	int i;
+	uint32_t lenchunk;
+	uint8_t nextbyte;
+
+	/* reserve 5 bytes so we can do unchecked writes */
+	dynbuffer_ensure_delta(dest, 5);
+
+	/* byte 1: Type spec */
+	lenchunk=(length&0x0f);
+	length>>=4;
+	nextbyte=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk;
+	if (!length) {
+		/* 4 bit length */
+		dynbuffer_append_byte_nocheck(dest, nextbyte);
+		return;
+	} else {
+		dynbuffer_append_byte_nocheck(dest, nextbyte | JSONBINARY_TYPE_LENGTHCONT);
+	}
+
+	/* byte 2-5 */
+	/* the compiler should unroll this loop */
+	for (i=0; i<4; i++) {
+		lenchunk=length & 0x7f;
+		length>>=7;
+		if (!length) {
+			/* 11 bit length */
+			dynbuffer_append_byte_nocheck(dest, lenchunk);
+			return;
+		} else {
+			dynbuffer_append_byte_nocheck(dest, lenchunk | 0x80);
+		}
+	}
+}
+
+uint32_t jsonbinary_begin_container(dynbuffer_t *dest)
+{
+	uint32_t startpos=dest->pos;
+
+	dynbuffer_ensure_delta(dest, JSONBINARY_RESERVE_LENGTH+1);
+	dest->pos+=JSONBINARY_RESERVE_LENGTH+1;
+	return startpos;
+}
+
+void jsonbinary_finalize_container(dynbuffer_t *dest, uint8_t type, uint32_t startpos)
+{
+	uint32_t actlen=dest->pos - startpos - JSONBINARY_RESERVE_LENGTH - 1;
+	uint32_t lenchunk;
+	uint32_t lenshift;
+	uint8_t lenbytes[4];
+	uint32_t lenindex;
+
+	/* ensure we have max needed room to grow */
+	dynbuffer_ensure_delta(dest, 5);
+
+	/* fast path for empty object/array */
+	if (!actlen) {
+		dest->pos=startpos;
+		dynbuffer_append_byte_nocheck(dest, (type<<JSONBINARY_TYPE_SHIFT));
+		return;
+	}
+
+	/* write the type code+4bit length */
+	lenchunk=actlen&0x0f;
+	lenshift=actlen>>4;
+
+	if (!lenshift) {
+		dest->contents[startpos]=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk;
+		if (JSONBINARY_RESERVE_LENGTH>0) {
+			/* move left by JSONBINARY_RESERVE_LENGTH */
+			memmove(dest->contents+startpos+1, dest->contents+startpos+1+JSONBINARY_RESERVE_LENGTH, actlen);
+			dest->pos-=JSONBINARY_RESERVE_LENGTH;
+		}
+		return;
+	} else {
+		/* more than the typespec byte - write typespec with continue bit set */
+		dest->contents[startpos]=(type<<JSONBINARY_TYPE_SHIFT) | lenchunk | JSONBINARY_TYPE_LENGTHCONT;
+	}
+
+	/* write bytes 2-5 */
+	for (lenindex=0; lenindex<4; lenindex++) {
+		lenchunk=lenshift&0x7f;
+		lenshift>>=7;
+
+		if (!lenshift) {
+			/* end of length */
+			lenbytes[lenindex]=lenchunk;
+			lenindex++;
+			break;
+		} else {
+			/* continues */
+			lenbytes[lenindex]=lenchunk | 0x80;
+		}
+	}
+
+	/* now determine how much to move the buffer */
+	if (lenindex==JSONBINARY_RESERVE_LENGTH) {
+		/* reserved byte count was correct guess */
+		/* add the lenbytes and return - all pointers are correct */
+		memcpy(dest->contents+startpos+1, lenbytes, JSONBINARY_RESERVE_LENGTH);
+		return;
+	} else {
+		/* move the object contents forward or back */
+		memmove(dest->contents+startpos+1+lenindex, dest->contents+startpos+1+JSONBINARY_RESERVE_LENGTH, actlen);
+
+		/* adjust pos */
+		if (lenindex>JSONBINARY_RESERVE_LENGTH) dest->pos+=(lenindex-JSONBINARY_RESERVE_LENGTH);
+		else dest->pos-=(JSONBINARY_RESERVE_LENGTH-lenindex);
+
+		/* add the lenbytes */
+		memcpy(dest->contents+startpos+1, lenbytes, lenindex);
+		return;
+	}
+}
+
+void jsonbinary_write_label(dynbuffer_t *dest, const uint8_t *s, size_t len)
+{
+	size_t index;
+	uint8_t c;
+
+	/* reserve len*2 bytes - the neurotic case of all nulls */
+	dynbuffer_ensure_delta(dest, len*2+1);
+
+	for (index=0; index<len; index++) {
+		c=s[index];
+		if (c) dynbuffer_append_byte_nocheck(dest, c);
+		else {
+			dynbuffer_append_byte_nocheck(dest, 0xc0);
+			dynbuffer_append_byte_nocheck(dest, 0x80);
+		}
+	}
+	dynbuffer_append_byte_nocheck(dest, 0);
+}
+
+void jsonbinary_write_ss(dynbuffer_t *dest, uint8_t ssdata)
+{
+	dynbuffer_ensure_delta(dest, 2);
+	dynbuffer_append_byte_nocheck(dest, JSONBINARY_SS_PREFIX);
+	dynbuffer_append_byte_nocheck(dest, ssdata);
+}
+
+void jsonbinary_write_value(dynbuffer_t *dest, uint8_t type, const uint8_t *s, size_t len)
+{
+	jsonbinary_write_type_length(dest, type, len);
+	dynbuffer_append(dest, s, len);
+}
+
+void jsonbinary_write_varint(dynbuffer_t *dest, uint32_t value)
+{
+	dynbuffer_ensure_delta(dest, 5);
+	while (value>=0x80) {
+		dynbuffer_append_byte_nocheck(dest, (value&0x7f) | 0x80);
+		value>>=7;
+	}
+	dynbuffer_append_byte_nocheck(dest, value);
+}
+
+bool jsonbinary_read_varint(uint8_t **source, uint8_t *sourcelimit, uint32_t *outvalue)
+{
+	uint8_t *p=*source;
+	uint32_t value=0;
+	int shift;
+
+	for (shift=0; shift<35; shift+=7) {
+		if (p>=sourcelimit) return false;
+		value|=(uint32_t)(*p&0x7f)<<shift;
+		if (!(*(p++)&0x80)) {
+			*source=p;
+			*outvalue=value;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool jsonbinary_extract_type_length(uint8_t *source, uint8_t *sourcelimit, uint8_t *outtypecode, uint8_t **outdata, uint32_t *outlength)
+{
+	uint8_t typespec;
+	uint32_t lencont;
+	uint32_t length;
+
+	/* decode type byte */
+	if (source>=sourcelimit) return false;
+	typespec=*source;
+	source++;
+	*outtypecode=(typespec>>JSONBINARY_TYPE_SHIFT);
+	length=typespec & 0x0f;
+
+	/* length byte 1 */
+	if (typespec&JSONBINARY_TYPE_LENGTHCONT) {
+		if (source>=sourcelimit) return false;
+		lencont=*(source++);
+		length|=(lencont&0x7f)<<4;
+
+		/* length byte 2 */
+		if (lencont&0x80) {
+			if (source>=sourcelimit) return false;
+			lencont=*(source++);
+			length|=(lencont&0x7f)<<11;
+
+			/* length byte 3 */
+			if (lencont&0x80) {
+				if (source>=sourcelimit) return false;
+				lencont=*(source++);
+				length|=(lencont&0x7f)<<18;
+
+				/* length byte 4 */
+				if (lencont&0x80) {
+					if (source>=sourcelimit) return false;
+					lencont=*(source++);
+					length|=(lencont&0x7f)<<25;
+
+					/* make sure high bit not set on last byte */
+					if (lencont&0x80) return false;
+				}
+			}
+		}
+	}
+
+	/* validate length */
+	if (length>(uint32_t)(sourcelimit-source)) return false;
+
+	*outdata=source;
+	*outlength=length;
+
+	return true;
+}
@@ -0,0 +1,75 @@
+/**
+ * jsonbinary.h
+ * Primitives for reading and writing the json binary representation.  The
+ * transcoders and the database functions that build values directly
+ * (row_to_json, json_build_object) share these.
+ */
+#ifndef __JSONBINARY_H__
+#define __JSONBINARY_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "dynbuffer.h"
+#include "jsonbinaryconst.h"
+
+/**
+ * Number of bytes of length to reserve for objects and arrays while their
+ * contents are being written.  jsonbinary_finalize_container moves the
+ * contents if the final length needs more or less than this.
+ */
+#define JSONBINARY_RESERVE_LENGTH 1
+
+/**
+ * Write type and length bytes
+ */
+void jsonbinary_write_type_length(dynbuffer_t *dest, uint8_t type, uint32_t length);
+
+/**
+ * Reserve room for the type and length bytes of an object or array whose
+ * contents will be written next.
+ * @return startpos to pass to jsonbinary_finalize_container
+ */
+uint32_t jsonbinary_begin_container(dynbuffer_t *dest);
+
+/**
+ * Finalizes an object or array given the startpos returned by
+ * jsonbinary_begin_container.  Goes back and writes the type+length bytes,
+ * moving the contents as necessary.
+ */
+void jsonbinary_finalize_container(dynbuffer_t *dest, uint8_t type, uint32_t startpos);
+
+/**
+ * Append an object label to dest as zero terminated modified utf8
+ */
+void jsonbinary_write_label(dynbuffer_t *dest, const uint8_t *s, size_t len);
+
+/**
+ * Append a simple scalar (JSONBINARY_SS_DATA_*)
+ */
+void jsonbinary_write_ss(dynbuffer_t *dest, uint8_t ssdata);
+
+/**
+ * Append a string or number value (type+length followed by the bytes)
+ */
+void jsonbinary_write_value(dynbuffer_t *dest, uint8_t type, const uint8_t *s, size_t len);
+
+/**
+ * Append an unsigned integer as a little endian base 128 varint (7 bits
+ * per byte, high bit set on all but the last byte), as used for counts
+ * within extended values.
+ */
+void jsonbinary_write_varint(dynbuffer_t *dest, uint32_t value);
+
+/**
+ * Decode a varint at *source, advancing it.
+ * @return false if truncated or longer than 5 bytes
+ */
+bool jsonbinary_read_varint(uint8_t **source, uint8_t *sourcelimit, uint32_t *outvalue);
+
+/**
+ * Decode the type and length at source.  On success, outdata points to the
+ * value data and outlength is its length.
+ * @return false if the type/length is truncated or overruns sourcelimit
+ */
+bool jsonbinary_extract_type_length(uint8_t *source, uint8_t *sourcelimit, uint8_t *outtypecode, uint8_t **outdata, uint32_t *outlength);
+
+#endif
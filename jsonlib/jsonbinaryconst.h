@@ -12,9 +12,16 @@
 #define JSONBINARY_TYPE_SS (0x04)
 #define JSONBINARY_TYPE_TSTRING (0x05)
 #define JSONBINARY_TYPE_SBINARY (0x06)
-#define JSONBINARY_TYPE_RESERVED (0x07)
+#define JSONBINARY_TYPE_EXTENDED (0x07)
 #define JSONBINARY_TYPE_SHIFT 5
 
+/**
+ * The json type's binary send/recv format is this version byte followed
+ * by the binary value.  It changes with any incompatible change to the
+ * encoding.
+ */
+#define JSONBINARY_WIRE_VERSION (0x01)
+
 /**
  * Length continuation bit for the type byte
  */
@@ -30,4 +37,33 @@
 #define JSONBINARY_SS_DATA_NULL (0x02)
 #define JSONBINARY_SS_DATA_UNDEFINED (0x03)
 
+/**
+ * The first data byte of a JSONBINARY_TYPE_EXTENDED value is one of the
+ * JSONBINARY_EXT_* subtypes, which determines how the remaining bytes
+ * are interpreted.
+ *
+ * Packed arrays are arrays whose elements are all numbers, stored as a
+ * contiguous little endian vector of the given element width following
+ * the subtype byte.  The element count is implied by the length.
+ */
+#define JSONBINARY_EXT_PACKED_INT8 (0x01)
+#define JSONBINARY_EXT_PACKED_INT16 (0x02)
+#define JSONBINARY_EXT_PACKED_INT32 (0x03)
+#define JSONBINARY_EXT_PACKED_INT64 (0x04)
+#define JSONBINARY_EXT_PACKED_DOUBLE (0x05)
+
+/**
+ * A table is an array of objects sharing one list of keys, stored column
+ * by column:
+ *   subtype, varint row count, varint column count,
+ *   column count zero terminated labels,
+ *   for each column:
+ *     varint length of the rest of the column,
+ *     present bitmap (one bit per row, set if the row has the key),
+ *     null bitmap (one bit per row, set if the value is null),
+ *     the values of the rows that are present and not null, in row order.
+ * Bitmaps are (rows+7)/8 bytes with row 0 in the low bit of the first byte.
+ */
+#define JSONBINARY_EXT_TABLE (0x06)
+
 #endif
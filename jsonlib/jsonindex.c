@@ -0,0 +1,223 @@
+#include <string.h>
+#include "jsonindex.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* raw classification of one block, before string state is applied */
+typedef struct {
+	uint64_t quote;
+	uint64_t squote;
+	uint64_t backslash;
+	uint64_t open;
+	uint64_t close;
+	uint64_t comma;
+} block_class_t;
+
+#if defined(__AVX2__)
+static void classify(const uint8_t *p, block_class_t *c)
+{
+	int half;
+	uint64_t bits[6]={0};
+
+	for (half=0; half<2; half++) {
+		__m256i x=_mm256_loadu_si256((const __m256i*)(p+half*32));
+		__m256i lower=_mm256_or_si256(x, _mm256_set1_epi8(0x20));
+		int shift=half*32;
+
+		bits[0]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'))) << shift;
+		bits[1]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\''))) << shift;
+		bits[2]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'))) << shift;
+		/* [ and { differ only by 0x20, as do ] and } */
+		bits[3]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{'))) << shift;
+		bits[4]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))) << shift;
+		bits[5]|=(uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(','))) << shift;
+	}
+
+	c->quote=bits[0];
+	c->squote=bits[1];
+	c->backslash=bits[2];
+	c->open=bits[3];
+	c->close=bits[4];
+	c->comma=bits[5];
+}
+#elif defined(__SSE2__)
+static void classify(const uint8_t *p, block_class_t *c)
+{
+	int quarter;
+	uint64_t bits[6]={0};
+
+	for (quarter=0; quarter<4; quarter++) {
+		__m128i x=_mm_loadu_si128((const __m128i*)(p+quarter*16));
+		__m128i lower=_mm_or_si128(x, _mm_set1_epi8(0x20));
+		int shift=quarter*16;
+
+		bits[0]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('"'))) << shift;
+		bits[1]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\''))) << shift;
+		bits[2]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\\'))) << shift;
+		/* [ and { differ only by 0x20, as do ] and } */
+		bits[3]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lower, _mm_set1_epi8('{'))) << shift;
+		bits[4]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(lower, _mm_set1_epi8('}'))) << shift;
+		bits[5]|=(uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(','))) << shift;
+	}
+
+	c->quote=bits[0];
+	c->squote=bits[1];
+	c->backslash=bits[2];
+	c->open=bits[3];
+	c->close=bits[4];
+	c->comma=bits[5];
+}
+#else
+#define CLASS_QUOTE 0x01
+#define CLASS_SQUOTE 0x02
+#define CLASS_BACKSLASH 0x04
+#define CLASS_OPEN 0x08
+#define CLASS_CLOSE 0x10
+#define CLASS_COMMA 0x20
+
+static const uint8_t class_table[256]={
+	['"']=CLASS_QUOTE,
+	['\'']=CLASS_SQUOTE,
+	['\\']=CLASS_BACKSLASH,
+	['{']=CLASS_OPEN, ['[']=CLASS_OPEN,
+	['}']=CLASS_CLOSE, [']']=CLASS_CLOSE,
+	[',']=CLASS_COMMA
+};
+
+static void classify(const uint8_t *p, block_class_t *c)
+{
+	int i;
+	uint8_t cls;
+	uint64_t bit;
+
+	memset(c, 0, sizeof(block_class_t));
+	for (i=0; i<JSONINDEX_BLOCK_SIZE; i++) {
+		cls=class_table[p[i]];
+		if (!cls) continue;
+		bit=(uint64_t)1 << i;
+		if (cls&CLASS_QUOTE) c->quote|=bit;
+		if (cls&CLASS_SQUOTE) c->squote|=bit;
+		if (cls&CLASS_BACKSLASH) c->backslash|=bit;
+		if (cls&CLASS_OPEN) c->open|=bit;
+		if (cls&CLASS_CLOSE) c->close|=bit;
+		if (cls&CLASS_COMMA) c->comma|=bit;
+	}
+}
+#endif
+
+/**
+ * Bits of the characters escaped by a backslash.  A character is escaped
+ * if it follows an odd length run of backslashes, found by adding the
+ * run starts on odd bits to the runs and checking where the carries end.
+ */
+static uint64_t find_escaped(uint64_t backslash, uint64_t *carry_escaped)
+{
+	const uint64_t even_bits=0x5555555555555555ULL;
+	uint64_t follows_escape, odd_starts, sum, invert;
+
+	backslash&=~*carry_escaped;
+	follows_escape=(backslash << 1) | *carry_escaped;
+	odd_starts=backslash & ~even_bits & ~follows_escape;
+	sum=odd_starts + backslash;
+	*carry_escaped=sum<odd_starts;
+	invert=sum << 1;
+	return (even_bits ^ invert) & follows_escape;
+}
+
+/* each bit becomes the xor of itself and all lower bits */
+static uint64_t prefix_xor(uint64_t bits)
+{
+	bits^=bits << 1;
+	bits^=bits << 2;
+	bits^=bits << 4;
+	bits^=bits << 8;
+	bits^=bits << 16;
+	bits^=bits << 32;
+	return bits;
+}
+
+void jsonindex_init(jsonindex_t *index, const uint8_t *source, size_t len)
+{
+	memset(index, 0, sizeof(jsonindex_t));
+	index->source=source;
+	index->sourcelimit=source+len;
+	index->paritylimit=index->sourcelimit;
+}
+
+void jsonindex_init_state(jsonindex_t *index, const uint8_t *source, size_t len, bool instring, bool escaped)
+{
+	jsonindex_init(index, source, len);
+	index->carry_instring=instring ? ~(uint64_t)0 : 0;
+	index->carry_escaped=escaped;
+}
+
+bool jsonindex_next_block(jsonindex_t *index)
+{
+	const uint8_t *p=index->block ? index->block+JSONINDEX_BLOCK_SIZE : index->source;
+	uint8_t padded[JSONINDEX_BLOCK_SIZE];
+	block_class_t c;
+	uint64_t escaped, quote, instring, squote;
+
+	if (p>=index->sourcelimit) return false;
+
+	if (index->sourcelimit-p < JSONINDEX_BLOCK_SIZE) {
+		/* pad the last block with whitespace */
+		memset(padded, ' ', sizeof(padded));
+		memcpy(padded, p, index->sourcelimit-p);
+		classify(padded, &c);
+	} else {
+		classify(p, &c);
+	}
+
+	escaped=find_escaped(c.backslash, &index->carry_escaped);
+	quote=c.quote & ~escaped;
+	instring=prefix_xor(quote) ^ index->carry_instring;
+	index->carry_instring=(uint64_t)((int64_t)instring >> 63);
+
+	/* a single quote outside a double quoted string starts a string the
+	 * quote parity does not see */
+	squote=c.squote & ~instring;
+	if (squote && index->paritylimit==index->sourcelimit) index->paritylimit=p+__builtin_ctzll(squote);
+
+	index->block=p;
+	index->open=c.open & ~instring;
+	index->close=c.close & ~instring;
+	index->comma=c.comma & ~instring;
+	return true;
+}
+
+const uint8_t *jsonindex_container_end(jsonindex_t *index, const uint8_t *pos)
+{
+	uint32_t depth=1;
+	uint64_t bits, limitmask, bit;
+	int offset;
+
+	for (;;) {
+		if (pos>=index->paritylimit || !jsonindex_seek(index, pos)) return NULL;
+
+		bits=(index->open | index->close) & (~(uint64_t)0 << (pos-index->block));
+		limitmask=~(uint64_t)0;
+		if (index->paritylimit < index->block+JSONINDEX_BLOCK_SIZE) {
+			limitmask=((uint64_t)1 << (index->paritylimit-index->block)) - 1;
+			bits&=limitmask;
+		}
+
+		while (bits) {
+			offset=__builtin_ctzll(bits);
+			bit=(uint64_t)1 << offset;
+			if (index->close & bit) {
+				if (!--depth) return index->block+offset+1;
+			} else {
+				depth++;
+			}
+			bits&=bits-1;
+		}
+
+		if (limitmask!=~(uint64_t)0) return NULL;
+		pos=index->block+JSONINDEX_BLOCK_SIZE;
+	}
+}
@@ -0,0 +1,78 @@
+/**
+ * jsonindex.h
+ * Structural index over json text, computed lazily 64 bytes at a time.
+ *
+ * Each block is classified with AVX2 or SSE2 when the compiler targets
+ * them (a table driven loop otherwise) into bitmaps, one bit per byte:
+ * double quotes, backslashes, brackets and commas.  Escaped quotes are
+ * removed by finding odd length backslash runs, and a prefix xor of the
+ * remaining quotes gives the bytes inside strings, carried from block to
+ * block, so that brackets inside strings are not counted.
+ *
+ * jsonlex_skip_value uses the index to skip whole containers.  Queries
+ * return NULL when the index cannot answer (a position behind the current
+ * block, or string state after a single quoted string, which the index
+ * does not track), and the caller falls back to reading a character at a
+ * time.  The parallel encoder walks the bitmaps directly to find the
+ * commas between the elements of a top level array.
+ */
+#ifndef __JSONINDEX_H__
+#define __JSONINDEX_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define JSONINDEX_BLOCK_SIZE 64
+
+typedef struct {
+	const uint8_t *source;
+	const uint8_t *sourcelimit;
+	const uint8_t *block;		/* start of the current block, NULL before the first */
+	const uint8_t *paritylimit;	/* string state is unknown from here on */
+
+	/* bitmaps of the current block */
+	uint64_t open;			/* { and [ outside strings */
+	uint64_t close;			/* } and ] outside strings */
+	uint64_t comma;			/* commas outside strings */
+
+	/* carried into the next block */
+	uint64_t carry_instring;	/* all ones if the block ended inside a string */
+	uint64_t carry_escaped;		/* 1 if the block ended with an unpaired backslash */
+} jsonindex_t;
+
+void jsonindex_init(jsonindex_t *index, const uint8_t *source, size_t len);
+
+/**
+ * Index source starting in the middle of a document: instring if source
+ * starts inside a double quoted string, escaped if its first character is
+ * escaped by a backslash before it
+ */
+void jsonindex_init_state(jsonindex_t *index, const uint8_t *source, size_t len, bool instring, bool escaped);
+
+/**
+ * Index the block after the current one
+ * @return false at the end of the source
+ */
+bool jsonindex_next_block(jsonindex_t *index);
+
+/**
+ * Make the current block the one containing pos
+ * @return false if pos is behind the current block or past the end
+ */
+static inline bool jsonindex_seek(jsonindex_t *index, const uint8_t *pos)
+{
+	if (index->block && pos<index->block) return false;
+	while (!index->block || pos>=index->block+JSONINDEX_BLOCK_SIZE) {
+		if (!jsonindex_next_block(index)) return false;
+	}
+	return true;
+}
+
+/**
+ * For a container whose contents start at pos (just after the opening
+ * bracket), find the end.
+ * @return the position after the matching bracket, or NULL if unknown
+ */
+const uint8_t *jsonindex_container_end(jsonindex_t *index, const uint8_t *pos);
+
+#endif
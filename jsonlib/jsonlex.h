@@ -13,27 +13,58 @@
 #ifndef __JSONLEX_H__
 #define __JSONLEX_H__
 
+/**
+ * JSONLEX_CHECK_ONLY
+ * Define as 1 for a lexer that only checks the input, for parsers that
+ * do not look at the values.  Nothing is copied into the buffer: the text
+ * of a string token is the source between its quotes with any escapes
+ * still in it, and numbers are not normalized.  Requires the standard IO.
+ *
+ * Defaults to 0
+ */
+#ifndef JSONLEX_CHECK_ONLY
+#define JSONLEX_CHECK_ONLY 0
+#endif
+
 /**
  * JSONLEX_STATICBUFFER_SIZE
  * If defined, then a static initial lex buffer will be
  * defined.  If the capacity exceeds this static buffer
  * then dynamic allocation will be done.
  *
- * Defaults to 256
+ * Defaults to 256, or 0 with JSONLEX_CHECK_ONLY, which never buffers
  */
 #ifndef JSONLEX_STATICBUFFER_SIZE
+#if JSONLEX_CHECK_ONLY
+#define JSONLEX_STATICBUFFER_SIZE 0
+#else
 #define JSONLEX_STATICBUFFER_SIZE 256
 #endif
+#endif
 
 /**
  * JSONLEX_TRACK_POSITION
  * Define as 0 or 1 to indicate whether input position should be tracked.
- * If 1, then start_line, start_col, end_line, end_col will be maintained
+ * If 1, then token_start is set to where each token starts, from which
+ * the line and column can be counted.  Parsers that only need positions to
+ * report errors are better off without it and parsing again with it on
+ * failure (see json_diagnose_json).  Requires the standard IO.
  *
- * Default to 1
+ * Default to 0
  */
 #ifndef JSONLEX_TRACK_POSITION
-#define JSONLEX_TRACK_POSITION 1
+#define JSONLEX_TRACK_POSITION 0
+#endif
+
+/**
+ * JSONLEX_SKIP
+ * Define as 1 to include jsonlex_skip_value, which passes over a value
+ * without buffering any of it.
+ *
+ * Defaults to 0
+ */
+#ifndef JSONLEX_SKIP
+#define JSONLEX_SKIP 0
 #endif
 
 /**
@@ -64,8 +95,54 @@
 #ifndef JSONLEX_UNGETC
 #define JSONLEX_UNGETC(c) (lexstate->source-=1)
 #endif
+#elif JSONLEX_CHECK_ONLY
+#error JSONLEX_CHECK_ONLY requires the standard IO
+#elif JSONLEX_TRACK_POSITION
+#error JSONLEX_TRACK_POSITION requires the standard IO
 #endif
 
+/**
+ * JSONLEX_INDEX
+ * Define as 0 or 1 to indicate whether the standard IO should build a
+ * structural index of the source (see jsonindex.h), with which
+ * jsonlex_skip_value passes over whole containers in bulk.  Tokens are
+ * still read a byte at a time: jumping over whitespace with the index was
+ * slower on all but deeply indented text.  Sources under a kilobyte are not
+ * indexed.  Not available with JSONLEX_DISABLE_IO.
+ *
+ * Defaults to 1 with the standard IO
+ */
+#ifndef JSONLEX_INDEX
+#ifdef JSONLEX_DISABLE_IO
+#define JSONLEX_INDEX 0
+#else
+#define JSONLEX_INDEX 1
+#endif
+#endif
+
+#if JSONLEX_INDEX
+#include "jsonindex.h"
+#endif
+
+/**
+ * JSONLEX_VALIDATE_UTF8
+ * Define as 0 or 1 to indicate whether strings must be valid UTF-8 (see
+ * jsonutf8.h).  Strings that are not are returned as jsonlex_invalid_utf8.
+ * Only strings with bytes above 0x7f are checked, so ASCII costs nothing
+ * extra.
+ *
+ * Defaults to 1
+ */
+#ifndef JSONLEX_VALIDATE_UTF8
+#define JSONLEX_VALIDATE_UTF8 1
+#endif
+
+#if JSONLEX_VALIDATE_UTF8
+#include "jsonutf8.h"
+#endif
+
+#include "jsonmalloc.h"
+
 
 /**
  * JSON_DECLP
@@ -112,12 +189,19 @@ typedef enum {
 	jsonlex_string=0x13,
 
 	/* pseudo tokens */
+	jsonlex_invalid_utf8=0xfc,
 	jsonlex_illegal_string=0xfd,
 	jsonlex_unknown=0xfe,
 	jsonlex_eof=0xff
 } jsonlex_token_t;
 
 typedef struct {
+	/* text of the last string, identifier or number token.  points into the
+	 * source with the standard IO unless it had to be unescaped or
+	 * normalized, in which case it points at the buffer */
+	uint8_t *token;
+	size_t   token_len;
+
 	/* holds token extra data.  initially null */
 	uint8_t *buffer;
 	size_t   buffer_capacity;
@@ -128,10 +212,7 @@ typedef struct {
 
 	/* position */
 	#if JSONLEX_TRACK_POSITION
-	int start_line;
-	int start_col;
-	int end_line;
-	int end_col;
+	uint8_t *token_start;	/* of the last token, or eof */
 	#endif
 
 	/* additional user-defined declarations */
@@ -141,6 +222,11 @@ typedef struct {
 	#ifdef JSONLEX_IO_DECL
 	JSONLEX_IO_DECL
 	#endif
+
+	#if JSONLEX_INDEX
+	bool indexed;			/* false for sources too short to be worth indexing */
+	jsonindex_t index;
+	#endif
 } jsonlex_state_t, *jsonlex_state_arg;
 
 /**
@@ -193,6 +279,9 @@ JSON_FDECLP void jsonlex_init(jsonlex_state_arg lexstate);
 	JSON_FDECLP void jsonlex_init_io(jsonlex_state_arg lexstate, uint8_t *source, size_t len);
 #endif
 JSON_FDECLP void jsonlex_destroy(jsonlex_state_arg lexstate);
+#if JSONLEX_SKIP
+	JSON_FDECLP bool jsonlex_skip_value(jsonlex_state_arg lexstate);
+#endif
 
 
 #endif
@@ -53,35 +53,91 @@ JSON_FDECLP const char* jsonlex_token_str(jsonlex_token_t t)
 	case jsonlex_string:  return "STRING";
 	case jsonlex_eof:     return "<EOF>";
 	case jsonlex_illegal_string: return "<BAD ESCAPE SEQUENCE IN STRING>";
+	case jsonlex_invalid_utf8: return "<INVALID UTF-8 IN STRING>";
 	default:
 		return "<UNKNOWN>";
 	}
 }
 
-JSON_FDECLP void jsonlex_realloc_buffer(jsonlex_state_arg lexstate)
+JSON_FDECLP void jsonlex_realloc_buffer(jsonlex_state_arg lexstate, size_t needed)
 {
 	size_t newcapacity=lexstate->buffer_capacity*2;
 	if (!newcapacity) newcapacity=256;
+	while (newcapacity<needed) newcapacity*=2;
 
+	/* through the jsonmalloc.h hooks, so that in the backend the buffer
+	 * lives in the current memory context */
 	#if JSONLEX_STATICBUFFER_SIZE > 0
 		if (lexstate->buffer==lexstate->buffer_static) {
-			/* just alloc a new one */
-			lexstate->buffer=malloc(newcapacity);
+			/* move out of the static buffer */
+			lexstate->buffer=(uint8_t*)JSON_malloc(newcapacity);
+			memcpy(lexstate->buffer, lexstate->buffer_static, lexstate->buffer_pos);
 		} else {
-			lexstate->buffer=realloc(lexstate->buffer, newcapacity);
+			lexstate->buffer=(uint8_t*)JSON_realloc(lexstate->buffer, newcapacity);
 		}
 	#else
-		lexstate->buffer=realloc(lexstate->buffer, newcapacity);
+		if (lexstate->buffer) {
+			lexstate->buffer=(uint8_t*)JSON_realloc(lexstate->buffer, newcapacity);
+		} else {
+			lexstate->buffer=(uint8_t*)JSON_malloc(newcapacity);
+		}
 	#endif
+	lexstate->buffer_capacity=newcapacity;
 }
 
 #define JSONLEX_BUFFER_BYTE(c) \
 		if (lexstate->buffer_pos==lexstate->buffer_capacity) \
-			jsonlex_realloc_buffer(lexstate); \
+			jsonlex_realloc_buffer(lexstate, lexstate->buffer_pos+1); \
 		lexstate->buffer[lexstate->buffer_pos++]=c;
 
+#define JSONLEX_BUFFER_BYTES(s, len) \
+		if (lexstate->buffer_pos+(len)>lexstate->buffer_capacity) \
+			jsonlex_realloc_buffer(lexstate, lexstate->buffer_pos+(len)); \
+		memcpy(lexstate->buffer+lexstate->buffer_pos, s, len); \
+		lexstate->buffer_pos+=(len);
+
 #define JSONLEX_BUFFER_CLEAR() lexstate->buffer_pos=0;
 
+/* identifiers and numbers are spans of the source with the standard IO,
+ * and are buffered a byte at a time otherwise */
+#ifndef JSONLEX_DISABLE_IO
+#define JSONLEX_TOKEN_START() tokenstart=lexstate->source-1;
+#define JSONLEX_TOKEN_BYTE(c)
+#define JSONLEX_TOKEN_END() \
+		lexstate->token=tokenstart; \
+		lexstate->token_len=lexstate->source-tokenstart;
+/* a dangling exponent char is consumed but not part of the number */
+#define JSONLEX_TOKEN_END_BEFORE_EXPONENT() \
+		lexstate->token=tokenstart; \
+		lexstate->token_len=exponent-tokenstart;
+#else
+#define JSONLEX_TOKEN_START()
+#define JSONLEX_TOKEN_BYTE(c) JSONLEX_BUFFER_BYTE(c)
+#define JSONLEX_TOKEN_END() \
+		lexstate->token=lexstate->buffer; \
+		lexstate->token_len=lexstate->buffer_pos;
+#define JSONLEX_TOKEN_END_BEFORE_EXPONENT() JSONLEX_TOKEN_END()
+#endif
+
+/* string contents are only unescaped into the buffer if they are wanted */
+#if JSONLEX_CHECK_ONLY
+#define JSONLEX_STRING_BYTE(c)
+#else
+#define JSONLEX_STRING_BYTE(c) JSONLEX_BUFFER_BYTE(c)
+#endif
+
+#if JSONLEX_INDEX
+/* sources shorter than this are cheaper to read a byte at a time */
+#define JSONLEX_INDEX_MINSIZE 1024
+#endif
+
+/* strings are searched a word at a time on little endian machines */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+#define JSONLEX_SWAR 1
+#else
+#define JSONLEX_SWAR 0
+#endif
+
 JSON_FDECLP void jsonlex_init(jsonlex_state_arg lexstate)
 {
 	#if JSONLEX_STATICBUFFER_SIZE > 0
@@ -93,13 +149,6 @@ JSON_FDECLP void jsonlex_init(jsonlex_state_arg lexstate)
 	#endif
 
 	lexstate->buffer_pos=0;
-
-	#if JSONLEX_TRACK_POSITION
-		lexstate->start_line=1;
-		lexstate->start_col=0;
-		lexstate->end_line=1;
-		lexstate->end_col=0;
-	#endif
 }
 
 #ifndef JSONLEX_DISABLE_IO
@@ -108,6 +157,13 @@ JSON_FDECLP void jsonlex_init_io(jsonlex_state_arg lexstate, uint8_t *source, si
 	jsonlex_init(lexstate);
 	lexstate->source=source;
 	lexstate->sourcelimit=source+len;
+	#if JSONLEX_TRACK_POSITION
+		lexstate->token_start=source;
+	#endif
+	#if JSONLEX_INDEX
+		lexstate->indexed=len>=JSONLEX_INDEX_MINSIZE;
+		if (lexstate->indexed) jsonindex_init(&lexstate->index, source, len);
+	#endif
 }
 #endif
 
@@ -115,57 +171,81 @@ JSON_FDECLP void jsonlex_destroy(jsonlex_state_arg lexstate)
 {
 	#if JSONLEX_STATICBUFFER_SIZE > 0
 		if (lexstate->buffer!=lexstate->buffer_static)
-			free(lexstate->buffer);
+			JSON_free(lexstate->buffer);
 	#else
 		if (lexstate->buffer)
-			free(lexstate->buffer);
+			JSON_free(lexstate->buffer);
 	#endif
 }
 
-JSON_FDECLP bool jsonlex_unicode_escape(jsonlex_state_arg lexstate)
+/**
+ * Decode the four hex digits of a unicode escape
+ * @return the UTF-16 code unit, or -1 if a digit is not hex
+ */
+JSON_FDECLP int32_t jsonlex_unicode_unit(jsonlex_state_arg lexstate)
 {
 	int i;
 	uint32_t nibble;
-	uint32_t codepoint=0;
+	int32_t unit=0;
 	int digit;
 
-	/* decode digits into codepoint */
 	for (i=0; i<4; i++) {
 		digit=JSONLEX_GETC();
 		if (digit>='0' && digit<='9') {
 			nibble=digit - '0';
 		} else if (digit>='a' && digit <= 'f') {
-			nibble=digit - 'a';
+			nibble=digit - 'a' + 10;
 		} else if (digit>='A' && digit <= 'F') {
-			nibble=digit - 'A';
+			nibble=digit - 'A' + 10;
 		} else {
-			return false;
+			return -1;
 		}
 
-		codepoint = (codepoint << 4) | nibble;
+		unit = (unit << 4) | nibble;
+	}
+	return unit;
+}
+
+JSON_FDECLP bool jsonlex_unicode_escape(jsonlex_state_arg lexstate)
+{
+	int32_t unit;
+	uint32_t codepoint;
+
+	unit=jsonlex_unicode_unit(lexstate);
+	if (unit<0) return false;
+	codepoint=unit;
+
+	/* code points above U+FFFF are escaped as a surrogate pair.  a lone
+	 * surrogate has no UTF-8 form and is rejected */
+	if (codepoint>=0xdc00 && codepoint<=0xdfff) return false;
+	if (codepoint>=0xd800 && codepoint<=0xdbff) {
+		if (JSONLEX_GETC()!='\\' || JSONLEX_GETC()!='u') return false;
+		unit=jsonlex_unicode_unit(lexstate);
+		if (unit<0xdc00 || unit>0xdfff) return false;
+		codepoint=0x10000 + ((codepoint-0xd800)<<10) + (unit-0xdc00);
 	}
 
 	/* output codepoint as utf-8 */
 	if (codepoint>=0 && codepoint<=0x7f) {
-		JSONLEX_BUFFER_BYTE(codepoint);
+		JSONLEX_STRING_BYTE(codepoint);
 	} else if (codepoint<=0x7ff) {
-		JSONLEX_BUFFER_BYTE(0xc0 | ((codepoint>>6)&0x1f));
-		JSONLEX_BUFFER_BYTE(0x80 | (codepoint&0x3f));
+		JSONLEX_STRING_BYTE(0xc0 | ((codepoint>>6)&0x1f));
+		JSONLEX_STRING_BYTE(0x80 | (codepoint&0x3f));
 	} else if (codepoint<=0xffff) {
-		JSONLEX_BUFFER_BYTE(0xe0 | ((codepoint>>12)&0xff));
-		JSONLEX_BUFFER_BYTE(0x80 | ((codepoint>>6)&0x3f));
-		JSONLEX_BUFFER_BYTE(0x80 | ((codepoint&0x3f)));
+		JSONLEX_STRING_BYTE(0xe0 | ((codepoint>>12)&0xff));
+		JSONLEX_STRING_BYTE(0x80 | ((codepoint>>6)&0x3f));
+		JSONLEX_STRING_BYTE(0x80 | ((codepoint&0x3f)));
 	} else if (codepoint<=0x10ffff) {
-		JSONLEX_BUFFER_BYTE(0xf0 | ((codepoint>>18)&0x7));
-		JSONLEX_BUFFER_BYTE(0x80 | ((codepoint>>12)&0x3f));
-		JSONLEX_BUFFER_BYTE(0x80 | ((codepoint>>6)&0x3f));
-		JSONLEX_BUFFER_BYTE(0x80 | ((codepoint&0x3f)));
+		JSONLEX_STRING_BYTE(0xf0 | ((codepoint>>18)&0x7));
+		JSONLEX_STRING_BYTE(0x80 | ((codepoint>>12)&0x3f));
+		JSONLEX_STRING_BYTE(0x80 | ((codepoint>>6)&0x3f));
+		JSONLEX_STRING_BYTE(0x80 | ((codepoint&0x3f)));
 	} else {
 		/* Unicode replacement char uFFFD as UTF-8 */
 		/*
-		JSONLEX_BUFFER_BYTE(0xef);
-		JSONLEX_BUFFER_BYTE(0xbf);
-		JSONLEX_BUFFER_BYTE(0xbd);
+		JSONLEX_STRING_BYTE(0xef);
+		JSONLEX_STRING_BYTE(0xbf);
+		JSONLEX_STRING_BYTE(0xbd);
 		*/
 		return false;
 	}
@@ -174,14 +254,70 @@ JSON_FDECLP bool jsonlex_unicode_escape(jsonlex_state_arg lexstate)
 	return true;
 }
 
+#ifndef JSONLEX_DISABLE_IO
+/**
+ * Find the end of the plain characters of a string starting at the current
+ * position: the first quotechar, backslash or control character, or
+ * sourcelimit.  Searches a word at a time, which outpaces the index here
+ * as it needs no per block setup.  Sets *nonascii if the run has bytes
+ * above 0x7f, which need to be checked for valid UTF-8.
+ */
+JSON_FDECLP uint8_t *jsonlex_string_run(jsonlex_state_arg lexstate, int quotechar, bool *nonascii)
+{
+	uint8_t *p=lexstate->source;
+	uint8_t *limit=lexstate->sourcelimit;
+	uint64_t high=0;
+	#if JSONLEX_SWAR
+	const uint64_t ones=0x0101010101010101ULL;
+	const uint64_t quotes=ones*(uint8_t)quotechar;
+	const uint64_t backslashes=ones*'\\';
+	uint64_t word, special;
+	#endif
+
+	#if JSONLEX_SWAR
+	while (limit-p>=8) {
+		/* the lowest high bit set marks the first byte that is zero after
+		 * the xor, or below 0x20 */
+		memcpy(&word, p, 8);
+		special=(((word^quotes)-ones) & ~(word^quotes))
+			| (((word^backslashes)-ones) & ~(word^backslashes))
+			| ((word-ones*0x20) & ~word);
+		special&=ones*0x80;
+		if (special) {
+			/* only the bytes before the first special one */
+			high|=word & ((special & -special)-1);
+			if (high & ones*0x80) *nonascii=true;
+			return p+(__builtin_ctzll(special)>>3);
+		}
+		high|=word;
+		p+=8;
+	}
+	#endif
+
+	while (p<limit && *p!=quotechar && *p!='\\' && *p>=0x20) high|=*p++;
+	if (high & 0x8080808080808080ULL) *nonascii=true;
+	return p;
+}
+#endif
+
 JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 {
 	int charin;
 	int quotechar;
+	bool nonascii;
 	jsonlex_charclass_t cc;
+	#ifndef JSONLEX_DISABLE_IO
+	uint8_t *tokenstart;
+	uint8_t *exponent;
+	uint8_t *run;
+	#endif
 
 	JSONLEX_BUFFER_CLEAR();
+
 	for (;;) {
+		#if JSONLEX_TRACK_POSITION
+		lexstate->token_start=lexstate->source;
+		#endif
 		charin=JSONLEX_GETC();
 		if (charin<0) return jsonlex_eof;
 		cc=JSONLEX_CC_TABLE[charin];
@@ -197,8 +333,9 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 		case JSONLEX_CC_IDCHAR:
 			/* introduce identifier */
 			/* identifier continues until first non IDCHAR or DIGIT */
+			JSONLEX_TOKEN_START();
 			for (;;) {
-				JSONLEX_BUFFER_BYTE(charin);
+				JSONLEX_TOKEN_BYTE(charin);
 				charin=JSONLEX_GETC();
 				if (charin<0) break;	/* eof - identifier is still valid token */
 				cc=JSONLEX_CC_TABLE[charin];
@@ -209,14 +346,20 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 				}
 			}
 
+			JSONLEX_TOKEN_END();
 			return jsonlex_identifier;
 		case JSONLEX_CC_NUMERIC:
 			/* introduce numeric value */
 			/* loop is optimized for recognizing integers */
+			JSONLEX_TOKEN_START();
 			for (;;) {
-				JSONLEX_BUFFER_BYTE(charin);
+				JSONLEX_TOKEN_BYTE(charin);
 				charin=JSONLEX_GETC();
-				if (charin<0) return jsonlex_integer;	/* eof while in int parse state */
+				if (charin<0) {
+					/* eof while in int parse state */
+					JSONLEX_TOKEN_END();
+					return jsonlex_integer;
+				}
 				cc=JSONLEX_CC_TABLE[charin];
 				if (!(cc&JSONLEX_CC_ATTR_DIGIT)) break; /* non-integer digit */
 			}
@@ -225,19 +368,21 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 			if (!(cc&JSONLEX_CC_ATTR_INT_SEP)) {
 				/* Not an "integer separator" indicating parse as numeric */
 				JSONLEX_UNGETC(charin);
+				JSONLEX_TOKEN_END();
 				return jsonlex_integer;
 			}
 
 			/* if charin is a decimal point, accumulate the fractional bits */
 			if (charin=='.') {
 				for (;;) {
-					JSONLEX_BUFFER_BYTE(charin);
+					JSONLEX_TOKEN_BYTE(charin);
 					charin=JSONLEX_GETC();
 					if (charin<0) {
 						/* this lets a numeric with a trailing decimal point
 						 * through, but let higher level logic deal with that
 						 * if needed
 						 */
+						JSONLEX_TOKEN_END();
 						return jsonlex_numeric;
 					}
 					cc=JSONLEX_CC_TABLE[charin];
@@ -249,13 +394,18 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 			if (charin!='e' && charin!='E') {
 				/* no exponent - just numeric */
 				JSONLEX_UNGETC(charin);
+				JSONLEX_TOKEN_END();
 				return jsonlex_numeric;
 			}
 
 			/* final loop - collect exponent */
+			#ifndef JSONLEX_DISABLE_IO
+			exponent=lexstate->source-1;
+			#endif
 			charin=JSONLEX_GETC();
 			if (charin<0) {
 				/* technically lets an unadorned E through */
+				JSONLEX_TOKEN_END_BEFORE_EXPONENT();
 				return jsonlex_numeric;
 			}
 
@@ -264,36 +414,101 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 			if ((cc & JSONLEX_CC_CLASSMASK)!=JSONLEX_CC_NUMERIC) {
 				/* non-numeric following exponent - end of number */
 				JSONLEX_UNGETC(charin);
+				JSONLEX_TOKEN_END_BEFORE_EXPONENT();
 				return jsonlex_numeric;
 			}
-			JSONLEX_BUFFER_BYTE('E');
+			JSONLEX_TOKEN_BYTE('E');
 			for (;;) {
-				JSONLEX_BUFFER_BYTE(charin);
+				JSONLEX_TOKEN_BYTE(charin);
 				charin=JSONLEX_GETC();
 				if (charin<0) {
 					/* eof as numeric */
-					return jsonlex_numeric;
+					break;
 				}
 				cc=JSONLEX_CC_TABLE[charin];
 				if (!(cc&JSONLEX_CC_ATTR_DIGIT)) {
 					/* char is not part of numeric */
 					JSONLEX_UNGETC(charin);
-					return jsonlex_numeric;
+					break;
 				}
 			}
 
-			break;
+			JSONLEX_TOKEN_END();
+			#if !defined(JSONLEX_DISABLE_IO) && !JSONLEX_CHECK_ONLY
+			if (*exponent=='e') {
+				/* the span can not be normalized in place */
+				JSONLEX_BUFFER_BYTES(lexstate->token, lexstate->token_len);
+				lexstate->buffer[exponent-lexstate->token]='E';
+				lexstate->token=lexstate->buffer;
+			}
+			#endif
+			return jsonlex_numeric;
 		case JSONLEX_CC_QUOTE:
 			/* introduce string value */
 			quotechar=charin;
+			nonascii=false;
+
+			#ifndef JSONLEX_DISABLE_IO
+			/* a string without escapes is returned as a span of the source */
+			tokenstart=lexstate->source;
+			run=jsonlex_string_run(lexstate, quotechar, &nonascii);
+			if (run<lexstate->sourcelimit && *run==quotechar) {
+				lexstate->token=lexstate->source;
+				lexstate->token_len=run-lexstate->source;
+				lexstate->source=run+1;
+				#if JSONLEX_VALIDATE_UTF8
+				if (nonascii && !jsonutf8_valid(lexstate->token, lexstate->token_len))
+					return jsonlex_invalid_utf8;
+				#endif
+				return jsonlex_string;
+			}
+			#endif
+
 			for (;;) {
+				#ifndef JSONLEX_DISABLE_IO
+				/* copy up to the next quote, escape or control character in one
+				 * go.  the run was found before the loop or after the last escape */
+				#if JSONLEX_CHECK_ONLY
+				/* nothing is copied to check at the end, so each run is
+				 * checked by itself.  a sequence can not span an escape */
+				#if JSONLEX_VALIDATE_UTF8
+				if (nonascii && run<lexstate->sourcelimit) {
+					if (!jsonutf8_valid(lexstate->source, run-lexstate->source))
+						return jsonlex_invalid_utf8;
+					nonascii=false;
+				}
+				#endif
+				lexstate->source=run;
+				#else
+				if (run!=lexstate->source) {
+					JSONLEX_BUFFER_BYTES(lexstate->source, run-lexstate->source);
+					lexstate->source=run;
+				}
+				#endif
+				#endif
+
 				charin=JSONLEX_GETC();
 
 				/* detect control char or eof in one go */
 				if (charin<32) return jsonlex_illegal_string;
 
 				/* string termination */
-				if (charin==quotechar) return jsonlex_string;
+				if (charin==quotechar) {
+					#if JSONLEX_CHECK_ONLY
+					lexstate->token=tokenstart;
+					lexstate->token_len=lexstate->source-1-tokenstart;
+					#else
+					lexstate->token=lexstate->buffer;
+					lexstate->token_len=lexstate->buffer_pos;
+					#endif
+					#if JSONLEX_VALIDATE_UTF8 && !JSONLEX_CHECK_ONLY
+					/* escapes always decode to valid UTF-8, so the copied
+					 * characters can be checked together with them */
+					if (nonascii && !jsonutf8_valid(lexstate->token, lexstate->token_len))
+						return jsonlex_invalid_utf8;
+					#endif
+					return jsonlex_string;
+				}
 
 				/* escape */
 				if (charin=='\\') {
@@ -320,13 +535,17 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 						default:
 							return jsonlex_illegal_string;
 						}
-						JSONLEX_BUFFER_BYTE(charin);
+						JSONLEX_STRING_BYTE(charin);
 					}
+					#ifndef JSONLEX_DISABLE_IO
+					run=jsonlex_string_run(lexstate, quotechar, &nonascii);
+					#endif
 					continue;
 				}
 
 				/* default case - copy char */
-				JSONLEX_BUFFER_BYTE(charin);
+				if (charin>=0x80) nonascii=true;
+				JSONLEX_STRING_BYTE(charin);
 			}
 			break;
 
@@ -335,3 +554,93 @@ JSON_FDECLP jsonlex_token_t jsonlex_next_token(jsonlex_state_arg lexstate)
 		}
 	}
 }
+
+#if JSONLEX_SKIP
+/**
+ * Pass over the next value without buffering it.  Strings are jumped over
+ * honoring escapes and containers by counting brackets, so the contents
+ * are only checked for balanced brackets and terminated strings.
+ * @return false on eof or unbalanced input
+ */
+JSON_FDECLP bool jsonlex_skip_value(jsonlex_state_arg lexstate)
+{
+	int charin;
+	int quotechar;
+	int depth=0;
+	#ifndef JSONLEX_DISABLE_IO
+	bool nonascii;
+	#endif
+	jsonlex_charclass_t cc;
+	#if JSONLEX_INDEX
+	const uint8_t *indexpos;
+	#endif
+
+	for (;;) {
+		charin=JSONLEX_GETC();
+		if (charin<0) return false;
+		cc=JSONLEX_CC_TABLE[charin];
+
+		switch (cc&JSONLEX_CC_CLASSMASK) {
+		case JSONLEX_CC_WHITE:
+			continue;
+		case JSONLEX_CC_QUOTE:
+			quotechar=charin;
+			for (;;) {
+				#ifndef JSONLEX_DISABLE_IO
+				lexstate->source=jsonlex_string_run(lexstate, quotechar, &nonascii);
+				#endif
+				charin=JSONLEX_GETC();
+				if (charin<32) return false;
+				if (charin==quotechar) break;
+				if (charin=='\\' && JSONLEX_GETC()<0) return false;
+			}
+			break;
+		case JSONLEX_CC_TERMCHAR:
+			switch (charin) {
+			case '{':
+			case '[':
+				#if JSONLEX_INDEX
+				/* skip the outermost container by its brackets */
+				if (!depth && lexstate->indexed) {
+					indexpos=jsonindex_container_end(&lexstate->index, lexstate->source);
+					if (indexpos) {
+						lexstate->source=(uint8_t*)indexpos;
+						return true;
+					}
+				}
+				#endif
+				depth++;
+				break;
+			case '}':
+			case ']':
+				if (--depth<0) return false;
+				break;
+			case ',':
+			case ':':
+				if (!depth) return false;
+				break;
+			default:
+				return false;
+			}
+			break;
+		case JSONLEX_CC_IDCHAR:
+		case JSONLEX_CC_NUMERIC:
+			/* identifier or number - runs until a character neither can contain */
+			for (;;) {
+				charin=JSONLEX_GETC();
+				if (charin<0) break;
+				cc=JSONLEX_CC_TABLE[charin];
+				if (!(cc&(JSONLEX_CC_ATTR_IDCHAR_CONT|JSONLEX_CC_ATTR_INT_SEP)) && (cc&JSONLEX_CC_CLASSMASK)!=JSONLEX_CC_NUMERIC) {
+					JSONLEX_UNGETC(charin);
+					break;
+				}
+			}
+			break;
+		default:
+			return false;
+		}
+
+		if (!depth) return true;
+	}
+}
+#endif
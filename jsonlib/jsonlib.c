@@ -0,0 +1,170 @@
+#include <string.h>
+#include <stdlib.h>
+#include "jsonlib.h"
+#include "jsonutil.h"
+#include "jsonbinary.h"
+
+#ifndef JSON_USE_HOOKS
+#error "jsonlib.c is only built into the standalone library, with JSON_USE_HOOKS"
+#endif
+
+void *(*json_malloc_hook)(size_t size)=malloc;
+void *(*json_realloc_hook)(void *ptr, size_t size)=realloc;
+void (*json_free_hook)(void *ptr)=free;
+
+static const jsonlib_options_t default_options=JSONLIB_OPTIONS_DEFAULT;
+
+void jsonlib_set_allocator(void *(*malloc_fn)(size_t size), void *(*realloc_fn)(void *ptr, size_t size), void (*free_fn)(void *ptr))
+{
+	json_malloc_hook=malloc_fn;
+	json_realloc_hook=realloc_fn;
+	json_free_hook=free_fn;
+}
+
+void jsonlib_buffer_free(jsonlib_buffer_t *buffer)
+{
+	if (buffer->data) JSON_free(buffer->data);
+	buffer->data=0;
+	buffer->len=0;
+}
+
+/**
+ * Set this thread's settings for a call.  Every entry point sets them, so
+ * nothing is left over from the last call.
+ */
+static const jsonlib_options_t *apply_options(const jsonlib_options_t *options)
+{
+	if (!options) options=&default_options;
+	json_max_depth=options->max_depth>0 ? options->max_depth : JSON_DEFAULT_MAX_DEPTH;
+	if (json_max_depth>JSON_MAX_DEPTH_LIMIT) json_max_depth=JSON_MAX_DEPTH_LIMIT;
+	json_ascii_output=options->ascii_output;
+	return options;
+}
+
+/**
+ * Step over the version byte of wire binary
+ */
+static jsonlib_status_t open_binary(const jsonlib_options_t *options, const uint8_t **binary, size_t *len)
+{
+	if (!options->wire) return JSONLIB_OK;
+	if (*len<1) return JSONLIB_CORRUPT;
+	if (**binary!=JSONBINARY_WIRE_VERSION) return JSONLIB_VERSION;
+	(*binary)++;
+	(*len)--;
+	return JSONLIB_OK;
+}
+
+static void start_binary(const jsonlib_options_t *options, dynbuffer_t *dest)
+{
+	if (options->wire) dynbuffer_append_byte(dest, JSONBINARY_WIRE_VERSION);
+}
+
+static jsonlib_status_t finish(jsonlib_status_t status, dynbuffer_t *dest, jsonlib_buffer_t *out)
+{
+	out->data=dest->contents;
+	out->len=dest->pos;
+	return status;
+}
+
+static jsonlib_status_t encode(const uint8_t *text, size_t len, int nthreads, const jsonlib_options_t *options, jsonlib_buffer_t *out)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	dynbuffer_t diagnosis=dynbuffer_init();
+	bool ok;
+
+	options=apply_options(options);
+	start_binary(options, &dest);
+	if (nthreads>1)
+		ok=json_transcode_json_to_binary_parallel((uint8_t*)text, len, nthreads, &dest);
+	else
+		ok=json_transcode_json_to_binary((uint8_t*)text, len, &dest);
+	if (ok) return finish(JSONLIB_OK, &dest, out);
+
+	/* the parser's own message has no position */
+	if (json_diagnose_json((uint8_t*)text, len, &diagnosis)) {
+		dynbuffer_destroy(&dest);
+		dest=diagnosis;
+	} else {
+		dynbuffer_destroy(&diagnosis);
+	}
+	dest.pos=strlen((char*)dest.contents);
+	return finish(JSONLIB_INVALID, &dest, out);
+}
+
+jsonlib_status_t jsonlib_encode(const uint8_t *text, size_t len, const jsonlib_options_t *options, jsonlib_buffer_t *out)
+{
+	return encode(text, len, 1, options, out);
+}
+
+jsonlib_status_t jsonlib_encode_parallel(const uint8_t *text, size_t len, int nthreads, const jsonlib_options_t *options, jsonlib_buffer_t *out)
+{
+	return encode(text, len, nthreads, options, out);
+}
+
+jsonlib_status_t jsonlib_decode(const uint8_t *binary, size_t len, const jsonlib_options_t *options, jsonlib_buffer_t *out)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	jsonlib_status_t status;
+
+	out->data=0;
+	out->len=0;
+	options=apply_options(options);
+	status=open_binary(options, &binary, &len);
+	if (status!=JSONLIB_OK) return status;
+	if (!json_verify_binary((uint8_t*)binary, len)) return JSONLIB_CORRUPT;
+
+	if (!json_transcode_binary_to_json((uint8_t*)binary, len, &dest)) {
+		dynbuffer_destroy(&dest);
+		return JSONLIB_CORRUPT;
+	}
+	dynbuffer_append_byte(&dest, 0);
+	dest.pos--;
+	return finish(JSONLIB_OK, &dest, out);
+}
+
+jsonlib_status_t jsonlib_validate(const uint8_t *text, size_t len, const jsonlib_options_t *options)
+{
+	apply_options(options);
+	return json_validate_json((uint8_t*)text, len) ? JSONLIB_OK : JSONLIB_INVALID;
+}
+
+jsonlib_status_t jsonlib_verify(const uint8_t *binary, size_t len, const jsonlib_options_t *options)
+{
+	jsonlib_status_t status;
+
+	options=apply_options(options);
+	status=open_binary(options, &binary, &len);
+	if (status!=JSONLIB_OK) return status;
+	return json_verify_binary((uint8_t*)binary, len) ? JSONLIB_OK : JSONLIB_CORRUPT;
+}
+
+jsonlib_status_t jsonlib_get(const uint8_t *binary, size_t len, const char *path, const jsonlib_options_t *options, jsonlib_buffer_t *out)
+{
+	dynbuffer_t dest=dynbuffer_init();
+	jsonlib_status_t status;
+	bool found;
+
+	out->data=0;
+	out->len=0;
+	options=apply_options(options);
+	status=open_binary(options, &binary, &len);
+	if (status!=JSONLIB_OK) return status;
+
+	start_binary(options, &dest);
+	switch (json_path_get((uint8_t*)binary, len, (const uint8_t*)path, strlen(path), &dest, &found)) {
+	case JSON_PATH_OK:
+		status=found ? JSONLIB_OK : JSONLIB_NOT_FOUND;
+		break;
+	case JSON_PATH_SYNTAX:
+		status=JSONLIB_PATH_SYNTAX;
+		break;
+	default:
+		status=JSONLIB_CORRUPT;
+	}
+
+	if (status!=JSONLIB_OK) {
+		dynbuffer_destroy(&dest);
+		return status;
+	}
+	return finish(JSONLIB_OK, &dest, out);
+}
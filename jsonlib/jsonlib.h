@@ -0,0 +1,133 @@
+/**
+ * jsonlib.h
+ * Stable C API of the standalone json library (libjsonlib, built by
+ * jsonlib/Makefile), for applications that encode documents to the binary
+ * representation themselves, e.g. to send them to the json type's binary
+ * recv function so the server does not lex any text, and decode what its
+ * send function returns.
+ *
+ * Every function may be called from any number of threads at once.  The
+ * settings of a call are passed in a jsonlib_options_t and apply to that
+ * call only.  Results are returned in a jsonlib_buffer_t allocated through
+ * the library's allocator, which the caller frees with jsonlib_buffer_free
+ * whatever the status.
+ */
+#ifndef __JSONLIB_H__
+#define __JSONLIB_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bumped on any incompatible change to this header
+ */
+#define JSONLIB_API_VERSION 1
+
+/* the shared library is built with -fvisibility=hidden, so that only these
+ * functions are exported */
+#if defined(__GNUC__) && __GNUC__>=4
+#define JSONLIB_EXPORT __attribute__((visibility("default")))
+#else
+#define JSONLIB_EXPORT
+#endif
+
+typedef struct {
+	/* text or binary nested deeper than this is rejected, 0 for the
+	 * default of 1000.  Values above 4000 are taken as 4000: decoding and
+	 * path lookups recurse on each level, and 4000 levels take about a
+	 * megabyte of stack */
+	int max_depth;
+
+	/* decode escapes every character outside printable ascii as \uXXXX;
+	 * otherwise UTF-8 is written as it is */
+	bool ascii_output;
+
+	/* binary values (encode output, decode/verify/get input and get output)
+	 * start with the version byte of the json type's binary send/recv
+	 * format */
+	bool wire;
+} jsonlib_options_t;
+
+/**
+ * The options used when NULL is passed
+ */
+#define JSONLIB_OPTIONS_DEFAULT { 0, true, false }
+
+typedef enum {
+	JSONLIB_OK=0,
+	JSONLIB_INVALID,		/* text that does not parse */
+	JSONLIB_CORRUPT,		/* binary that fails verification */
+	JSONLIB_VERSION,		/* wire binary of an unknown version */
+	JSONLIB_PATH_SYNTAX,
+	JSONLIB_NOT_FOUND
+} jsonlib_status_t;
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+} jsonlib_buffer_t;
+
+/**
+ * Allocate everything through these instead of malloc, realloc and free.
+ * Must be called before any other function, while only one thread uses the
+ * library.  The library does not check for allocation failure, so the
+ * functions must not return NULL (they can abort or longjmp instead).
+ */
+JSONLIB_EXPORT void jsonlib_set_allocator(void *(*malloc_fn)(size_t size), void *(*realloc_fn)(void *ptr, size_t size), void (*free_fn)(void *ptr));
+
+/**
+ * Free the contents of a buffer returned by the functions below and empty
+ * it
+ */
+JSONLIB_EXPORT void jsonlib_buffer_free(jsonlib_buffer_t *buffer);
+
+/**
+ * Encode json text to binary.  On JSONLIB_INVALID, out holds a zero
+ * terminated message giving the line and column where parsing failed.
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_encode(const uint8_t *text, size_t len, const jsonlib_options_t *options, jsonlib_buffer_t *out);
+
+/**
+ * Encode as jsonlib_encode, on up to nthreads threads when the text is one
+ * big array: it is cut into ranges of at least a megabyte, up to four per
+ * thread, and split at the first comma between top level elements in
+ * each range, so text under 2MB is encoded on the calling thread and all
+ * nthreads are kept busy from about nthreads megabytes.  The binary is the
+ * same as jsonlib_encode's.
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_encode_parallel(const uint8_t *text, size_t len, int nthreads, const jsonlib_options_t *options, jsonlib_buffer_t *out);
+
+/**
+ * Decode binary to json text, followed by a zero terminator that len does
+ * not count.  The binary is verified first, as by jsonlib_verify.
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_decode(const uint8_t *binary, size_t len, const jsonlib_options_t *options, jsonlib_buffer_t *out);
+
+/**
+ * Check that text parses, without encoding it
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_validate(const uint8_t *text, size_t len, const jsonlib_options_t *options);
+
+/**
+ * Check binary from an untrusted source in one pass, as json recv does
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_verify(const uint8_t *binary, size_t len, const jsonlib_options_t *options);
+
+/**
+ * Look up a path (a zero terminated string such as items[0].price, as for
+ * the json_get function) in binary, and return the binary of the value
+ * found.  A path with [*] returns an array of every match.  The binary is
+ * trusted: reads stay in bounds, but pass anything from outside through
+ * jsonlib_verify first.
+ */
+JSONLIB_EXPORT jsonlib_status_t jsonlib_get(const uint8_t *binary, size_t len, const char *path, const jsonlib_options_t *options, jsonlib_buffer_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
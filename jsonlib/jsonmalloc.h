@@ -14,6 +14,25 @@
 #ifndef JSON_realloc
 #define JSON_realloc repalloc
 #endif
+#elif defined(JSON_USE_HOOKS)
+#include <stddef.h>
+
+/** The standalone library allocates through jsonlib_set_allocator's hooks **/
+extern void *(*json_malloc_hook)(size_t size);
+extern void *(*json_realloc_hook)(void *ptr, size_t size);
+extern void (*json_free_hook)(void *ptr);
+
+#ifndef JSON_malloc
+#define JSON_malloc json_malloc_hook
+#endif
+
+#ifndef JSON_free
+#define JSON_free json_free_hook
+#endif
+
+#ifndef JSON_realloc
+#define JSON_realloc json_realloc_hook
+#endif
 #else
 #include <stdlib.h>
 
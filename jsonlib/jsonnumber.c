@@ -0,0 +1,606 @@
+#include <string.h>
+#include <float.h>
+#include "jsonnumber.h"
+
+#define DOUBLE_MANTISSA_BITS 52
+#define DOUBLE_MANTISSA_MASK (((uint64_t)1 << DOUBLE_MANTISSA_BITS) - 1)
+#define DOUBLE_EXPONENT_BIAS 1023
+#define DOUBLE_EXPONENT_INF 0x7ff
+
+/* digits that always fit in a uint64_t */
+#define PARSE_MAX_DIGITS 19
+
+/* low 64 bits of a*b, with the high 64 bits in *hi */
+static inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t *hi)
+{
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 r=(unsigned __int128)a * b;
+	*hi=(uint64_t)(r >> 64);
+	return (uint64_t)r;
+#else
+	uint64_t alo=(uint32_t)a, ahi=a >> 32, blo=(uint32_t)b, bhi=b >> 32;
+	uint64_t lolo=alo*blo, hilo=ahi*blo, lohi=alo*bhi, hihi=ahi*bhi;
+	uint64_t cross=(lolo >> 32) + (uint32_t)hilo + lohi;
+
+	*hi=(hilo >> 32) + (cross >> 32) + hihi;
+	return (cross << 32) | (uint32_t)lolo;
+#endif
+}
+
+/* floor(e * log2(10)), valid well beyond the double range */
+#define FLOOR_LOG2_POW10(e) (((e) * 1741647) >> 19)
+
+/*** Exact decimal arithmetic, for the cases Eisel-Lemire cannot decide ***/
+
+#define DECIMAL_DIGITS 800
+/* bits that can be shifted at once without overflowing a uint64_t */
+#define DECIMAL_MAX_SHIFT 60
+
+typedef struct {
+	uint8_t d[DECIMAL_DIGITS];	/* digit values, most significant first */
+	int nd;						/* number of digits */
+	int dp;						/* the value is 0.d * 10^dp */
+	bool trunc;					/* nonzero digits past DECIMAL_DIGITS were dropped */
+} decimal_t;
+
+static void decimal_trim(decimal_t *a)
+{
+	while (a->nd>0 && a->d[a->nd-1]==0) a->nd--;
+	if (!a->nd) a->dp=0;
+}
+
+static void decimal_left_shift(decimal_t *a, unsigned k)
+{
+	int r, w, delta=0;
+	uint64_t n=0, quo, rem;
+
+	/* the digits the shift adds are those of the carry out of the top */
+	for (r=a->nd-1; r>=0; r--) n=(n + ((uint64_t)a->d[r] << k)) / 10;
+	for (; n>0; n/=10) delta++;
+
+	w=a->nd + delta;
+	for (r=a->nd-1; r>=0; r--) {
+		n+=(uint64_t)a->d[r] << k;
+		quo=n/10;
+		rem=n - 10*quo;
+		w--;
+		if (w<DECIMAL_DIGITS) a->d[w]=(uint8_t)rem;
+		else if (rem) a->trunc=true;
+		n=quo;
+	}
+	while (n>0) {
+		quo=n/10;
+		rem=n - 10*quo;
+		w--;
+		if (w<DECIMAL_DIGITS) a->d[w]=(uint8_t)rem;
+		else if (rem) a->trunc=true;
+		n=quo;
+	}
+
+	a->nd+=delta;
+	if (a->nd>DECIMAL_DIGITS) a->nd=DECIMAL_DIGITS;
+	a->dp+=delta;
+	decimal_trim(a);
+}
+
+static void decimal_right_shift(decimal_t *a, unsigned k)
+{
+	int r=0, w=0;
+	uint64_t n=0, dig, mask=((uint64_t)1 << k) - 1;
+
+	/* pick up enough leading digits to cover the first shift */
+	for (; !(n >> k); r++) {
+		if (r>=a->nd) {
+			if (!n) {
+				a->nd=0;
+				return;
+			}
+			while (!(n >> k)) {
+				n*=10;
+				r++;
+			}
+			break;
+		}
+		n=n*10 + a->d[r];
+	}
+	a->dp-=r-1;
+
+	/* pick up a digit, put down a digit */
+	for (; r<a->nd; r++) {
+		dig=n >> k;
+		n&=mask;
+		a->d[w++]=(uint8_t)dig;
+		n=n*10 + a->d[r];
+	}
+
+	/* put down the rest */
+	while (n>0) {
+		dig=n >> k;
+		n&=mask;
+		if (w<DECIMAL_DIGITS) a->d[w++]=(uint8_t)dig;
+		else if (dig) a->trunc=true;
+		n*=10;
+	}
+
+	a->nd=w;
+	decimal_trim(a);
+}
+
+/* multiply by 2^k */
+static void decimal_shift(decimal_t *a, int k)
+{
+	if (!a->nd) return;
+	if (k>0) {
+		for (; k>DECIMAL_MAX_SHIFT; k-=DECIMAL_MAX_SHIFT) decimal_left_shift(a, DECIMAL_MAX_SHIFT);
+		decimal_left_shift(a, k);
+	} else if (k<0) {
+		for (; k<-DECIMAL_MAX_SHIFT; k+=DECIMAL_MAX_SHIFT) decimal_right_shift(a, DECIMAL_MAX_SHIFT);
+		decimal_right_shift(a, -k);
+	}
+}
+
+/* the integer part, rounded half to even */
+static uint64_t decimal_rounded_integer(decimal_t *a)
+{
+	uint64_t n=0;
+	int i;
+	bool up;
+
+	if (a->dp>20) return UINT64_MAX;
+	for (i=0; i<a->dp && i<a->nd; i++) n=n*10 + a->d[i];
+	for (; i<a->dp; i++) n*=10;
+
+	if (a->dp<0 || a->dp>=a->nd) {
+		up=false;
+	} else if (a->d[a->dp]==5 && a->dp+1==a->nd) {
+		/* exactly halfway, unless digits were dropped */
+		up=a->trunc || (a->dp>0 && (a->d[a->dp-1] & 1));
+	} else {
+		up=a->d[a->dp]>=5;
+	}
+	return n + up;
+}
+
+/**
+ * Load number text, which must already have been checked, into a
+ */
+static void decimal_load(decimal_t *a, const uint8_t *p, const uint8_t *limit)
+{
+	bool fraction=false, negexp=false;
+	int e=0;
+
+	a->nd=0;
+	a->dp=0;
+	a->trunc=false;
+
+	if (*p=='-' || *p=='+') p++;
+	for (; p<limit && *p!='e' && *p!='E'; p++) {
+		if (*p=='.') {
+			fraction=true;
+			continue;
+		}
+		if (!a->nd && *p=='0') {
+			if (fraction) a->dp--;
+			continue;
+		}
+		if (a->nd<DECIMAL_DIGITS) a->d[a->nd++]=*p - '0';
+		else if (*p!='0') a->trunc=true;
+		if (!fraction) a->dp++;
+	}
+
+	if (p<limit) {
+		p++;
+		if (*p=='-' || *p=='+') negexp=(*(p++)=='-');
+		for (; p<limit; p++) {
+			if (e<100000) e=e*10 + (*p - '0');
+		}
+	}
+	a->dp+=negexp ? -e : e;
+	decimal_trim(a);
+}
+
+/**
+ * Round a to the nearest double
+ * @return false if it overflows
+ */
+static bool decimal_to_bits(decimal_t *a, uint64_t *bits)
+{
+	static const int powtab[]={1, 3, 6, 9, 13, 16, 19, 23, 26};
+	uint64_t mantissa;
+	int exp=0, n;
+
+	if (!a->nd || a->dp<-330) {
+		*bits=0;
+		return true;
+	}
+	if (a->dp>310) return false;
+
+	/* scale by powers of two into [0.5, 1) */
+	while (a->dp>0) {
+		n=a->dp>=9 ? 27 : powtab[a->dp];
+		decimal_shift(a, -n);
+		exp+=n;
+	}
+	while (a->dp<0 || (a->dp==0 && a->d[0]<5)) {
+		n=-a->dp>=9 ? 27 : powtab[-a->dp];
+		decimal_shift(a, n);
+		exp-=n;
+	}
+
+	/* doubles are in [1, 2) */
+	exp--;
+
+	/* below the smallest normal exponent, shift into a subnormal */
+	if (exp<1-DOUBLE_EXPONENT_BIAS) {
+		n=1-DOUBLE_EXPONENT_BIAS - exp;
+		decimal_shift(a, -n);
+		exp+=n;
+	}
+	if (exp+DOUBLE_EXPONENT_BIAS>=DOUBLE_EXPONENT_INF) return false;
+
+	decimal_shift(a, DOUBLE_MANTISSA_BITS+1);
+	mantissa=decimal_rounded_integer(a);
+
+	/* rounding might have added a bit */
+	if (mantissa==(uint64_t)2 << DOUBLE_MANTISSA_BITS) {
+		mantissa>>=1;
+		exp++;
+		if (exp+DOUBLE_EXPONENT_BIAS>=DOUBLE_EXPONENT_INF) return false;
+	}
+	if (!(mantissa & ((uint64_t)1 << DOUBLE_MANTISSA_BITS))) exp=-DOUBLE_EXPONENT_BIAS;
+
+	*bits=(mantissa & DOUBLE_MANTISSA_MASK) | (uint64_t)(exp+DOUBLE_EXPONENT_BIAS) << DOUBLE_MANTISSA_BITS;
+	return true;
+}
+
+/*** Parsing ***/
+
+#if FLT_EVAL_METHOD==0
+/* powers of ten that are exact doubles */
+static const double EXACT_POW10[]={
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+/**
+ * Eisel-Lemire: the bits of the double nearest w * 10^q, for w nonzero
+ * @return false if the result cannot be decided from 128 bits
+ */
+static bool eisel_lemire(uint64_t w, int q, uint64_t *bits)
+{
+	const uint64_t *pow5;
+	uint64_t hi, lo, pow5lo, hi2, mantissa;
+	int lz, upperbit, power2;
+
+	if (q<JSONNUMBER_POW5_MIN) {
+		*bits=0;
+		return true;
+	}
+	if (q>308) {
+		*bits=(uint64_t)DOUBLE_EXPONENT_INF << DOUBLE_MANTISSA_BITS;
+		return true;
+	}
+
+	lz=__builtin_clzll(w);
+	w<<=lz;
+
+	/* powers of five between 5^-27 and 5^-1 are rounded up */
+	pow5=JSONNUMBER_POW5_TABLE[q - JSONNUMBER_POW5_MIN];
+	hi=pow5[0];
+	pow5lo=pow5[1];
+	if (q>=-27 && q<0 && !++pow5lo) hi++;
+
+	lo=mul128(w, hi, &hi);
+	/* only refine with the low half of the power if the bits below the
+	 * 55 that are kept could carry */
+	if ((hi & 0x1ff)==0x1ff) {
+		mul128(w, pow5lo, &hi2);
+		lo+=hi2;
+		if (hi2>lo) hi++;
+	}
+	if (lo==UINT64_MAX && (q<-27 || q>55)) return false;
+
+	upperbit=(int)(hi >> 63);
+	mantissa=hi >> (upperbit + 64 - DOUBLE_MANTISSA_BITS - 3);
+	power2=((217706 * q) >> 16) + 63 + upperbit - lz + DOUBLE_EXPONENT_BIAS;
+
+	if (power2<=0) {
+		/* subnormal */
+		if (-power2+1>=64) {
+			*bits=0;
+			return true;
+		}
+		mantissa>>=-power2 + 1;
+		mantissa+=mantissa & 1;
+		mantissa>>=1;
+		/* rounding up may have made it the smallest normal */
+		power2=mantissa<((uint64_t)1 << DOUBLE_MANTISSA_BITS) ? 0 : 1;
+		*bits=mantissa | (uint64_t)power2 << DOUBLE_MANTISSA_BITS;
+		return true;
+	}
+
+	/* exactly halfway between two doubles: round to even */
+	if (lo<=1 && q>=-4 && q<=23 && (mantissa & 3)==1
+			&& (mantissa << (upperbit + 64 - DOUBLE_MANTISSA_BITS - 3))==hi) {
+		mantissa&=~(uint64_t)1;
+	}
+
+	mantissa+=mantissa & 1;
+	mantissa>>=1;
+	if (mantissa>=(uint64_t)2 << DOUBLE_MANTISSA_BITS) {
+		mantissa=(uint64_t)1 << DOUBLE_MANTISSA_BITS;
+		power2++;
+	}
+	mantissa&=DOUBLE_MANTISSA_MASK;
+	if (power2>=DOUBLE_EXPONENT_INF) power2=DOUBLE_EXPONENT_INF, mantissa=0;
+
+	*bits=mantissa | (uint64_t)power2 << DOUBLE_MANTISSA_BITS;
+	return true;
+}
+
+bool jsonnumber_parse_double(const uint8_t *s, size_t len, bool exact, double *out)
+{
+	const uint8_t *p=s, *limit=s+len;
+	uint64_t w=0, bits, bits2, digits;
+	int64_t exp10=0, e=0;
+	int ndigits=0, shortexp;
+	bool negative=false, anydigit=false, truncated=false, negexp=false;
+	unsigned d;
+	double value;
+	decimal_t decimal;
+
+	/* sign and mantissa, keeping the first 19 significant digits in w */
+	if (p<limit && (*p=='-' || *p=='+')) negative=(*(p++)=='-');
+	for (; p<limit && (d=*p - '0')<=9; p++) {
+		anydigit=true;
+		if (!ndigits && !d) continue;
+		if (ndigits<PARSE_MAX_DIGITS) {
+			w=w*10 + d;
+			ndigits++;
+		} else {
+			exp10++;
+			if (d) truncated=true;
+		}
+	}
+	if (p<limit && *p=='.') {
+		for (p++; p<limit && (d=*p - '0')<=9; p++) {
+			anydigit=true;
+			if (!ndigits && !d) {
+				exp10--;
+			} else if (ndigits<PARSE_MAX_DIGITS) {
+				w=w*10 + d;
+				ndigits++;
+				exp10--;
+			} else if (d) {
+				truncated=true;
+			}
+		}
+	}
+	if (!anydigit) return false;
+
+	/* exponent */
+	if (p<limit && (*p=='e' || *p=='E')) {
+		p++;
+		if (p<limit && (*p=='-' || *p=='+')) negexp=(*(p++)=='-');
+		if (p==limit) return false;
+		for (; p<limit && (d=*p - '0')<=9; p++) {
+			if (e<100000) e=e*10 + d;
+		}
+		exp10+=negexp ? -e : e;
+	}
+	if (p!=limit) return false;
+
+	if (!w) {
+		value=0;
+#if FLT_EVAL_METHOD==0
+	} else if (!truncated && w<=(uint64_t)1 << 53 && exp10>=-22 && exp10<=22) {
+		/* both operands are exact, so the one rounding is correct */
+		value=(double)w;
+		if (exp10<0) value/=EXACT_POW10[-exp10];
+		else value*=EXACT_POW10[exp10];
+#endif
+	} else {
+		if (exp10<-100000) exp10=-100000;
+		if (exp10>100000) exp10=100000;
+
+		/* with digits dropped, the result must be the same for w and w+1 */
+		if (!eisel_lemire(w, (int)exp10, &bits)
+				|| (truncated && (!eisel_lemire(w+1, (int)exp10, &bits2) || bits!=bits2))) {
+			decimal_load(&decimal, s, limit);
+			if (!decimal_to_bits(&decimal, &bits)) return false;
+		}
+		if ((bits >> DOUBLE_MANTISSA_BITS)==DOUBLE_EXPONENT_INF) return false;
+		memcpy(&value, &bits, sizeof(value));
+	}
+
+	if (exact) {
+		if (truncated) return false;
+		if (!w) {
+			exp10=0;
+		} else {
+			while (!(w%10)) {
+				w/=10;
+				exp10++;
+			}
+		}
+		jsonnumber_shortest(value, &digits, &shortexp);
+		if (digits!=w || shortexp!=exp10) return false;
+	}
+
+	*out=negative ? -value : value;
+	return true;
+}
+
+/*** Formatting ***/
+
+/**
+ * The high 64 bits of g * cp, with the lowest bit set if any of the
+ * bits below were (rounding to odd)
+ */
+static inline uint64_t round_to_odd(uint64_t ghi, uint64_t glo, uint64_t cp)
+{
+	uint64_t xhi, ylo, yhi;
+
+	mul128(glo, cp, &xhi);
+	ylo=mul128(ghi, cp, &yhi);
+	ylo+=xhi;
+	if (ylo<xhi) yhi++;
+	return yhi | (ylo>1);
+}
+
+/**
+ * Schubfach, after Raffaello Giulietti's "The Schubfach way to render
+ * doubles".  The value is c * 2^q; the candidates are scaled by 10^-k
+ * to integers, and among those rounding back to the value the shortest,
+ * then closest, is taken.
+ */
+void jsonnumber_shortest(double value, uint64_t *digits, int *exponent)
+{
+	uint64_t bits, significand, c, cbl, cb, cbr, vbl, vb, vbr, lower, upper, s, sp, mid;
+	uint64_t ghi, glo;
+	const uint64_t *pow10;
+	int biased, q, k, h;
+	bool even, lower_closer, u_inside, w_inside;
+
+	memcpy(&bits, &value, sizeof(bits));
+	significand=bits & DOUBLE_MANTISSA_MASK;
+	biased=(int)(bits >> DOUBLE_MANTISSA_BITS) & DOUBLE_EXPONENT_INF;
+
+	if (!biased && !significand) {
+		*digits=0;
+		*exponent=0;
+		return;
+	}
+
+	if (biased) {
+		c=significand | (uint64_t)1 << DOUBLE_MANTISSA_BITS;
+		q=biased - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+
+		/* small integers */
+		if (q<=0 && -q<=DOUBLE_MANTISSA_BITS && !(c & (((uint64_t)1 << -q) - 1))) {
+			*digits=c >> -q;
+			*exponent=0;
+			goto trim;
+		}
+	} else {
+		c=significand;
+		q=1 - DOUBLE_EXPONENT_BIAS - DOUBLE_MANTISSA_BITS;
+	}
+
+	even=!(c & 1);
+	lower_closer=!significand && biased>1;
+
+	/* the value and its rounding interval, times 4 */
+	cbl=4*c - 2 + lower_closer;
+	cb=4*c;
+	cbr=4*c + 2;
+
+	/* floor(log10(2^q)), or of 3/4 2^q when the interval is lopsided */
+	k=(q*1262611 - (lower_closer ? 524031 : 0)) >> 22;
+	h=q + FLOOR_LOG2_POW10(-k) + 1;
+
+	/* 10^-k rounded up to 128 bits */
+	pow10=JSONNUMBER_POW5_TABLE[-k - JSONNUMBER_POW5_MIN];
+	ghi=pow10[0];
+	glo=pow10[1] + 1;
+	if (!glo) ghi++;
+
+	vbl=round_to_odd(ghi, glo, cbl << h);
+	vb=round_to_odd(ghi, glo, cb << h);
+	vbr=round_to_odd(ghi, glo, cbr << h);
+	lower=vbl + !even;
+	upper=vbr - !even;
+
+	/* one digit less, if exactly one of its neighbours is in the interval */
+	s=vb/4;
+	if (s>=10) {
+		sp=s/10;
+		u_inside=lower<=40*sp;
+		w_inside=40*sp + 40<=upper;
+		if (u_inside!=w_inside) {
+			*digits=sp + w_inside;
+			*exponent=k + 1;
+			goto trim;
+		}
+	}
+
+	u_inside=lower<=4*s;
+	w_inside=4*s + 4<=upper;
+	if (u_inside!=w_inside) {
+		*digits=s + w_inside;
+		*exponent=k;
+		goto trim;
+	}
+
+	/* both are in: take the closer, or the even one if halfway */
+	mid=4*s + 2;
+	*digits=s + (vb>mid || (vb==mid && (s & 1)));
+	*exponent=k;
+
+trim:
+	while (!(*digits%10)) {
+		*digits/=10;
+		(*exponent)++;
+	}
+}
+
+size_t jsonnumber_format_int64(int64_t value, char *buf)
+{
+	char digitbuf[20];
+	uint64_t v=value<0 ? 0-(uint64_t)value : (uint64_t)value;
+	int n=0;
+	char *p=buf;
+
+	if (value<0) *(p++)='-';
+	do {
+		digitbuf[n++]='0' + v%10;
+		v/=10;
+	} while (v);
+	while (n) *(p++)=digitbuf[--n];
+	return p-buf;
+}
+
+size_t jsonnumber_format_double(double value, char *buf)
+{
+	char digitbuf[20];
+	uint64_t digits;
+	int exponent, n=0, x, i;
+	char *p=buf;
+
+	if (value<0 || (value==0 && 1/value<0)) *(p++)='-';
+	jsonnumber_shortest(value, &digits, &exponent);
+	if (!digits) {
+		*(p++)='0';
+		return p-buf;
+	}
+
+	/* digits in reverse */
+	for (; digits; digits/=10) digitbuf[n++]='0' + digits%10;
+	x=exponent + n - 1;
+
+	if (x<-4 || x>=15) {
+		/* d.ddde+xx */
+		*(p++)=digitbuf[--n];
+		if (n) *(p++)='.';
+		while (n) *(p++)=digitbuf[--n];
+		*(p++)='e';
+		*(p++)=x<0 ? '-' : '+';
+		if (x<0) x=-x;
+		if (x>=100) *(p++)='0' + x/100;
+		*(p++)='0' + x/10%10;
+		*(p++)='0' + x%10;
+	} else if (x>=0) {
+		/* ddd.ddd or ddd00 */
+		for (i=0; i<=x; i++) *(p++)=n ? digitbuf[--n] : '0';
+		if (n) *(p++)='.';
+		while (n) *(p++)=digitbuf[--n];
+	} else {
+		/* 0.000ddd */
+		*(p++)='0';
+		*(p++)='.';
+		for (i=-1; i>x; i--) *(p++)='0';
+		while (n) *(p++)=digitbuf[--n];
+	}
+	return p-buf;
+}
@@ -0,0 +1,57 @@
+/**
+ * jsonnumber.h
+ * Conversion between json number text and doubles without strtod and
+ * printf, which are slow and depend on the locale.
+ *
+ * Text is read with the Eisel-Lemire algorithm, which gets the correctly
+ * rounded double from a 128 bit product of up to 19 significant digits and
+ * a table of powers of five, and falls back to exact decimal arithmetic in
+ * the rare cases it cannot decide.  Doubles are written with Schubfach,
+ * which finds the shortest decimal that reads back as the same double using
+ * the same table.
+ */
+#ifndef __JSONNUMBER_H__
+#define __JSONNUMBER_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Parse json number text: an optional sign, digits with an optional
+ * fraction, and an optional exponent.  The result is correctly rounded.
+ * With exact set, only succeeds if the text has no more significant digits
+ * than jsonnumber_format_double writes for the result, so that formatting
+ * it gives back the same number.
+ * @return false if the text is not a number or does not fit in a double
+ */
+bool jsonnumber_parse_double(const uint8_t *s, size_t len, bool exact, double *out);
+
+/**
+ * Format a finite double as the shortest json number text that parses
+ * back to it, in the style of printf %g: exponent notation for exponents
+ * below -4 or from 15 up.  buf must have room for JSONNUMBER_FORMAT_MAX
+ * bytes.  No terminator is written.
+ * @return number of bytes written
+ */
+#define JSONNUMBER_FORMAT_MAX 32
+size_t jsonnumber_format_double(double value, char *buf);
+
+/**
+ * Format an integer into buf, which must have room for
+ * JSONNUMBER_FORMAT_MAX bytes.  No terminator is written.
+ * @return number of bytes written
+ */
+size_t jsonnumber_format_int64(int64_t value, char *buf);
+
+/**
+ * Shortest decimal for a finite double: |value| = digits * 10^exponent
+ * with digits not divisible by 10 (or 0 for zero)
+ */
+void jsonnumber_shortest(double value, uint64_t *digits, int *exponent);
+
+/* table of powers of five in jsonnumber.tab.c */
+#define JSONNUMBER_POW5_MIN (-342)
+#define JSONNUMBER_POW5_MAX 326
+extern const uint64_t JSONNUMBER_POW5_TABLE[JSONNUMBER_POW5_MAX-JSONNUMBER_POW5_MIN+1][2];
+
+#endif
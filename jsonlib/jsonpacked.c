@@ -0,0 +1,321 @@
+#include <math.h>
+#include "jsonpacked.h"
+#include "jsonnumber.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+#define PACKED_SWAP16(v) __builtin_bswap16(v)
+#define PACKED_SWAP32(v) __builtin_bswap32(v)
+#define PACKED_SWAP64(v) __builtin_bswap64(v)
+#else
+#define PACKED_SWAP16(v) (v)
+#define PACKED_SWAP32(v) (v)
+#define PACKED_SWAP64(v) (v)
+#endif
+
+static inline int64_t load_int8(const uint8_t *p)
+{
+	return (int8_t)*p;
+}
+
+static inline int64_t load_int16(const uint8_t *p)
+{
+	uint16_t v;
+	memcpy(&v, p, 2);
+	return (int16_t)PACKED_SWAP16(v);
+}
+
+static inline int64_t load_int32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return (int32_t)PACKED_SWAP32(v);
+}
+
+static inline int64_t load_int64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return (int64_t)PACKED_SWAP64(v);
+}
+
+static inline double load_double(const uint8_t *p)
+{
+	uint64_t v;
+	double d;
+	memcpy(&v, p, 8);
+	v=PACKED_SWAP64(v);
+	memcpy(&d, &v, 8);
+	return d;
+}
+
+static void store_element(uint8_t *p, uint32_t width, uint64_t v)
+{
+	uint32_t i;
+	for (i=0; i<width; i++) {
+		p[i]=(uint8_t)v;
+		v>>=8;
+	}
+}
+
+bool jsonpacked_parse_int64(const uint8_t *s, size_t len, int64_t *out)
+{
+	size_t i=0;
+	bool neg=false;
+	uint64_t v=0;
+	uint32_t digit;
+
+	if (i<len && s[i]=='-') {
+		neg=true;
+		i++;
+	}
+	if (i==len) return false;
+
+	for (; i<len; i++) {
+		digit=(uint32_t)s[i] - '0';
+		if (digit>9) return false;
+		if (v>(UINT64_MAX-digit)/10) return false;
+		v=v*10 + digit;
+	}
+
+	if (neg) {
+		if (v>(uint64_t)INT64_MAX+1) return false;
+		*out=(int64_t)(0-v);
+	} else {
+		if (v>(uint64_t)INT64_MAX) return false;
+		*out=(int64_t)v;
+	}
+	return true;
+}
+
+bool jsonpacked_parse_double(const uint8_t *s, size_t len, bool exact, double *out)
+{
+	return jsonnumber_parse_double(s, len, exact, out);
+}
+
+void jsonpacked_finalize_array(dynbuffer_t *dest, uint32_t startpos, uint32_t count, bool integers)
+{
+	uint32_t datapos=startpos+1+JSONBINARY_RESERVE_LENGTH;
+	uint8_t *source=dest->contents+datapos;
+	uint8_t *sourcelimit=dest->contents+dest->pos;
+	uint8_t typecode;
+	uint8_t *data;
+	uint32_t datalen;
+	uint64_t *values;
+	int64_t ivalue, minvalue=0, maxvalue=0;
+	double dvalue;
+	char number[JSONNUMBER_FORMAT_MAX];
+	size_t numberlen;
+	uint8_t subtype;
+	uint32_t width, i;
+	uint8_t *out;
+
+	if (!count) {
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		return;
+	}
+
+	values=(uint64_t*)JSON_malloc(count * sizeof(uint64_t));
+	for (i=0; i<count; i++) {
+		if (!jsonbinary_extract_type_length(source, sourcelimit, &typecode, &data, &datalen)
+				|| typecode!=JSONBINARY_TYPE_NUMBER) break;
+		source=data+datalen;
+
+		if (integers) {
+			if (!jsonpacked_parse_int64(data, datalen, &ivalue)) break;
+			if (i==0 || ivalue<minvalue) minvalue=ivalue;
+			if (i==0 || ivalue>maxvalue) maxvalue=ivalue;
+			values[i]=(uint64_t)ivalue;
+			numberlen=jsonnumber_format_int64(ivalue, number);
+		} else {
+			if (!jsonpacked_parse_double(data, datalen, false, &dvalue)) break;
+			memcpy(&values[i], &dvalue, 8);
+			numberlen=jsonnumber_format_double(dvalue, number);
+		}
+
+		/* the packed element is written back formatted, so only text that
+		 * formats the same is packed: 1.0, 2.50, 1e5 and -0 keep theirs */
+		if (numberlen!=datalen || memcmp(number, data, datalen)) break;
+	}
+
+	/* pick the narrowest element that holds everything */
+	if (!integers) {
+		subtype=JSONBINARY_EXT_PACKED_DOUBLE; width=8;
+	} else if (minvalue>=INT8_MIN && maxvalue<=INT8_MAX) {
+		subtype=JSONBINARY_EXT_PACKED_INT8; width=1;
+	} else if (minvalue>=INT16_MIN && maxvalue<=INT16_MAX) {
+		subtype=JSONBINARY_EXT_PACKED_INT16; width=2;
+	} else if (minvalue>=INT32_MIN && maxvalue<=INT32_MAX) {
+		subtype=JSONBINARY_EXT_PACKED_INT32; width=4;
+	} else {
+		subtype=JSONBINARY_EXT_PACKED_INT64; width=8;
+	}
+
+	/* only pack if every element converted and it saves space */
+	if (i<count || (uint64_t)count*width+1>=(uint64_t)(sourcelimit-(dest->contents+datapos))) {
+		JSON_free(values);
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		return;
+	}
+
+	out=dest->contents+datapos;
+	*(out++)=subtype;
+	for (i=0; i<count; i++) {
+		store_element(out, width, values[i]);
+		out+=width;
+	}
+	dest->pos=out - dest->contents;
+	JSON_free(values);
+
+	jsonbinary_finalize_container(dest, JSONBINARY_TYPE_EXTENDED, startpos);
+}
+
+bool jsonpacked_open(const uint8_t *data, uint32_t len, jsonpacked_t *packed)
+{
+	if (len<1) return false;
+
+	packed->subtype=data[0];
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: packed->width=1; break;
+	case JSONBINARY_EXT_PACKED_INT16: packed->width=2; break;
+	case JSONBINARY_EXT_PACKED_INT32: packed->width=4; break;
+	case JSONBINARY_EXT_PACKED_INT64: packed->width=8; break;
+	case JSONBINARY_EXT_PACKED_DOUBLE: packed->width=8; break;
+	default:
+		return false;
+	}
+
+	if ((len-1)%packed->width) return false;
+	packed->count=(len-1)/packed->width;
+	packed->data=data+1;
+	return true;
+}
+
+double jsonpacked_get(const jsonpacked_t *packed, uint32_t index)
+{
+	const uint8_t *p=packed->data + (size_t)index*packed->width;
+
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: return (double)load_int8(p);
+	case JSONBINARY_EXT_PACKED_INT16: return (double)load_int16(p);
+	case JSONBINARY_EXT_PACKED_INT32: return (double)load_int32(p);
+	case JSONBINARY_EXT_PACKED_INT64: return (double)load_int64(p);
+	default: return load_double(p);
+	}
+}
+
+size_t jsonpacked_format(const jsonpacked_t *packed, uint32_t index, char *buf)
+{
+	const uint8_t *p=packed->data + (size_t)index*packed->width;
+	int64_t ivalue;
+
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: ivalue=load_int8(p); break;
+	case JSONBINARY_EXT_PACKED_INT16: ivalue=load_int16(p); break;
+	case JSONBINARY_EXT_PACKED_INT32: ivalue=load_int32(p); break;
+	case JSONBINARY_EXT_PACKED_INT64: ivalue=load_int64(p); break;
+	default:
+		return jsonnumber_format_double(load_double(p), buf);
+	}
+	return jsonnumber_format_int64(ivalue, buf);
+}
+
+/**
+ * Kernels.  Each is expanded once per element type so that the inner loop
+ * is a fixed stride load the compiler can vectorize.
+ */
+#define PACKED_INT_SUM(load, width) { \
+	int64_t isum=0; \
+	for (i=0; i<n; i++) isum+=load(p + i*width); \
+	return (double)isum; \
+	}
+
+double jsonpacked_sum(const jsonpacked_t *packed)
+{
+	const uint8_t *p=packed->data;
+	uint32_t i, n=packed->count;
+	double s0=0, s1=0, s2=0, s3=0;
+
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: PACKED_INT_SUM(load_int8, 1)
+	case JSONBINARY_EXT_PACKED_INT16: PACKED_INT_SUM(load_int16, 2)
+	case JSONBINARY_EXT_PACKED_INT32: PACKED_INT_SUM(load_int32, 4)
+	case JSONBINARY_EXT_PACKED_INT64:
+		/* int64 sums can overflow - accumulate as double */
+		for (i=0; i<n; i++) s0+=(double)load_int64(p + i*8);
+		return s0;
+	default:
+		/* independent accumulators break the add dependency chain */
+		for (i=0; i+4<=n; i+=4) {
+			s0+=load_double(p + i*8);
+			s1+=load_double(p + (i+1)*8);
+			s2+=load_double(p + (i+2)*8);
+			s3+=load_double(p + (i+3)*8);
+		}
+		for (; i<n; i++) s0+=load_double(p + i*8);
+		return (s0+s1)+(s2+s3);
+	}
+}
+
+#define PACKED_INT_MINMAX(load, width) { \
+	int64_t imin=load(p), imax=imin, v; \
+	for (i=1; i<n; i++) { \
+		v=load(p + i*width); \
+		imin=v<imin ? v : imin; \
+		imax=v>imax ? v : imax; \
+	} \
+	*outmin=(double)imin; \
+	*outmax=(double)imax; \
+	return; \
+	}
+
+void jsonpacked_minmax(const jsonpacked_t *packed, double *outmin, double *outmax)
+{
+	const uint8_t *p=packed->data;
+	uint32_t i, n=packed->count;
+	double dmin, dmax, v;
+
+	if (!n) return;
+
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: PACKED_INT_MINMAX(load_int8, 1)
+	case JSONBINARY_EXT_PACKED_INT16: PACKED_INT_MINMAX(load_int16, 2)
+	case JSONBINARY_EXT_PACKED_INT32: PACKED_INT_MINMAX(load_int32, 4)
+	case JSONBINARY_EXT_PACKED_INT64: PACKED_INT_MINMAX(load_int64, 8)
+	default:
+		dmin=dmax=load_double(p);
+		for (i=1; i<n; i++) {
+			v=load_double(p + i*8);
+			dmin=v<dmin ? v : dmin;
+			dmax=v>dmax ? v : dmax;
+		}
+		*outmin=dmin;
+		*outmax=dmax;
+	}
+}
+
+/* branch free compare over the whole vector so the loop vectorizes */
+#define PACKED_CONTAINS(load, width, needle) { \
+	int found=0; \
+	for (i=0; i<n; i++) found|=(load(p + i*width)==needle); \
+	return found!=0; \
+	}
+
+bool jsonpacked_contains(const jsonpacked_t *packed, double value)
+{
+	const uint8_t *p=packed->data;
+	uint32_t i, n=packed->count;
+	int64_t ivalue;
+
+	if (packed->subtype==JSONBINARY_EXT_PACKED_DOUBLE) PACKED_CONTAINS(load_double, 8, value)
+
+	/* integer vectors can only contain integral values in range */
+	if (value!=floor(value) || value<-9223372036854775808.0 || value>=9223372036854775808.0) return false;
+	ivalue=(int64_t)value;
+
+	switch (packed->subtype) {
+	case JSONBINARY_EXT_PACKED_INT8: PACKED_CONTAINS(load_int8, 1, ivalue)
+	case JSONBINARY_EXT_PACKED_INT16: PACKED_CONTAINS(load_int16, 2, ivalue)
+	case JSONBINARY_EXT_PACKED_INT32: PACKED_CONTAINS(load_int32, 4, ivalue)
+	default: PACKED_CONTAINS(load_int64, 8, ivalue)
+	}
+}
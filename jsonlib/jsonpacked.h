@@ -0,0 +1,65 @@
+/**
+ * jsonpacked.h
+ * Packed homogeneous number arrays (JSONBINARY_EXT_PACKED_*).
+ *
+ * The kernels over packed vectors are written as simple counted loops over
+ * fixed width elements so that the compiler can vectorize them.
+ */
+#ifndef __JSONPACKED_H__
+#define __JSONPACKED_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "dynbuffer.h"
+#include "jsonbinary.h"
+#include "jsonnumber.h"
+
+typedef struct {
+	uint8_t subtype;	/* JSONBINARY_EXT_PACKED_* */
+	uint32_t width;		/* bytes per element */
+	uint32_t count;
+	const uint8_t *data;
+} jsonpacked_t;
+
+/**
+ * Finalize an array whose elements were all numbers, as with
+ * jsonbinary_finalize_container.  If every element's text is what
+ * jsonpacked_format writes for its value and the packed form is smaller,
+ * the array is rewritten as a packed vector.  If integers is true, all
+ * elements were lexed as integers.
+ */
+void jsonpacked_finalize_array(dynbuffer_t *dest, uint32_t startpos, uint32_t count, bool integers);
+
+/**
+ * Open the data of a JSONBINARY_TYPE_EXTENDED value as a packed array.
+ * @return false if it is not a valid packed array
+ */
+bool jsonpacked_open(const uint8_t *data, uint32_t len, jsonpacked_t *packed);
+
+/**
+ * Format element index as json number text into buf, which must have room
+ * for JSONPACKED_FORMAT_MAX bytes.
+ * @return number of bytes written
+ */
+#define JSONPACKED_FORMAT_MAX JSONNUMBER_FORMAT_MAX
+size_t jsonpacked_format(const jsonpacked_t *packed, uint32_t index, char *buf);
+
+double jsonpacked_get(const jsonpacked_t *packed, uint32_t index);
+double jsonpacked_sum(const jsonpacked_t *packed);
+void jsonpacked_minmax(const jsonpacked_t *packed, double *outmin, double *outmax);
+bool jsonpacked_contains(const jsonpacked_t *packed, double value);
+
+/**
+ * Parse json number text as an exact int64: digits after an optional minus
+ * sign (json has no plus sign)
+ * @return false if the text is not an integer or is out of range
+ */
+bool jsonpacked_parse_int64(const uint8_t *s, size_t len, int64_t *out);
+
+/**
+ * Parse json number text as a double, as jsonnumber_parse_double.  With
+ * exact set, only succeeds if the text is reproduced when formatted back
+ * out.
+ */
+bool jsonpacked_parse_double(const uint8_t *s, size_t len, bool exact, double *out);
+
+#endif
@@ -1,8 +1,8 @@
 /**
  * jsonparse.h
  *
- * Interface to simple recursive descent parser for JSON with actions defined via
- * pre-processor macros.
+ * Interface to a simple JSON parser with actions defined via pre-processor
+ * macros.
  */
 #ifndef __JSONPARSE_H__
 #define __JSONPARSE_H__
@@ -16,6 +16,78 @@
 #define JSONPARSE_EXTRA_DECL
 #endif
 
+/**
+ * JSONPARSE_FRAME_DECL
+ * If defined, add additional declarations to jsonparse_frame_t, the state
+ * kept for each open container.  Actions reach the frame of the innermost
+ * container with JSONPARSE_FRAME, so state set by a START action can be
+ * read back by the matching END action.
+ */
+#ifndef JSONPARSE_FRAME_DECL
+#define JSONPARSE_FRAME_DECL
+#endif
+
+/**
+ * JSONPARSE_RECURSIVE
+ * Define as 1 to parse by recursive descent, one C stack frame per nesting
+ * level, instead of with the iterative parser and its explicit stack of
+ * jsonparse_frame_t.  The actions are invoked identically either way.
+ *
+ * Defaults to 0
+ */
+#ifndef JSONPARSE_RECURSIVE
+#define JSONPARSE_RECURSIVE 0
+#endif
+
+/**
+ * JSONPARSE_MAX_DEPTH
+ * Containers nested deeper than this fail to parse.
+ *
+ * Defaults to json_max_depth
+ */
+#ifndef JSONPARSE_MAX_DEPTH
+#define JSONPARSE_MAX_DEPTH json_max_depth
+#endif
+
+/**
+ * JSONPARSE_STATIC_FRAMES
+ * Number of frames the iterative parser keeps in jsonparseinfo_t before it
+ * allocates its stack with JSON_malloc.
+ *
+ * Defaults to 32
+ */
+#ifndef JSONPARSE_STATIC_FRAMES
+#define JSONPARSE_STATIC_FRAMES 32
+#endif
+
+/**
+ * JSONPARSE_PUSH
+ * Define as 1 to include jsonparse_push_begin, jsonparse_push and
+ * jsonparse_push_end, which parse input handed over in chunks of any size.
+ * Requires the standard IO and the iterative parser.
+ *
+ * Defaults to 0
+ */
+#ifndef JSONPARSE_PUSH
+#define JSONPARSE_PUSH 0
+#endif
+
+typedef struct {
+	jsonlex_token_t kind;	/* jsonlex_lbrace or jsonlex_lbracket */
+	int index;				/* field or element index */
+
+	JSONPARSE_FRAME_DECL
+} jsonparse_frame_t;
+
+/**
+ * Result of handing the iterative parser a token or a chunk of input
+ */
+typedef enum {
+	JSONPARSE_CONTINUE,		/* more input is needed */
+	JSONPARSE_DONE,			/* a complete value followed by eof */
+	JSONPARSE_ERROR
+} jsonparse_status_t;
+
 typedef struct {
 	/**
 	 * lexstate as the first member means that jsonparse_t
@@ -23,11 +95,33 @@ typedef struct {
 	 */
 	jsonlex_state_t lexstate;
 
+	/* current nesting depth */
+	int depth;
+
+	#if !JSONPARSE_RECURSIVE
+	/* what the next token may be (a jsonparse_state_t) */
+	int state;
+	/* one frame per open container */
+	jsonparse_frame_t *stack;
+	int stack_capacity;
+	jsonparse_frame_t stack_static[JSONPARSE_STATIC_FRAMES];
+	#endif
+
+	#if JSONPARSE_PUSH
+	/* the start of a token split between chunks */
+	dynbuffer_t carry;
+	#endif
+
 	JSONPARSE_EXTRA_DECL;
 } jsonparseinfo_t, *jsonparseinfo_arg;
 
 /** Forward declarations **/
 JSON_FDECLP bool jsonparse(jsonparseinfo_t *info);
+#if JSONPARSE_PUSH
+JSON_FDECLP void jsonparse_push_begin(jsonparseinfo_t *info);
+JSON_FDECLP jsonparse_status_t jsonparse_push(jsonparseinfo_t *info, uint8_t *chunk, size_t len, bool final);
+JSON_FDECLP void jsonparse_push_end(jsonparseinfo_t *info);
+#endif
 
 
 #endif
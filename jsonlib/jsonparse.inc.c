@@ -11,7 +11,92 @@ static const uint8_t JSON_IDENT_NULL[] = { 'n', 'u', 'l', 'l' };
 static const uint8_t JSON_IDENT_UNDEFINED[] = { 'u', 'n', 'd', 'e', 'f', 'i', 'n', 'e', 'd' };
 
 #define JSON_TOKEN_IS_IDENTIFIER(ident) \
-	(sizeof(ident)==parsestate->lexstate.buffer_pos && memcmp(ident, parsestate->lexstate.buffer, sizeof(ident))==0)
+	(sizeof(ident)==parsestate->lexstate.token_len && memcmp(ident, parsestate->lexstate.token, sizeof(ident))==0)
+
+#ifdef JSONPARSE_ACTION_ERROR
+#define JSONPARSE_DEPTH_ERROR(got) JSONPARSE_ACTION_ERROR("Maximum nesting depth exceeded", got)
+#else
+#define JSONPARSE_DEPTH_ERROR(got)
+#endif
+
+/**
+ * Invoke the action for a scalar value.  Legal tokens are
+ * jsonlex_identifier (null, undefined, true, false), jsonlex_integer,
+ * jsonlex_numeric and jsonlex_string.
+ */
+JSON_FDECLP bool jsonparse_scalar(jsonparseinfo_arg parsestate, jsonlex_token_t token)
+{
+	switch (token) {
+	case jsonlex_identifier:
+		/* we only support four different identifiers, so just figure which it is */
+		if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_NULL)) {
+			#ifdef JSONPARSE_ACTION_VALUE_NULL
+			JSONPARSE_ACTION_VALUE_NULL();
+			#endif
+		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_TRUE)) {
+			#ifdef JSONPARSE_ACTION_VALUE_BOOL
+			JSONPARSE_ACTION_VALUE_BOOL(true);
+			#endif
+		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_FALSE)) {
+			#ifdef JSONPARSE_ACTION_VALUE_BOOL
+			JSONPARSE_ACTION_VALUE_BOOL(false);
+			#endif
+		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_UNDEFINED)) {
+			#ifdef JSONPARSE_ACTION_VALUE_BOOL
+			JSONPARSE_ACTION_VALUE_UNDEFINED();
+			#endif
+		} else {
+			/* unrecognized token */
+			#ifdef JSONPARSE_ACTION_ERROR
+			JSONPARSE_ACTION_ERROR("Expected true/false/null/undefined identifier", token);
+			#endif
+			return false;
+		}
+		return true;
+	case jsonlex_integer:
+		#ifdef JSONPARSE_ACTION_VALUE_INTEGER
+		JSONPARSE_ACTION_VALUE_INTEGER(parsestate->lexstate.token, parsestate->lexstate.token_len);
+		#else
+			/* caller may just want to treat INTEGER and NUMERIC the same, fallback */
+			#ifdef JSONPARSE_ACTION_VALUE_NUMERIC
+			JSONPARSE_ACTION_VALUE_NUMERIC(parsestate->lexstate.token, parsestate->lexstate.token_len);
+			#endif
+		#endif
+		return true;
+	case jsonlex_numeric:
+		#ifdef JSONPARSE_ACTION_VALUE_NUMERIC
+		JSONPARSE_ACTION_VALUE_NUMERIC(parsestate->lexstate.token, parsestate->lexstate.token_len);
+		#endif
+		return true;
+	case jsonlex_string:
+		#ifdef JSONPARSE_ACTION_VALUE_STRING
+		JSONPARSE_ACTION_VALUE_STRING(parsestate->lexstate.token, parsestate->lexstate.token_len);
+		#endif
+		return true;
+	default:
+		#ifdef JSONPARSE_ACTION_ERROR
+		JSONPARSE_ACTION_ERROR("Expected legal value", token);
+		#endif
+		return false;
+	}
+}
+
+#if JSONPARSE_RECURSIVE
+/* the frame of the innermost container is a local of its parse function */
+#define JSONPARSE_FRAME (&frame)
+
+/**
+ * Check the depth limit and set up the frame on entering a container
+ */
+#define JSONPARSE_ENTER(k) \
+	if (parsestate->depth==JSONPARSE_MAX_DEPTH) { \
+		JSONPARSE_DEPTH_ERROR(k); \
+		return false; \
+	} \
+	parsestate->depth++; \
+	frame.kind=k; \
+	frame.index=0; \
+	(void)frame;
 
 /**** Forward declarations ****/
 JSON_FDECLP bool jsonparse_object(jsonparseinfo_arg parsestate);
@@ -27,7 +112,10 @@ JSON_FDECLP bool jsonparse_object(jsonparseinfo_arg parsestate)
 {
 	jsonlex_token_t token;
 	int fieldindex=-1;
-	
+	jsonparse_frame_t frame;
+
+	JSONPARSE_ENTER(jsonlex_lbrace);
+
 	#ifdef JSONPARSE_ACTION_OBJECT_START
 	JSONPARSE_ACTION_OBJECT_START();
 	#endif
@@ -38,6 +126,7 @@ JSON_FDECLP bool jsonparse_object(jsonparseinfo_arg parsestate)
 		#ifdef JSONPARSE_ACTION_OBJECT_END
 		JSONPARSE_ACTION_OBJECT_END();
 		#endif
+		parsestate->depth--;
 		return true;
 	}
 
@@ -47,7 +136,7 @@ JSON_FDECLP bool jsonparse_object(jsonparseinfo_arg parsestate)
 		if (token==jsonlex_identifier||token==jsonlex_string) {
 			/* treat either a string or identifier as a field label */
 			#ifdef JSONPARSE_ACTION_OBJECT_LABEL
-			JSONPARSE_ACTION_OBJECT_LABEL(fieldindex, parsestate->lexstate.buffer, parsestate->lexstate.buffer_pos);
+			JSONPARSE_ACTION_OBJECT_LABEL(fieldindex, parsestate->lexstate.token, parsestate->lexstate.token_len);
 			#endif
 		} else {
 			#ifdef JSONPARSE_ACTION_ERROR
@@ -81,6 +170,7 @@ JSON_FDECLP bool jsonparse_object(jsonparseinfo_arg parsestate)
 			#ifdef JSONPARSE_ACTION_OBJECT_END
 			JSONPARSE_ACTION_OBJECT_END();
 			#endif
+			parsestate->depth--;
 			return true;
 		} else {
 			#ifdef JSONPARSE_ACTION_ERROR
@@ -99,6 +189,9 @@ JSON_FDECLP bool jsonparse_array(jsonparseinfo_arg parsestate)
 {
 	jsonlex_token_t token;
 	int elementindex=-1;
+	jsonparse_frame_t frame;
+
+	JSONPARSE_ENTER(jsonlex_lbracket);
 
 	#ifdef JSONPARSE_ACTION_ARRAY_START
 	JSONPARSE_ACTION_ARRAY_START();
@@ -110,6 +203,7 @@ JSON_FDECLP bool jsonparse_array(jsonparseinfo_arg parsestate)
 		#ifdef JSONPARSE_ACTION_ARRAY_END
 		JSONPARSE_ACTION_ARRAY_END();
 		#endif
+		parsestate->depth--;
 		return true;
 	}
 
@@ -136,6 +230,7 @@ JSON_FDECLP bool jsonparse_array(jsonparseinfo_arg parsestate)
 			#ifdef JSONPARSE_ACTION_ARRAY_END
 			JSONPARSE_ACTION_ARRAY_END();
 			#endif
+			parsestate->depth--;
 			return true;
 		}
 
@@ -152,10 +247,7 @@ JSON_FDECLP bool jsonparse_array(jsonparseinfo_arg parsestate)
  * Parse a JSON "value".  Legal tokens in this state are:
  *   - jsonlex_lbrace: introduces an object value
  *   - jsonlex_lbracket: introduces an array value
- *   - jsonlex_identifier: interpreted as a JSON constant (null, undefined, true, false)
- *   - jsonlex_integer
- *   - jsonlex_numeric
- *   - jsonlex_string
+ *   - any scalar token accepted by jsonparse_scalar
  */
 JSON_FDECLP bool jsonparse_value(jsonparseinfo_arg parsestate, jsonlex_token_t token)
 {
@@ -165,57 +257,8 @@ JSON_FDECLP bool jsonparse_value(jsonparseinfo_arg parsestate, jsonlex_token_t t
 		return jsonparse_object(parsestate);
 	case jsonlex_lbracket:
 		return jsonparse_array(parsestate);
-	case jsonlex_identifier:
-		/* we only support four different identifiers, so just figure which it is */
-		if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_NULL)) {
-			#ifdef JSONPARSE_ACTION_VALUE_NULL
-			JSONPARSE_ACTION_VALUE_NULL();
-			#endif
-		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_TRUE)) {
-			#ifdef JSONPARSE_ACTION_VALUE_BOOL
-			JSONPARSE_ACTION_VALUE_BOOL(true);
-			#endif
-		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_FALSE)) {
-			#ifdef JSONPARSE_ACTION_VALUE_BOOL
-			JSONPARSE_ACTION_VALUE_BOOL(false);
-			#endif
-		} else if (JSON_TOKEN_IS_IDENTIFIER(JSON_IDENT_UNDEFINED)) {
-			#ifdef JSONPARSE_ACTION_VALUE_BOOL
-			JSONPARSE_ACTION_VALUE_UNDEFINED();
-			#endif
-		} else {
-			/* unrecognized token */
-			#ifdef JSONPARSE_ACTION_ERROR
-			JSONPARSE_ACTION_ERROR("Expected true/false/null/undefined identifier", token);
-			#endif
-			return false;
-		}
-		return true;
-	case jsonlex_integer:
-		#ifdef JSONPARSE_ACTION_VALUE_INTEGER
-		JSONPARSE_ACTION_VALUE_INTEGER(parsestate->lexstate.buffer, parsestate->lexstate.buffer_pos);
-		#else
-			/* caller may just want to treat INTEGER and NUMERIC the same, fallback */
-			#ifdef JSONPARSE_ACTION_VALUE_NUMERIC
-			JSONPARSE_ACTION_VALUE_NUMERIC(parsestate->lexstate.buffer, parsestate->lexstate.buffer_pos);
-			#endif
-		#endif
-		return true;
-	case jsonlex_numeric:
-		#ifdef JSONPARSE_ACTION_VALUE_NUMERIC
-		JSONPARSE_ACTION_VALUE_NUMERIC(parsestate->lexstate.buffer, parsestate->lexstate.buffer_pos);
-		#endif
-		return true;
-	case jsonlex_string:
-		#ifdef JSONPARSE_ACTION_VALUE_STRING
-		JSONPARSE_ACTION_VALUE_STRING(parsestate->lexstate.buffer, parsestate->lexstate.buffer_pos);
-		#endif
-		return true;
 	default:
-		#ifdef JSONPARSE_ACTION_ERROR
-		JSONPARSE_ACTION_ERROR("Expected legal value", token);
-		#endif
-		return false;
+		return jsonparse_scalar(parsestate, token);
 	}
 }
 
@@ -230,6 +273,7 @@ JSON_FDECLP bool jsonparse(jsonparseinfo_arg parsestate)
 {
 	jsonlex_token_t token;
 
+	parsestate->depth=0;
 	if (!jsonparse_value(parsestate, jsonlex_next_token(&parsestate->lexstate))) return false;
 
 	token=jsonlex_next_token(&parsestate->lexstate);
@@ -242,3 +286,332 @@ JSON_FDECLP bool jsonparse(jsonparseinfo_arg parsestate)
 	}
 	return true;
 }
+
+#else
+/* the frame of the innermost container is the top of the explicit stack */
+#define JSONPARSE_FRAME frame
+
+/**
+ * States of the iterative parser, named for what the next token may be.
+ * Containers push a frame on an explicit stack instead of recursing, so
+ * the nesting depth is bounded only by JSONPARSE_MAX_DEPTH and memory, and
+ * since the stack lives in jsonparseinfo_t the parser can stop between any
+ * two tokens and resume later.
+ */
+typedef enum {
+	JSONPARSE_STATE_VALUE,			/* a value */
+	JSONPARSE_STATE_OBJECT_FIRST,	/* a label or the end of an empty object */
+	JSONPARSE_STATE_LABEL,			/* a label */
+	JSONPARSE_STATE_COLON,			/* the colon after a label */
+	JSONPARSE_STATE_ARRAY_FIRST,	/* a value or the end of an empty array */
+	JSONPARSE_STATE_AFTER_VALUE,	/* a comma or the end of the innermost container */
+	JSONPARSE_STATE_END				/* eof after the complete value */
+} jsonparse_state_t;
+
+JSON_FDECLP void jsonparse_begin(jsonparseinfo_arg parsestate)
+{
+	parsestate->depth=0;
+	parsestate->state=JSONPARSE_STATE_VALUE;
+	parsestate->stack=parsestate->stack_static;
+	parsestate->stack_capacity=JSONPARSE_STATIC_FRAMES;
+}
+
+JSON_FDECLP void jsonparse_end(jsonparseinfo_arg parsestate)
+{
+	if (parsestate->stack!=parsestate->stack_static) JSON_free(parsestate->stack);
+}
+
+/**
+ * Run the parser over tokens from the lexer.  The state and the innermost
+ * frame are kept in locals and saved to parsestate when the parser stops.
+ * With partial, the input may continue past sourcelimit, so the parser
+ * stops at eof or at a token that runs into sourcelimit, leaving
+ * lexstate.source at its start.
+ */
+JSON_FDECLP jsonparse_status_t jsonparse_run(jsonparseinfo_arg parsestate, bool partial)
+{
+	jsonlex_state_t *lexstate=&parsestate->lexstate;
+	jsonparse_frame_t *frame=parsestate->depth ? &parsestate->stack[parsestate->depth-1] : 0;
+	jsonparse_state_t state=(jsonparse_state_t)parsestate->state;
+	jsonlex_token_t token;
+	#if JSONPARSE_PUSH
+	uint8_t *start;
+	#else
+	(void)partial;
+	#endif
+
+	for (;;) {
+		#if JSONPARSE_PUSH
+		start=lexstate->source;
+		token=jsonlex_next_token(lexstate);
+		if (partial) {
+			/* only whitespace remains */
+			if (token==jsonlex_eof) break;
+
+			/* strings end at their quote, other tokens at a character that
+			 * is not part of them */
+			if (lexstate->source==lexstate->sourcelimit && (token==jsonlex_illegal_string
+					|| token==jsonlex_identifier || token==jsonlex_integer || token==jsonlex_numeric)) {
+				lexstate->source=start;
+				break;
+			}
+		}
+		#else
+		token=jsonlex_next_token(lexstate);
+		#endif
+
+		switch (state) {
+		case JSONPARSE_STATE_OBJECT_FIRST:
+			if (token==jsonlex_rbrace) {
+				/* end of object (will only hit this for empty object) */
+				#ifdef JSONPARSE_ACTION_OBJECT_END
+				JSONPARSE_ACTION_OBJECT_END();
+				#endif
+				goto close;
+			}
+			/* fall through */
+		case JSONPARSE_STATE_LABEL:
+			/* treat either a string or identifier as a field label */
+			if (token!=jsonlex_identifier && token!=jsonlex_string) {
+				#ifdef JSONPARSE_ACTION_ERROR
+				JSONPARSE_ACTION_ERROR("Expected object element", token);
+				#endif
+				return JSONPARSE_ERROR;
+			}
+			#ifdef JSONPARSE_ACTION_OBJECT_LABEL
+			JSONPARSE_ACTION_OBJECT_LABEL(frame->index, parsestate->lexstate.token, parsestate->lexstate.token_len);
+			#endif
+			state=JSONPARSE_STATE_COLON;
+			continue;
+
+		case JSONPARSE_STATE_COLON:
+			if (token!=jsonlex_colon) {
+				#ifdef JSONPARSE_ACTION_ERROR
+				JSONPARSE_ACTION_ERROR("Expected colon", token);
+				#endif
+				return JSONPARSE_ERROR;
+			}
+			state=JSONPARSE_STATE_VALUE;
+			continue;
+
+		case JSONPARSE_STATE_ARRAY_FIRST:
+			if (token==jsonlex_rbracket) {
+				#ifdef JSONPARSE_ACTION_ARRAY_END
+				JSONPARSE_ACTION_ARRAY_END();
+				#endif
+				goto close;
+			}
+			#ifdef JSONPARSE_ACTION_ARRAY_ELEMENT
+			JSONPARSE_ACTION_ARRAY_ELEMENT(0);
+			#endif
+			/* fall through */
+		case JSONPARSE_STATE_VALUE:
+			if (token!=jsonlex_lbrace && token!=jsonlex_lbracket) {
+				if (!jsonparse_scalar(parsestate, token)) return JSONPARSE_ERROR;
+				break;
+			}
+
+			/* push a frame for the container */
+			if (parsestate->depth==JSONPARSE_MAX_DEPTH) {
+				JSONPARSE_DEPTH_ERROR(token);
+				return JSONPARSE_ERROR;
+			}
+			if (parsestate->depth==parsestate->stack_capacity) {
+				parsestate->stack_capacity*=2;
+				if (parsestate->stack==parsestate->stack_static) {
+					parsestate->stack=(jsonparse_frame_t*)JSON_malloc(sizeof(jsonparse_frame_t) * parsestate->stack_capacity);
+					memcpy(parsestate->stack, parsestate->stack_static, sizeof(parsestate->stack_static));
+				} else {
+					parsestate->stack=(jsonparse_frame_t*)JSON_realloc(parsestate->stack, sizeof(jsonparse_frame_t) * parsestate->stack_capacity);
+				}
+			}
+			frame=&parsestate->stack[parsestate->depth++];
+			frame->kind=token;
+			frame->index=0;
+
+			if (token==jsonlex_lbrace) {
+				#ifdef JSONPARSE_ACTION_OBJECT_START
+				JSONPARSE_ACTION_OBJECT_START();
+				#endif
+				state=JSONPARSE_STATE_OBJECT_FIRST;
+			} else {
+				#ifdef JSONPARSE_ACTION_ARRAY_START
+				JSONPARSE_ACTION_ARRAY_START();
+				#endif
+				state=JSONPARSE_STATE_ARRAY_FIRST;
+			}
+			continue;
+
+		case JSONPARSE_STATE_AFTER_VALUE:
+			/* either a comma (continue) or the end of the container */
+			if (frame->kind==jsonlex_lbrace) {
+				if (token==jsonlex_comma) {
+					frame->index++;
+					state=JSONPARSE_STATE_LABEL;
+					continue;
+				} else if (token==jsonlex_rbrace) {
+					#ifdef JSONPARSE_ACTION_OBJECT_END
+					JSONPARSE_ACTION_OBJECT_END();
+					#endif
+					goto close;
+				}
+				#ifdef JSONPARSE_ACTION_ERROR
+				JSONPARSE_ACTION_ERROR("Expected next object field or end of object", token);
+				#endif
+				return JSONPARSE_ERROR;
+			}
+
+			if (token==jsonlex_comma) {
+				frame->index++;
+				#ifdef JSONPARSE_ACTION_ARRAY_ELEMENT
+				JSONPARSE_ACTION_ARRAY_ELEMENT(frame->index);
+				#endif
+				state=JSONPARSE_STATE_VALUE;
+				continue;
+			} else if (token==jsonlex_rbracket) {
+				#ifdef JSONPARSE_ACTION_ARRAY_END
+				JSONPARSE_ACTION_ARRAY_END();
+				#endif
+				goto close;
+			}
+			#ifdef JSONPARSE_ACTION_ERROR
+			JSONPARSE_ACTION_ERROR("Expected end of array of additional element", token);
+			#endif
+			return JSONPARSE_ERROR;
+
+		case JSONPARSE_STATE_END:
+			if (token!=jsonlex_eof) {
+				/* expected end of file */
+				#ifdef JSONPARSE_ACTION_ERROR
+				JSONPARSE_ACTION_ERROR("Expected end of file", token);
+				#endif
+				return JSONPARSE_ERROR;
+			}
+			return JSONPARSE_DONE;
+		}
+
+		/* a scalar value is complete */
+		state=parsestate->depth ? JSONPARSE_STATE_AFTER_VALUE : JSONPARSE_STATE_END;
+		continue;
+
+	close:
+		/* the innermost container is complete: pop its frame */
+		parsestate->depth--;
+		frame=parsestate->depth ? &parsestate->stack[parsestate->depth-1] : 0;
+		state=parsestate->depth ? JSONPARSE_STATE_AFTER_VALUE : JSONPARSE_STATE_END;
+	}
+
+	/* more input is needed */
+	parsestate->state=state;
+	return JSONPARSE_CONTINUE;
+}
+
+/**
+ * Parse a JSON text stream, returning true if it is valid, false otherwise.
+ * Actions are invoked by expanding JSONPARSE_ACTION_* macros as items are
+ * encountered.  Note that the corresponding action may be invoked prior
+ * to completely validating, so if this method returns false, any mutations
+ * made by JSONPARSE_ACTION_* should be discarded.
+ */
+JSON_FDECLP bool jsonparse(jsonparseinfo_arg parsestate)
+{
+	jsonparse_status_t status;
+
+	jsonparse_begin(parsestate);
+	status=jsonparse_run(parsestate, false);
+	jsonparse_end(parsestate);
+
+	return status==JSONPARSE_DONE;
+}
+
+#if JSONPARSE_PUSH
+/**
+ * Smallest number of bytes of a chunk appended to a split token at a time
+ */
+#define JSONPARSE_PUSH_STEP 64
+
+/**
+ * Start parsing input that will be handed over in chunks with
+ * jsonparse_push.  The lexer must not have been initialized.
+ */
+JSON_FDECLP void jsonparse_push_begin(jsonparseinfo_arg parsestate)
+{
+	dynbuffer_t carry=dynbuffer_init();
+
+	/* the source is set for each chunk, and too short to be indexed */
+	jsonlex_init_io(&parsestate->lexstate, 0, 0);
+	jsonparse_begin(parsestate);
+	parsestate->carry=carry;
+}
+
+JSON_FDECLP void jsonparse_push_end(jsonparseinfo_arg parsestate)
+{
+	jsonparse_end(parsestate);
+	jsonlex_destroy(&parsestate->lexstate);
+	dynbuffer_destroy(&parsestate->carry);
+}
+
+/**
+ * Parse the tokens of source up to limit.  Unless final, a token that runs
+ * into limit may continue in the next chunk, so parsing stops at its start
+ * and leaves lexstate.source there.
+ */
+JSON_FDECLP jsonparse_status_t jsonparse_push_tokens(jsonparseinfo_arg parsestate, uint8_t *source, uint8_t *limit, bool final)
+{
+	parsestate->lexstate.source=source;
+	parsestate->lexstate.sourcelimit=limit;
+	return jsonparse_run(parsestate, !final);
+}
+
+/**
+ * Parse the next chunk of input.  Set final with the last chunk (which
+ * may be empty).  Only a token split between two chunks is copied, so
+ * memory use does not depend on the size of the input.
+ * @return JSONPARSE_CONTINUE until the final chunk, then JSONPARSE_DONE,
+ * or JSONPARSE_ERROR as soon as the input is known to be invalid
+ */
+JSON_FDECLP jsonparse_status_t jsonparse_push(jsonparseinfo_arg parsestate, uint8_t *chunk, size_t len, bool final)
+{
+	dynbuffer_t *carry=&parsestate->carry;
+	jsonparse_status_t status;
+	size_t take, remaining;
+
+	/* finish the split token, appending the chunk to it a growing piece at
+	 * a time until the token ends within the piece */
+	while (carry->pos) {
+		if (!len && !final) return JSONPARSE_CONTINUE;
+
+		take=carry->pos>JSONPARSE_PUSH_STEP ? carry->pos : JSONPARSE_PUSH_STEP;
+		if (take>len) take=len;
+		/* the final chunk may be empty, even NULL */
+		if (take) {
+			dynbuffer_append(carry, chunk, take);
+			chunk+=take;
+			len-=take;
+		}
+
+		status=jsonparse_push_tokens(parsestate, carry->contents, carry->contents+carry->pos, final && !len);
+		if (status!=JSONPARSE_CONTINUE) return status;
+
+		remaining=parsestate->lexstate.sourcelimit - parsestate->lexstate.source;
+		if (remaining<take) {
+			/* what is left came from the chunk: carry on from there */
+			chunk-=remaining;
+			len+=remaining;
+			carry->pos=0;
+		} else {
+			memmove(carry->contents, parsestate->lexstate.source, remaining);
+			carry->pos=remaining;
+		}
+	}
+
+	status=jsonparse_push_tokens(parsestate, chunk, chunk+len, final);
+	if (status!=JSONPARSE_CONTINUE) return status;
+
+	/* keep the start of a token running into the end of the chunk */
+	remaining=parsestate->lexstate.sourcelimit - parsestate->lexstate.source;
+	if (remaining) dynbuffer_append(carry, parsestate->lexstate.source, remaining);
+	return JSONPARSE_CONTINUE;
+}
+#endif
+#endif
@@ -0,0 +1,32 @@
+/**
+ * jsonpath.h
+ * Parsed form of the paths accepted by json_path_get, json_project and
+ * json_text_extract.
+ */
+#ifndef __JSONPATH_H__
+#define __JSONPATH_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+	PATH_STEP_LABEL,
+	PATH_STEP_INDEX,
+	PATH_STEP_WILDCARD
+} path_step_kind_t;
+
+typedef struct {
+	path_step_kind_t kind;
+	const uint8_t *label;	/* points into the path */
+	size_t labellen;
+	uint32_t index;
+} path_step_t;
+
+/**
+ * Split path into steps.  steps must have room for pathlen+1 entries.
+ * *outwildcard is set if any step is [*].
+ * @return false on a syntax error
+ */
+bool json_path_parse(const uint8_t *path, size_t pathlen, path_step_t *steps, int *outnsteps, bool *outwildcard);
+
+#endif
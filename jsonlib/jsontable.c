@@ -0,0 +1,315 @@
+#include "jsontable.h"
+
+/* the binary value written for a row whose value is null */
+static uint8_t TABLE_NULL_VALUE[2]={ JSONBINARY_SS_PREFIX, JSONBINARY_SS_DATA_NULL };
+
+/* position of one object member found while checking the shape */
+typedef struct {
+	uint8_t *value;		/* NULL if the row does not have the key */
+	uint32_t valuelen;
+} table_cell_t;
+
+typedef struct {
+	uint8_t *label;
+	size_t labellen;	/* including the terminator */
+	size_t datasize;	/* total bytes of present non null values */
+} table_colinfo_t;
+
+static bool label_equals(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen)
+{
+	return alen==blen && memcmp(a, b, alen)==0;
+}
+
+/**
+ * Walk the members of count objects between source and sourcelimit.  The
+ * first pass (cells NULL) builds the column list: keys are matched in
+ * column order and a key not seen before becomes a new last column.  The
+ * second pass records where each row's values are.
+ * @return false if the objects are not all objects or a key appears out of
+ * column order
+ */
+static bool walk_rows(uint8_t *source, uint8_t *sourcelimit, uint32_t count, table_colinfo_t **cols, uint32_t *colcount, uint32_t *colcapacity, table_cell_t *cells)
+{
+	uint32_t row, col, nextcol;
+	uint8_t typecode;
+	uint8_t *data, *datalimit, *label, *value;
+	uint32_t datalen, valuelen;
+	size_t labellen;
+
+	for (row=0; row<count; row++) {
+		if (!jsonbinary_extract_type_length(source, sourcelimit, &typecode, &data, &datalen)
+				|| typecode!=JSONBINARY_TYPE_OBJECT) return false;
+		source=data+datalen;
+		datalimit=source;
+
+		nextcol=0;
+		while (data<datalimit) {
+			label=data;
+			while (data<datalimit && *data) data++;
+			if (data>=datalimit) return false;
+			data++;
+			labellen=data-label;
+
+			value=data;
+			if (!jsonbinary_extract_type_length(value, datalimit, &typecode, &data, &valuelen)) return false;
+			data+=valuelen;
+
+			for (col=nextcol; col<*colcount; col++) {
+				if (label_equals((*cols)[col].label, (*cols)[col].labellen, label, labellen)) break;
+			}
+
+			if (cells) {
+				cells[row*(*colcount)+col].value=value;
+				cells[row*(*colcount)+col].valuelen=data-value;
+			} else if (col==*colcount) {
+				/* a key that is out of order or duplicated cannot be represented */
+				for (col=0; col<nextcol; col++) {
+					if (label_equals((*cols)[col].label, (*cols)[col].labellen, label, labellen)) return false;
+				}
+				if (*colcount==*colcapacity) {
+					*colcapacity=*colcapacity ? *colcapacity*2 : 8;
+					*cols=(table_colinfo_t*)(*cols ? JSON_realloc(*cols, sizeof(table_colinfo_t) * *colcapacity) : JSON_malloc(sizeof(table_colinfo_t) * *colcapacity));
+				}
+				col=*colcount;
+				(*cols)[col].label=label;
+				(*cols)[col].labellen=labellen;
+				(*cols)[col].datasize=0;
+				(*colcount)++;
+			}
+			nextcol=col+1;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Determine the columns of the objects between source and sourcelimit and
+ * the cells of every row.
+ * @return false if the objects do not share a shape
+ */
+static bool collect_shape(uint8_t *source, uint8_t *sourcelimit, uint32_t count, table_colinfo_t **outcols, uint32_t *outcolcount, table_cell_t **outcells)
+{
+	table_colinfo_t *cols=0;
+	table_cell_t *cells;
+	uint32_t colcount=0, colcapacity=0;
+
+	if (!walk_rows(source, sourcelimit, count, &cols, &colcount, &colcapacity, 0) || !colcount) {
+		/* empty objects gain nothing */
+		if (cols) JSON_free(cols);
+		return false;
+	}
+
+	cells=(table_cell_t*)JSON_malloc(sizeof(table_cell_t) * count * colcount);
+	memset(cells, 0, sizeof(table_cell_t) * count * colcount);
+	walk_rows(source, sourcelimit, count, &cols, &colcount, &colcapacity, cells);
+
+	*outcols=cols;
+	*outcolcount=colcount;
+	*outcells=cells;
+	return true;
+}
+
+void jsontable_finalize_array(dynbuffer_t *dest, uint32_t startpos, uint32_t count)
+{
+	uint32_t datapos=startpos+1+JSONBINARY_RESERVE_LENGTH;
+	uint8_t *source=dest->contents+datapos;
+	uint8_t *sourcelimit=dest->contents+dest->pos;
+	size_t textsize=sourcelimit-source;
+	table_colinfo_t *cols;
+	table_cell_t *cells, *cell;
+	uint32_t colcount, row, col, bitmapsize, columnsize;
+	dynbuffer_t table=dynbuffer_init();
+	size_t tablesize;
+	size_t nullsize=sizeof(TABLE_NULL_VALUE);
+	uint8_t *present, *nulls;
+
+	if (count<2 || !collect_shape(source, sourcelimit, count, &cols, &colcount, &cells)) {
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		return;
+	}
+
+	/* size the table before committing to it */
+	bitmapsize=(count+7)/8;
+	tablesize=1+10;
+	for (col=0; col<colcount; col++) {
+		tablesize+=cols[col].labellen + 5 + 2*bitmapsize;
+		for (row=0; row<count; row++) {
+			cell=&cells[row*colcount+col];
+			if (cell->value && !(cell->valuelen==nullsize && memcmp(cell->value, TABLE_NULL_VALUE, nullsize)==0))
+				cols[col].datasize+=cell->valuelen;
+		}
+		tablesize+=cols[col].datasize;
+	}
+
+	if (tablesize>=textsize) {
+		JSON_free(cols);
+		JSON_free(cells);
+		jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+		return;
+	}
+
+	/* write the table into a scratch buffer, since it overlays the source */
+	dynbuffer_ensure(&table, tablesize);
+	dynbuffer_append_byte(&table, JSONBINARY_EXT_TABLE);
+	jsonbinary_write_varint(&table, count);
+	jsonbinary_write_varint(&table, colcount);
+	for (col=0; col<colcount; col++) {
+		dynbuffer_append(&table, cols[col].label, cols[col].labellen);
+	}
+
+	for (col=0; col<colcount; col++) {
+		columnsize=2*bitmapsize + cols[col].datasize;
+		jsonbinary_write_varint(&table, columnsize);
+
+		dynbuffer_ensure_delta(&table, columnsize);
+		present=table.contents+table.pos;
+		nulls=present+bitmapsize;
+		memset(present, 0, 2*bitmapsize);
+		table.pos+=2*bitmapsize;
+
+		for (row=0; row<count; row++) {
+			cell=&cells[row*colcount+col];
+			if (!cell->value) continue;
+
+			present[row>>3]|=1<<(row&7);
+			if (cell->valuelen==nullsize && memcmp(cell->value, TABLE_NULL_VALUE, nullsize)==0) {
+				nulls[row>>3]|=1<<(row&7);
+			} else {
+				/* room was ensured for the whole column */
+				memcpy(table.contents+table.pos, cell->value, cell->valuelen);
+				table.pos+=cell->valuelen;
+			}
+		}
+	}
+
+	JSON_free(cols);
+	JSON_free(cells);
+
+	/* replace the elements with the table */
+	dest->pos=datapos;
+	dynbuffer_append(dest, table.contents, table.pos);
+	dynbuffer_destroy(&table);
+
+	jsonbinary_finalize_container(dest, JSONBINARY_TYPE_EXTENDED, startpos);
+}
+
+bool jsontable_open(uint8_t *data, uint32_t len, jsontable_t *table)
+{
+	uint8_t *limit=data+len;
+	uint8_t *p=data;
+	uint32_t col;
+
+	if (p>=limit || *(p++)!=JSONBINARY_EXT_TABLE) return false;
+	if (!jsonbinary_read_varint(&p, limit, &table->rows)) return false;
+	if (!jsonbinary_read_varint(&p, limit, &table->cols)) return false;
+
+	table->labels=p;
+	for (col=0; col<table->cols; col++) {
+		while (p<limit && *p) p++;
+		if (p>=limit) return false;
+		p++;
+	}
+	table->columns=p;
+	table->limit=limit;
+	return true;
+}
+
+bool jsontable_read_column(jsontable_t *table, uint8_t **cursor, uint8_t **labelcursor, jsontable_column_t *column)
+{
+	uint8_t *p=*cursor;
+	uint32_t columnsize;
+	uint32_t bitmapsize=(table->rows+7)/8;
+
+	column->label=*labelcursor;
+	column->labellen=strlen((char*)column->label);
+	*labelcursor+=column->labellen+1;
+
+	if (!jsonbinary_read_varint(&p, table->limit, &columnsize)) return false;
+	if (columnsize>(uint32_t)(table->limit-p) || columnsize<2*bitmapsize) return false;
+
+	column->present=p;
+	column->nulls=p+bitmapsize;
+	column->values=p+2*bitmapsize;
+	column->limit=p+columnsize;
+	column->cursor=column->values;
+
+	*cursor=column->limit;
+	return true;
+}
+
+bool jsontable_find_column(jsontable_t *table, const uint8_t *label, size_t labellen, jsontable_column_t *column, bool *found)
+{
+	uint8_t *cursor=table->columns;
+	uint8_t *labelcursor=table->labels;
+	uint32_t col;
+
+	*found=false;
+	for (col=0; col<table->cols; col++) {
+		if (!jsontable_read_column(table, &cursor, &labelcursor, column)) return false;
+		if (label_equals(column->label, column->labellen, label, labellen)) {
+			*found=true;
+			break;
+		}
+	}
+	return true;
+}
+
+bool jsontable_cell(jsontable_column_t *column, uint32_t row, uint8_t **outvalue, uint32_t *outvaluelen)
+{
+	uint8_t typecode;
+	uint8_t *data;
+	uint32_t datalen;
+
+	if (!JSONTABLE_BIT(column->present, row)) {
+		*outvalue=0;
+		return true;
+	}
+
+	if (JSONTABLE_BIT(column->nulls, row)) {
+		*outvalue=TABLE_NULL_VALUE;
+		*outvaluelen=sizeof(TABLE_NULL_VALUE);
+		return true;
+	}
+
+	if (!jsonbinary_extract_type_length(column->cursor, column->limit, &typecode, &data, &datalen)) return false;
+	*outvalue=column->cursor;
+	*outvaluelen=(data+datalen) - column->cursor;
+	column->cursor=data+datalen;
+	return true;
+}
+
+bool jsontable_cell_at(jsontable_column_t *column, uint32_t row, uint8_t **outvalue, uint32_t *outvaluelen)
+{
+	uint32_t r;
+
+	column->cursor=column->values;
+	for (r=0; r<row; r++) {
+		if (!jsontable_cell(column, r, outvalue, outvaluelen)) return false;
+	}
+	return jsontable_cell(column, row, outvalue, outvaluelen);
+}
+
+bool jsontable_write_row(jsontable_t *table, uint32_t row, dynbuffer_t *dest)
+{
+	jsontable_column_t column;
+	uint8_t *cursor=table->columns;
+	uint8_t *labelcursor=table->labels;
+	uint8_t *value;
+	uint32_t valuelen;
+	uint32_t col, startpos;
+
+	if (row>=table->rows) return false;
+
+	startpos=jsonbinary_begin_container(dest);
+	for (col=0; col<table->cols; col++) {
+		if (!jsontable_read_column(table, &cursor, &labelcursor, &column)) return false;
+		if (!jsontable_cell_at(&column, row, &value, &valuelen)) return false;
+		if (!value) continue;
+
+		dynbuffer_append(dest, column.label, column.labellen+1);
+		dynbuffer_append(dest, value, valuelen);
+	}
+	jsonbinary_finalize_container(dest, JSONBINARY_TYPE_OBJECT, startpos);
+	return true;
+}
@@ -0,0 +1,78 @@
+/**
+ * jsontable.h
+ * Column oriented encoding for arrays of same-shaped objects
+ * (JSONBINARY_EXT_TABLE).  See jsonbinaryconst.h for the layout.
+ */
+#ifndef __JSONTABLE_H__
+#define __JSONTABLE_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include "dynbuffer.h"
+#include "jsonbinary.h"
+
+typedef struct {
+	uint32_t rows;
+	uint32_t cols;
+	uint8_t *labels;	/* the first of cols zero terminated labels */
+	uint8_t *columns;	/* the first column */
+	uint8_t *limit;
+} jsontable_t;
+
+typedef struct {
+	uint8_t *label;
+	size_t labellen;	/* excluding the terminator */
+	uint8_t *present;
+	uint8_t *nulls;
+	uint8_t *values;	/* first value of the column */
+	uint8_t *limit;		/* end of the column */
+	uint8_t *cursor;	/* next value, advanced by jsontable_cell */
+} jsontable_column_t;
+
+#define JSONTABLE_BIT(bitmap, row) (((bitmap)[(row)>>3]>>((row)&7)) & 1)
+
+/**
+ * Finalize an array whose count elements were all objects, as with
+ * jsonbinary_finalize_container.  If the objects share one key order (each
+ * object's keys appear in the order they were first seen, with no
+ * duplicates) and the table form is smaller, the array is rewritten as a
+ * table.
+ */
+void jsontable_finalize_array(dynbuffer_t *dest, uint32_t startpos, uint32_t count);
+
+/**
+ * Open the data of a JSONBINARY_TYPE_EXTENDED value as a table
+ * @return false if it is not a valid table header
+ */
+bool jsontable_open(uint8_t *data, uint32_t len, jsontable_t *table);
+
+/**
+ * Read the column at *cursor and advance *cursor and *labelcursor to the
+ * next one.  Both cursors start at table->columns and table->labels.
+ */
+bool jsontable_read_column(jsontable_t *table, uint8_t **cursor, uint8_t **labelcursor, jsontable_column_t *column);
+
+/**
+ * Find the column with the given label.  *found is false if there is none.
+ * Only the column headers are read, never the values of other columns.
+ */
+bool jsontable_find_column(jsontable_t *table, const uint8_t *label, size_t labellen, jsontable_column_t *column, bool *found);
+
+/**
+ * Get the value (type, length and data) of row in column.  Rows must be
+ * requested in increasing order after reading the column.  *outvalue is
+ * set to NULL if the row does not have the key.
+ * @return false on corrupt data
+ */
+bool jsontable_cell(jsontable_column_t *column, uint32_t row, uint8_t **outvalue, uint32_t *outvaluelen);
+
+/**
+ * As jsontable_cell, but for any row, by skipping the values before it.
+ */
+bool jsontable_cell_at(jsontable_column_t *column, uint32_t row, uint8_t **outvalue, uint32_t *outvaluelen);
+
+/**
+ * Append row as a regular binary object
+ */
+bool jsontable_write_row(jsontable_t *table, uint32_t row, dynbuffer_t *dest);
+
+#endif
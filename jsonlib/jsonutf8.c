@@ -0,0 +1,230 @@
+#include <string.h>
+#include "jsonutf8.h"
+
+/* without -mavx2 or -mssse3, x86 compilers that can target a single
+ * function still get the AVX2 version, used if the cpu has it */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define UTF8_SIMD 1
+#define UTF8_TARGET
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define UTF8_SIMD 1
+#define UTF8_TARGET
+#elif (defined(__x86_64__) || defined(__i386__)) && (__GNUC__>=5 || defined(__clang__))
+#include <immintrin.h>
+#define UTF8_SIMD 1
+#define UTF8_DISPATCH 1
+#define UTF8_TARGET __attribute__((target("avx2")))
+#endif
+
+/**
+ * Check s..limit a sequence at a time, and ASCII a word at a time.
+ */
+static bool valid_scalar(const uint8_t *s, const uint8_t *limit)
+{
+	uint64_t word;
+	uint8_t c;
+
+	while (s<limit) {
+		if (limit-s>=8) {
+			memcpy(&word, s, 8);
+			if (!(word & 0x8080808080808080ULL)) {
+				s+=8;
+				continue;
+			}
+		}
+
+		c=*s;
+		if (c<0x80) {
+			s++;
+		} else if (c<0xc2) {
+			/* continuation byte, or overlong two byte form */
+			return false;
+		} else if (c<0xe0) {
+			if (limit-s<2 || (s[1]&0xc0)!=0x80) return false;
+			s+=2;
+		} else if (c<0xf0) {
+			if (limit-s<3 || (s[1]&0xc0)!=0x80 || (s[2]&0xc0)!=0x80) return false;
+			if (c==0xe0 && s[1]<0xa0) return false;		/* overlong */
+			if (c==0xed && s[1]>=0xa0) return false;	/* surrogate */
+			s+=3;
+		} else if (c<0xf5) {
+			if (limit-s<4 || (s[1]&0xc0)!=0x80 || (s[2]&0xc0)!=0x80 || (s[3]&0xc0)!=0x80) return false;
+			if (c==0xf0 && s[1]<0x90) return false;		/* overlong */
+			if (c==0xf4 && s[1]>=0x90) return false;	/* above U+10FFFF */
+			s+=4;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+#ifdef UTF8_SIMD
+
+#if defined(__AVX2__) || defined(UTF8_DISPATCH)
+typedef __m256i vec_t;
+#define VEC_SIZE 32
+#define VEC_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define VEC_TABLE(t) _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(t)))
+#define VEC_SET1(c) _mm256_set1_epi8((char)(c))
+#define VEC_ZERO() _mm256_setzero_si256()
+#define VEC_AND(a, b) _mm256_and_si256(a, b)
+#define VEC_OR(a, b) _mm256_or_si256(a, b)
+#define VEC_XOR(a, b) _mm256_xor_si256(a, b)
+#define VEC_SUBS(a, b) _mm256_subs_epu8(a, b)
+#define VEC_LOOKUP(t, x) _mm256_shuffle_epi8(t, x)
+#define VEC_HIGH_NIBBLE(x) _mm256_and_si256(_mm256_srli_epi16(x, 4), VEC_SET1(0x0f))
+/* x shifted up by n bytes, with the top of prev shifted in */
+#define VEC_PREV(x, prev, n) _mm256_alignr_epi8(x, _mm256_permute2x128_si256(prev, x, 0x21), 16-(n))
+#define VEC_ASCII(x) (_mm256_movemask_epi8(x)==0)
+#define VEC_IS_ZERO(x) _mm256_testz_si256(x, x)
+#else
+typedef __m128i vec_t;
+#define VEC_SIZE 16
+#define VEC_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define VEC_TABLE(t) _mm_loadu_si128((const __m128i*)(t))
+#define VEC_SET1(c) _mm_set1_epi8((char)(c))
+#define VEC_ZERO() _mm_setzero_si128()
+#define VEC_AND(a, b) _mm_and_si128(a, b)
+#define VEC_OR(a, b) _mm_or_si128(a, b)
+#define VEC_XOR(a, b) _mm_xor_si128(a, b)
+#define VEC_SUBS(a, b) _mm_subs_epu8(a, b)
+#define VEC_LOOKUP(t, x) _mm_shuffle_epi8(t, x)
+#define VEC_HIGH_NIBBLE(x) _mm_and_si128(_mm_srli_epi16(x, 4), VEC_SET1(0x0f))
+#define VEC_PREV(x, prev, n) _mm_alignr_epi8(x, prev, 16-(n))
+#define VEC_ASCII(x) (_mm_movemask_epi8(x)==0)
+#define VEC_IS_ZERO(x) (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128()))==0xffff)
+#endif
+
+/* errors seen in a pair of bytes, each flagged by all three lookups */
+#define TOO_SHORT	0x01	/* lead byte not followed by a continuation */
+#define TOO_LONG	0x02	/* continuation after ASCII */
+#define OVERLONG_3	0x04	/* e0 80-9f */
+#define TOO_LARGE	0x08	/* f4 90-bf, f5-ff 90-bf */
+#define SURROGATE	0x10	/* ed a0-bf */
+#define OVERLONG_2	0x20	/* c0-c1 any */
+#define TOO_LARGE_1000	0x40	/* f5-ff 80-8f */
+#define OVERLONG_4	0x40	/* f0 80-8f */
+#define TWO_CONTS	0x80	/* continuation after continuation */
+/* errors that depend only on the high nibble of the first byte */
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* indexed by the high nibble of the first byte */
+static const uint8_t byte_1_high[16]={
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/* indexed by the low nibble of the first byte */
+static const uint8_t byte_1_low[16]={
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/* indexed by the high nibble of the second byte */
+static const uint8_t byte_2_high[16]={
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+UTF8_TARGET static bool valid_simd(const uint8_t *s, size_t len)
+{
+	vec_t table1=VEC_TABLE(byte_1_high);
+	vec_t table2=VEC_TABLE(byte_1_low);
+	vec_t table3=VEC_TABLE(byte_2_high);
+	vec_t lownibble=VEC_SET1(0x0f);
+	vec_t maxvalue, input, prev, prev1, special, must23;
+	vec_t error=VEC_ZERO();
+	vec_t incomplete=VEC_ZERO();
+	uint8_t bytes[VEC_SIZE];
+	size_t pos=0;
+	bool last=false;
+
+	/* a block ending in a lead byte with too few bytes after it for its
+	 * sequence has bytes above these */
+	memset(bytes, 0xff, VEC_SIZE);
+	bytes[VEC_SIZE-3]=0xf0-1;
+	bytes[VEC_SIZE-2]=0xe0-1;
+	bytes[VEC_SIZE-1]=0xc0-1;
+	maxvalue=VEC_LOAD(bytes);
+
+	prev=VEC_ZERO();
+	while (!last) {
+		if (len-pos>=VEC_SIZE) {
+			input=VEC_LOAD(s+pos);
+			pos+=VEC_SIZE;
+		} else {
+			/* pad the last block with ASCII, which also ends any sequence
+			 * still open at the end */
+			memset(bytes, 0, VEC_SIZE);
+			memcpy(bytes, s+pos, len-pos);
+			input=VEC_LOAD(bytes);
+			last=true;
+		}
+
+		if (VEC_ASCII(input)) {
+			error=VEC_OR(error, incomplete);
+			incomplete=VEC_ZERO();
+			prev=input;
+			continue;
+		}
+
+		prev1=VEC_PREV(input, prev, 1);
+		special=VEC_AND(VEC_AND(
+				VEC_LOOKUP(table1, VEC_HIGH_NIBBLE(prev1)),
+				VEC_LOOKUP(table2, VEC_AND(prev1, lownibble))),
+				VEC_LOOKUP(table3, VEC_HIGH_NIBBLE(input)));
+
+		/* the third byte of a sequence follows 111xxxxx by two and the
+		 * fourth 1111xxxx by three; these must be continuations, which the
+		 * lookups flag as TWO_CONTS */
+		must23=VEC_OR(
+				VEC_SUBS(VEC_PREV(input, prev, 2), VEC_SET1(0xe0-0x80)),
+				VEC_SUBS(VEC_PREV(input, prev, 3), VEC_SET1(0xf0-0x80)));
+		must23=VEC_AND(must23, VEC_SET1(0x80));
+		error=VEC_OR(error, VEC_XOR(must23, special));
+
+		incomplete=VEC_SUBS(input, maxvalue);
+		prev=input;
+	}
+
+	error=VEC_OR(error, incomplete);
+	return VEC_IS_ZERO(error);
+}
+#endif
+
+bool jsonutf8_valid(const uint8_t *s, size_t len)
+{
+	#if defined(UTF8_DISPATCH)
+	if (len>=VEC_SIZE && __builtin_cpu_supports("avx2")) return valid_simd(s, len);
+	#elif defined(UTF8_SIMD)
+	if (len>=VEC_SIZE) return valid_simd(s, len);
+	#endif
+	return valid_scalar(s, s+len);
+}
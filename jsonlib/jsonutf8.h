@@ -0,0 +1,27 @@
+/**
+ * jsonutf8.h
+ * UTF-8 validation of string contents.
+ *
+ * With AVX2 or SSSE3 the input is checked 32 or 16 bytes at a time with
+ * the lookup algorithm of Keiser and Lemire: three table lookups on the
+ * nibbles of each byte and the byte before it flag every error a two byte
+ * window can show (overlong forms, surrogates, code points above U+10FFFF,
+ * missing or stray continuation bytes), and comparisons on the bytes two
+ * and three back check the continuations of three and four byte sequences.
+ * Builds for x86 without either pick the AVX2 version at run time if the
+ * cpu has it.  Runs of ASCII are passed over a block (or a word) at a time
+ * either way.
+ */
+#ifndef __JSONUTF8_H__
+#define __JSONUTF8_H__
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Check that s holds only complete, shortest form UTF-8 sequences for
+ * code points other than surrogates, up to U+10FFFF.
+ */
+bool jsonutf8_valid(const uint8_t *s, size_t len);
+
+#endif
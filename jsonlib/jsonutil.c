@@ -1,4 +1,13 @@
+#include <string.h>
 #include "jsonutil.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+JSON_TLS int json_max_depth=JSON_DEFAULT_MAX_DEPTH;
+JSON_TLS bool json_ascii_output=true;
 
 /**
  * The escape table is a classification table for characters that controls
@@ -16,8 +25,8 @@
  */
 static const char JSON_ESCAPE_TABLE[256]={
 /*  00 - 1F */
-/*   0   1  2  3  4  5  6  7   8    9    A    B    C    D   E  F 10 11 12 13 14 15 16 17 18 19 1A 1B 1C 1D 1E 1F */
-	'0', 5, 5, 5, 5, 5, 5, 5, 'b', 't', 'n', 'v', 'f', 'r', 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+/*  0  1  2  3  4  5  6  7   8    9    A  B    C    D   E  F 10 11 12 13 14 15 16 17 18 19 1A 1B 1C 1D 1E 1F */
+	5, 5, 5, 5, 5, 5, 5, 5, 'b', 't', 'n', 5, 'f', 'r', 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
 /*  20 - 3F */
 /*  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F 10 11 12 13 14 15 16 17 18 19 1A 1B 1C 1D 1E 1F */
 	0, 0, 2, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -43,28 +52,132 @@ static const char JSON_ESCAPE_TABLE[256]={
 
 static const char *UTF8_INVALID="\\uFFFD";
 
+static const char HEX_DIGITS[16]="0123456789abcdef";
+
+/**
+ * Write the 6 byte escape \uXXXX for a UTF-16 code unit
+ */
+static inline void json_escape_unit(char *out, uint32_t unit)
+{
+	out[0]='\\';
+	out[1]='u';
+	out[2]=HEX_DIGITS[(unit>>12)&0xf];
+	out[3]=HEX_DIGITS[(unit>>8)&0xf];
+	out[4]=HEX_DIGITS[(unit>>4)&0xf];
+	out[5]=HEX_DIGITS[unit&0xf];
+}
+
+/**
+ * Find the first character from index that may need escaping: a control
+ * character, DEL, a backslash, quote_char, 0xc0 (which starts the c0 80
+ * that stands for a zero in labels) or, if ascii_only, any byte above 0x7f.
+ * Looks at a vector (or a word) at a time.
+ * @return its index, or len if there is none
+ */
+static inline size_t json_escape_scan(const uint8_t *source, size_t index, size_t len, bool ascii_only, uint8_t quote_char)
+{
+	#if defined(__AVX2__)
+	const __m256i quotes=_mm256_set1_epi8((char)quote_char);
+	const __m256i backslashes=_mm256_set1_epi8('\\');
+	const __m256i dels=_mm256_set1_epi8(0x7f);
+	const __m256i spaces=_mm256_set1_epi8(0x20);
+	const __m256i zeros=_mm256_set1_epi8((char)0xc0);
+	const __m256i high=_mm256_set1_epi8(ascii_only ? 0 : 0x80);
+	__m256i x;
+	uint32_t mask;
+
+	while (len-index>=32) {
+		x=_mm256_loadu_si256((const __m256i*)(source+index));
+		/* a signed compare takes bytes above 0x7f for negative, so one
+		 * compare finds them along with the control characters; high
+		 * clears them again if they are to pass */
+		mask=_mm256_movemask_epi8(_mm256_or_si256(
+				_mm256_or_si256(_mm256_andnot_si256(_mm256_and_si256(x, high), _mm256_cmpgt_epi8(spaces, x)), _mm256_cmpeq_epi8(x, dels)),
+				_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, quotes), _mm256_cmpeq_epi8(x, backslashes)), _mm256_cmpeq_epi8(x, zeros))));
+		if (mask) return index+__builtin_ctz(mask);
+		index+=32;
+	}
+	#elif defined(__SSE2__)
+	const __m128i quotes=_mm_set1_epi8((char)quote_char);
+	const __m128i backslashes=_mm_set1_epi8('\\');
+	const __m128i dels=_mm_set1_epi8(0x7f);
+	const __m128i spaces=_mm_set1_epi8(0x20);
+	const __m128i zeros=_mm_set1_epi8((char)0xc0);
+	const __m128i high=_mm_set1_epi8(ascii_only ? 0 : 0x80);
+	__m128i x;
+	uint32_t mask;
+
+	while (len-index>=16) {
+		x=_mm_loadu_si128((const __m128i*)(source+index));
+		/* a signed compare takes bytes above 0x7f for negative, so one
+		 * compare finds them along with the control characters; high
+		 * clears them again if they are to pass */
+		mask=_mm_movemask_epi8(_mm_or_si128(
+				_mm_or_si128(_mm_andnot_si128(_mm_and_si128(x, high), _mm_cmpgt_epi8(spaces, x)), _mm_cmpeq_epi8(x, dels)),
+				_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quotes), _mm_cmpeq_epi8(x, backslashes)), _mm_cmpeq_epi8(x, zeros))));
+		if (mask) return index+__builtin_ctz(mask);
+		index+=16;
+	}
+	#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	const uint64_t ones=0x0101010101010101ULL;
+	const uint64_t quotes=ones*quote_char;
+	const uint64_t backslashes=ones*'\\';
+	const uint64_t dels=ones*0x7f;
+	const uint64_t zeros=ones*0xc0;
+	const uint64_t high=ascii_only ? ones*0x80 : 0;
+	uint64_t word, special;
+
+	while (len-index>=8) {
+		/* the lowest high bit set marks the first byte that is zero after
+		 * the xor, below 0x20 or (if ascii_only) above 0x7f */
+		memcpy(&word, source+index, 8);
+		special=(((word^quotes)-ones) & ~(word^quotes))
+			| (((word^backslashes)-ones) & ~(word^backslashes))
+			| (((word^dels)-ones) & ~(word^dels))
+			| (((word^zeros)-ones) & ~(word^zeros))
+			| ((word-ones*0x20) & ~word)
+			| (word & high);
+		special&=ones*0x80;
+		if (special) return index+(__builtin_ctzll(special)>>3);
+		index+=8;
+	}
+	#endif
+
+	if (ascii_only) {
+		while (index<len && !JSON_ESCAPE_TABLE[source[index]]) index++;
+	} else {
+		while (index<len && (!JSON_ESCAPE_TABLE[source[index]] || (source[index]>=0x80 && source[index]!=0xc0))) index++;
+	}
+	return index;
+}
 
 bool json_escape_string(dynbuffer_t *dest, const uint8_t *source, size_t len, bool ascii_only, uint8_t quote_char)
 {
-	/* Instead of going char by char, we preseume that we are going to encounter
-	 * printing characters more than not and try to reserve a span of them to
-	 * write as a traunch, reducing the number of IO calls.
+	/* Characters that need no escaping are the common case, so runs of them
+	 * are found a vector at a time and written as a traunch, reducing the
+	 * number of IO calls.
 	 */
 	size_t mark=0, index=0;
 	uint8_t cur;
 	char type;
-	char replacement[10];
+	char replacement[12];
 	size_t replacement_count=0;
-	uint32_t utf8_1, utf8_2, utf8_3, utf8_4;
 	uint32_t codepoint;
 
-	for (; index<len; index++) {
+	for (;;) {
+		index=json_escape_scan(source, index, len, ascii_only, quote_char);
+		if (index>=len) break;
 		cur=source[index];
 		type=JSON_ESCAPE_TABLE[cur];
 
 		/* Is it literal printable */
-		if (type==0 || (type==2&&cur!=quote_char))
+		if (type==0 || (type==2&&cur!=quote_char)) {
+			index++;
 			continue;	/* Accumulate */
+		}
+
+		/* A short sequence at the end is written as it is with the tail */
+		if (type>=6 && type<=8 && len-index<(size_t)(type-4)) break;
 
 		/* Special char - dump what we have */
 		if (index>mark) dynbuffer_append(dest, source+mark, index-mark);
@@ -101,67 +214,33 @@ bool json_escape_string(dynbuffer_t *dest, const uint8_t *source, size_t len, bo
 				break;
 			case 5:
 				/* Numeric escape */
-				sprintf(replacement, "\\x%02x", cur);
-				replacement_count=4;
+				json_escape_unit(replacement, cur);
+				replacement_count=6;
 				break;
 			case 6:
-				/* UTF-8 2-byte */
+				/* UTF-8 2-byte.  Strings are checked for valid UTF-8 when
+				 * parsed, so sequences are decoded without checking them */
 				index++;
-				if (index>=len) continue;	/* Short sequence */
+				codepoint=((cur&0x1f)<<6) | (source[index]&0x3f);
+				json_escape_unit(replacement, codepoint);
 				replacement_count=6;
-				utf8_1=cur;
-				utf8_2=source[index];
-				if ((utf8_2>>6)!=2) {
-					/* Illegal */
-					strcpy(replacement, UTF8_INVALID);
-				} else {
-					/* Legal */
-					codepoint=((utf8_1&0x1f)<<5) | (utf8_2&0x3f);
-					sprintf(replacement, "\\u%04x", codepoint);
-				}
-
 				break;
 			case 7:
 				/* UTF-8 3 byte */
 				index+=2;
-				if (index>=len) continue; /* Short sequence */
+				codepoint=((cur&0xf)<<12) | ((source[index-1]&0x3f)<<6) | (source[index]&0x3f);
+				json_escape_unit(replacement, codepoint);
 				replacement_count=6;
-				utf8_1=cur;
-				utf8_2=source[index-1];
-				utf8_3=source[index];
-
-				if ((utf8_2>>6)!=2 || (utf8_3>>6)!=2) {
-					/* Illegal */
-					strcpy(replacement, UTF8_INVALID);
-				} else {
-					/* Legal */
-					codepoint=((utf8_1&0xf)<<12) | ((utf8_2&0x3f)<<6) | (utf8_3&0x3f);
-					sprintf(replacement, "\\u%04x", codepoint);
-				}
 				break;
 			case 8:
-				/* UTF-8 4 byte */
+				/* UTF-8 4 byte, escaped as a surrogate pair */
 				index+=3;
-				if (index>=len) continue; /* Short sequence */
-				replacement_count=6;
-				utf8_1=cur;
-				utf8_2=source[index-2];
-				utf8_3=source[index-1];
-				utf8_4=source[index];
-
-				if ((utf8_2>>6)!=2 || (utf8_3>>6)!=2 || (utf8_4>>6)!=2) {
-					/* Illegal */
-					strcpy(replacement, UTF8_INVALID);
-				} else {
-					/* Legal syntactically */
-					codepoint=((utf8_1&0x7)<<18) | ((utf8_2&0x3f)<<12) | ((utf8_3&0x3f)<<6) | (utf8_1&0x3f);
-					if (codepoint>0xffff) {
-						/* JavaScript only has escape for first ffff codepoints */
-						strcpy(replacement, UTF8_INVALID);
-					} else {
-						sprintf(replacement, "\\u%04x", codepoint);
-					}
-				}
+				codepoint=((cur&0x7)<<18) | ((source[index-2]&0x3f)<<12) | ((source[index-1]&0x3f)<<6) | (source[index]&0x3f);
+				codepoint-=0x10000;
+				json_escape_unit(replacement, 0xd800 | ((codepoint>>10)&0x3ff));
+				json_escape_unit(replacement+6, 0xdc00 | (codepoint&0x3ff));
+				replacement_count=12;
+				break;
 			}
 		}
 
@@ -169,13 +248,12 @@ bool json_escape_string(dynbuffer_t *dest, const uint8_t *source, size_t len, bo
 		dynbuffer_append(dest, replacement, replacement_count);
 
 		/* Advance the mark */
-		mark=index+1;
+		index++;
+		mark=index;
 	}
 
 	/* Write final tail */
-	if (len>mark) {
-		if (len>mark) dynbuffer_append(dest, source+mark, len-mark);
-	}
+	if (len>mark) dynbuffer_append(dest, source+mark, len-mark);
 
 	return true;
 }
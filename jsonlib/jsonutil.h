@@ -8,6 +8,47 @@
 #include <stdbool.h>
 #include "dynbuffer.h"
 
+/**
+ * The standalone library (built with JSON_THREADSAFE) keeps the settings
+ * below per thread, so that each call through jsonlib.h can set its own.
+ */
+#ifdef JSON_THREADSAFE
+#define JSON_TLS __thread
+#else
+#define JSON_TLS
+#endif
+
+/**
+ * Parsing json text fails on containers nested deeper than json_max_depth.
+ * pgjson sets it from the pgjson.max_depth setting.  Reading binary back
+ * (transcoding to text, path lookups, projection) recurses on each level,
+ * so json_max_depth must not be raised past JSON_MAX_DEPTH_LIMIT, which
+ * keeps that within about a megabyte of stack.
+ */
+#define JSON_DEFAULT_MAX_DEPTH 1000
+#define JSON_MAX_DEPTH_LIMIT 4000
+extern JSON_TLS int json_max_depth;
+
+/**
+ * Called on entry to the recursive readers.  In the server this raises
+ * the usual error past max_stack_depth.
+ */
+#ifdef JSON_USE_PALLOC
+#include <miscadmin.h>
+#define JSON_CHECK_STACK() check_stack_depth()
+#else
+#define JSON_CHECK_STACK()
+#endif
+
+/**
+ * Transcoding to json text escapes every character outside printable ascii
+ * as \uXXXX while json_ascii_output is true, the default.  Otherwise
+ * UTF-8 sequences are copied as they are and only quotes, backslashes and
+ * control characters are escaped, which is shorter and faster for non
+ * English text.  pgjson sets it from the pgjson.ascii_output setting.
+ */
+extern JSON_TLS bool json_ascii_output;
+
 /**
  * Escape a source buffer into a JSON string.
  * If ascii_only is true, then everything but printable ascii will be escaped (maximum
@@ -35,15 +76,179 @@ bool json_transcode_json_to_json(uint8_t *source, size_t sourcelen, dynbuffer_t
 bool json_transcode_json_to_binary(uint8_t *source, size_t sourcelen, dynbuffer_t *dest);
 
 /**
- * Transcode binary to text json into the dest buffer.
+ * Transcode json text that arrives in chunks, such as a file read a block
+ * at a time.  begin returns the transcoder state, push parses the next
+ * chunk, which may end anywhere (even within a token), and end finishes
+ * the input and frees the state.  Only a token split between chunks is
+ * kept from one push to the next.  push and end return false on a parse
+ * error, with the message in dest as for json_transcode_json_to_binary;
+ * end must still be called.
+ *
+ * The json text transcoder only appends to dest, so the caller may write
+ * out and clear dest after each push.  Binary containers are patched when
+ * they end, so dest holds the whole binary value until end.
+ */
+typedef struct json_to_binary_push json_to_binary_push_t;
+json_to_binary_push_t *json_transcode_json_to_binary_begin(dynbuffer_t *dest);
+bool json_transcode_json_to_binary_push(json_to_binary_push_t *push, uint8_t *chunk, size_t len);
+bool json_transcode_json_to_binary_end(json_to_binary_push_t *push);
+
+/**
+ * Element counts of an array, which decide how it is stored: packed if
+ * every element is a number, as a table if every element is an object.
+ */
+typedef struct {
+	uint32_t elements;
+	uint32_t numbers;
+	uint32_t integers;
+	uint32_t objects;
+} json_array_counts_t;
+
+/**
+ * Start transcoding one piece of a big array, pushed as an array of some
+ * of its elements.  That outermost array is written as a plain container
+ * and its counts are stored in outer_counts at its end, so that pieces can
+ * be joined: append the contents of each after jsonbinary_begin_container,
+ * add up the counts, and call json_transcode_json_to_binary_finalize_array.
+ */
+json_to_binary_push_t *json_transcode_json_to_binary_begin_segment(dynbuffer_t *dest, json_array_counts_t *outer_counts);
+void json_transcode_json_to_binary_finalize_array(dynbuffer_t *dest, uint32_t startpos, const json_array_counts_t *counts);
+
+/**
+ * Transcode a document whose top level value is an array using up to
+ * nthreads threads (standalone library only).  The text is split between
+ * top level elements, each piece is transcoded by a thread, and the pieces
+ * are joined into the same binary json_transcode_json_to_binary writes.
+ * Small documents, other top level values and anything the split cannot
+ * place with certainty (including every parse error, so that the message
+ * is the usual one) go through json_transcode_json_to_binary instead.
+ * @return true on success, false on error with the message in dest
+ */
+bool json_transcode_json_to_binary_parallel(uint8_t *source, size_t sourcelen, int nthreads, dynbuffer_t *dest);
+
+typedef struct json_to_json_push json_to_json_push_t;
+json_to_json_push_t *json_transcode_json_to_json_begin(dynbuffer_t *dest);
+bool json_transcode_json_to_json_push(json_to_json_push_t *push, uint8_t *chunk, size_t len);
+bool json_transcode_json_to_json_end(json_to_json_push_t *push);
+
+/**
+ * Transcode binary to text json into the dest buffer.  dest is grown
+ * up front to an estimate of the text's size, 5/4 of the binary, plus one
+ * byte for a terminator.
  * @return true on success, false on error
  */
 bool json_transcode_binary_to_json(uint8_t *source, size_t sourcelen, dynbuffer_t *dest);
 
+/**
+ * Transcode binary to text json a chunk at a time, for documents too big
+ * to hold as text.  begin returns the transcoder state and next appends
+ * the following chunk of text to dest: about chunk bytes, but strings may
+ * take it up to a few times that as they are escaped.  next sets *outdone
+ * after the last chunk.  end frees the state, at the end or at any point
+ * before.  source must stay in place until then.  The output mode
+ * (json_ascii_output) is read at begin.
+ * @return next returns false on corrupt data
+ */
+typedef struct json_from_binary_stream json_from_binary_stream_t;
+json_from_binary_stream_t *json_transcode_binary_to_json_begin(uint8_t *source, size_t sourcelen);
+bool json_transcode_binary_to_json_next(json_from_binary_stream_t *stream, dynbuffer_t *dest, size_t chunk, bool *outdone);
+void json_transcode_binary_to_json_end(json_from_binary_stream_t *stream);
+
 /**
  * Validate json
  * @return true if valid
  */
 bool json_validate_json(uint8_t *source, size_t sourcelen);
 
+/**
+ * Check binary json from an untrusted source in one pass before anything
+ * reads it: every length is in bounds and containers are exactly filled by
+ * their children, type codes are known, labels are terminated, strings and
+ * labels are valid UTF-8 and numbers are number text.  Nesting deeper than
+ * json_max_depth is rejected, as the parser would.
+ * @return true if valid
+ */
+bool json_verify_binary(uint8_t *source, size_t sourcelen);
+
+/**
+ * Explain why json text does not parse.  The parsers do not track
+ * positions, so this parses the text again noting where each token
+ * starts, and fills dest with a zero terminated message giving the line
+ * and column (in characters, from 1) where parsing failed and the text
+ * around it.  The message is bounded in size however long the text.
+ * @return false if the text parses after all, with dest left empty
+ */
+bool json_diagnose_json(uint8_t *source, size_t sourcelen, dynbuffer_t *dest);
+
+/**
+ * As json_diagnose_json, for text that starts on line firstline of a larger
+ * input, such as one record of newline delimited json
+ */
+bool json_diagnose_json_at(uint8_t *source, size_t sourcelen, uint64_t firstline, dynbuffer_t *dest);
+
+/**
+ * Status of the array functions below, which take a binary value.  Packed
+ * arrays are handled by vector kernels, regular arrays by walking their
+ * elements.
+ */
+typedef enum {
+	JSON_ARRAY_OK=0,
+	JSON_ARRAY_NOT_ARRAY,
+	JSON_ARRAY_NOT_NUMERIC,
+	JSON_ARRAY_CORRUPT
+} json_array_status_t;
+
+json_array_status_t json_array_length(uint8_t *source, size_t sourcelen, uint32_t *outcount);
+json_array_status_t json_array_sum(uint8_t *source, size_t sourcelen, double *outsum);
+
+/**
+ * outmin and outmax are only set if *outcount is non zero
+ */
+json_array_status_t json_array_minmax(uint8_t *source, size_t sourcelen, uint32_t *outcount, double *outmin, double *outmax);
+
+/**
+ * Non numeric elements never match
+ */
+json_array_status_t json_array_contains_number(uint8_t *source, size_t sourcelen, double value, bool *outfound);
+
+/**
+ * Append the binary value of element index (zero based) to dest
+ */
+json_array_status_t json_array_element(uint8_t *source, size_t sourcelen, uint32_t index, dynbuffer_t *dest, bool *outfound);
+
+typedef enum {
+	JSON_PATH_OK=0,
+	JSON_PATH_SYNTAX,
+	JSON_PATH_CORRUPT
+} json_path_status_t;
+
+/**
+ * Append the binary value at path within source to dest.  A path is a
+ * sequence of steps: a label (separated from the previous step by a dot),
+ * [n] for element n of an array, or [*] for every element.  For example
+ * items[*].price.  If the path has a [*] step, every match is collected
+ * into one array, which is empty if nothing matched.  Tables are read a
+ * column at a time when [*] is followed by a label.
+ */
+json_path_status_t json_path_get(uint8_t *source, size_t sourcelen, const uint8_t *path, size_t pathlen, dynbuffer_t *dest, bool *outfound);
+
+/**
+ * Append a copy of source reduced to the values selected by paths, in one
+ * pass.  Selected values are copied as raw bytes, objects keep only the
+ * selected keys and arrays only the selected elements ([n] elements also
+ * get what [*] selects).  An object with none of its selected keys is left
+ * out, as is any value no path applies to.  *outfound is false if that
+ * leaves out the top level value.
+ */
+json_path_status_t json_project(uint8_t *source, size_t sourcelen, const uint8_t **paths, const size_t *pathlens, int npaths, dynbuffer_t *dest, bool *outfound);
+
+/**
+ * As json_path_get, but over json text, appending the text of the match
+ * (a [*] path yields a text array).  Values off the path are skipped
+ * without being tokenized, and scanning stops at the first match of a
+ * path without [*], so the rest of the text is not validated.
+ * JSON_PATH_CORRUPT means the text is not valid json.
+ */
+json_path_status_t json_text_extract(uint8_t *source, size_t sourcelen, const uint8_t *path, size_t pathlen, dynbuffer_t *dest, bool *outfound);
+
 #endif
@@ -0,0 +1,406 @@
+/**
+ * ndjson2copy
+ * Encode newline delimited json (a document per line) to the binary
+ * representation on several threads, and write it in the binary COPY
+ * format, so that
+ *
+ *	COPY table (doc) FROM '/path/out.copy' WITH BINARY
+ *
+ * loads it into a json column without the server lexing any text.
+ *
+ * The input is mapped into memory and split into chunks that end on line
+ * boundaries.  Workers claim the next chunk from a shared counter, so a
+ * worker that finishes early simply takes more of them, and encode it with
+ * their own record buffer into the chunk's output buffer.  Chunks are
+ * written in input order: a finished chunk waits until those before it are
+ * written, and no worker runs more than a window of chunks ahead of the
+ * output, which bounds the memory used.  The worker that finishes the next
+ * chunk to be written writes it, and any that follow it and are ready,
+ * without holding the lock, so the others keep encoding meanwhile.
+ *
+ * Lines that do not parse are counted and skipped, and the first few are
+ * reported with their line number and byte offset.  A worker only notes
+ * where its chunk's bad lines are, relative to the chunk: they are
+ * diagnosed and reported in input order as the chunk is written, when the
+ * number of lines before it is known.  Blank lines are skipped.
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "dynbuffer.h"
+#include "jsonutil.h"
+#include "jsonbinary.h"
+
+#define DEFAULT_CHUNK_SIZE (4*1024*1024)
+#define DEFAULT_ERRORS_SHOWN 10
+
+/* chunks that may be encoded but not yet written, per worker */
+#define WINDOW_PER_WORKER 4
+
+static const uint8_t COPY_SIGNATURE[11]={ 'P', 'G', 'C', 'O', 'P', 'Y', '\n', 0xff, '\r', '\n', 0 };
+
+typedef struct {
+	size_t offset;
+	size_t len;
+	uint64_t line;			/* within the chunk, from 0 */
+} bad_line_t;
+
+typedef struct {
+	bool done;				/* encoded, waiting to be written */
+	dynbuffer_t out;
+	dynbuffer_t bad;		/* bad_line_t of the first errors_shown_max errors */
+	uint64_t lines;
+	uint64_t records;
+	uint64_t errors;
+} chunk_slot_t;
+
+typedef struct {
+	const uint8_t *input;
+	size_t inputlen;
+	size_t chunksize;
+	size_t nchunks;
+	int max_depth;
+	uint64_t errors_shown_max;
+	FILE *output;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	size_t next_claim;		/* chunk the next worker takes */
+	size_t next_write;		/* chunk to be written next */
+	bool writing;			/* a worker is writing chunks out */
+	chunk_slot_t *slots;	/* chunk n uses slots[n % window] */
+	size_t window;
+
+	uint64_t lines;			/* in the chunks written so far */
+	uint64_t records;
+	uint64_t errors;
+	uint64_t errors_shown;
+	uint64_t bytes_out;
+	bool write_failed;
+} job_t;
+
+static void put_int16(dynbuffer_t *dest, int16_t value)
+{
+	dynbuffer_ensure_delta(dest, 2);
+	dynbuffer_append_byte_nocheck(dest, ((uint16_t)value>>8) & 0xff);
+	dynbuffer_append_byte_nocheck(dest, (uint16_t)value & 0xff);
+}
+
+static void put_int32(dynbuffer_t *dest, int32_t value)
+{
+	dynbuffer_ensure_delta(dest, 4);
+	dynbuffer_append_byte_nocheck(dest, ((uint32_t)value>>24) & 0xff);
+	dynbuffer_append_byte_nocheck(dest, ((uint32_t)value>>16) & 0xff);
+	dynbuffer_append_byte_nocheck(dest, ((uint32_t)value>>8) & 0xff);
+	dynbuffer_append_byte_nocheck(dest, (uint32_t)value & 0xff);
+}
+
+/**
+ * Offset of the first line that starts at or after chunk * chunksize
+ */
+static size_t chunk_start(job_t *job, size_t chunk)
+{
+	size_t pos=chunk*job->chunksize;
+	const uint8_t *newline;
+
+	if (chunk==0) return 0;
+	if (pos>=job->inputlen) return job->inputlen;
+
+	newline=(const uint8_t*)memchr(job->input+pos-1, '\n', job->inputlen-(pos-1));
+	return newline ? (size_t)(newline-job->input)+1 : job->inputlen;
+}
+
+static bool is_blank(const uint8_t *s, size_t len)
+{
+	size_t i;
+
+	for (i=0; i<len; i++) {
+		if (s[i]!=' ' && s[i]!='\t' && s[i]!='\r') return false;
+	}
+	return true;
+}
+
+/**
+ * Report the bad lines noted in slot, until errors_shown_max have been.
+ * Only called by the worker writing chunks out, after the chunks before.
+ */
+static void report_errors(job_t *job, chunk_slot_t *slot)
+{
+	dynbuffer_t diagnosis=dynbuffer_init();
+	bad_line_t *bad=(bad_line_t*)slot->bad.contents;
+	size_t i, nbad=slot->bad.pos/sizeof(bad_line_t);
+	unsigned long long line;
+
+	for (i=0; i<nbad && job->errors_shown<job->errors_shown_max; i++, job->errors_shown++) {
+		line=job->lines+bad[i].line+1;
+		diagnosis.pos=0;
+		if (json_diagnose_json_at((uint8_t*)job->input+bad[i].offset, bad[i].len, line, &diagnosis)) {
+			fprintf(stderr, "offset %lu: %s\n", (unsigned long)bad[i].offset, (char*)diagnosis.contents);
+		} else {
+			fprintf(stderr, "offset %lu: document too large at line %llu\n", (unsigned long)bad[i].offset, line);
+		}
+	}
+	dynbuffer_destroy(&diagnosis);
+}
+
+/**
+ * Encode the lines of chunk as COPY tuples of one field into slot->out.
+ * record is the worker's own buffer, which keeps its capacity from one
+ * line to the next.
+ */
+static void encode_chunk(job_t *job, size_t chunk, chunk_slot_t *slot, dynbuffer_t *record)
+{
+	const uint8_t *p=job->input+chunk_start(job, chunk);
+	const uint8_t *end=job->input+chunk_start(job, chunk+1);
+	const uint8_t *line, *newline;
+	size_t len;
+	bad_line_t bad;
+
+	slot->out.pos=0;
+	slot->bad.pos=0;
+	slot->lines=0;
+	slot->records=0;
+	slot->errors=0;
+
+	for (; p<end; slot->lines++) {
+		line=p;
+		newline=(const uint8_t*)memchr(p, '\n', end-p);
+		len=(newline ? newline : end)-line;
+		p=newline ? newline+1 : end;
+		if (is_blank(line, len)) continue;
+
+		record->pos=0;
+		if (!json_transcode_json_to_binary((uint8_t*)line, len, record) || record->pos>=INT32_MAX) {
+			if (slot->errors++<job->errors_shown_max) {
+				bad.offset=line-job->input;
+				bad.len=len;
+				bad.line=slot->lines;
+				dynbuffer_append(&slot->bad, &bad, sizeof(bad));
+			}
+			continue;
+		}
+
+		/* one field: its length, then the json type's binary format */
+		put_int16(&slot->out, 1);
+		put_int32(&slot->out, (int32_t)(record->pos+1));
+		dynbuffer_append_byte(&slot->out, JSONBINARY_WIRE_VERSION);
+		dynbuffer_append(&slot->out, record->contents, record->pos);
+		slot->records++;
+	}
+}
+
+/**
+ * Write out the finished chunks that are next in order.  Called with the
+ * lock held, which is released while writing.  Only one worker writes at a
+ * time; a chunk finished meanwhile is written by that worker when it takes
+ * the lock again.
+ */
+static void write_ready(job_t *job)
+{
+	chunk_slot_t *slot;
+	bool failed;
+
+	if (job->writing) return;
+	job->writing=true;
+
+	while (job->next_write<job->nchunks) {
+		slot=&job->slots[job->next_write % job->window];
+		if (!slot->done) break;
+
+		/* no chunk reuses the slot until next_write has moved past it */
+		pthread_mutex_unlock(&job->lock);
+		failed=slot->out.pos && fwrite(slot->out.contents, 1, slot->out.pos, job->output)!=slot->out.pos;
+		report_errors(job, slot);
+		pthread_mutex_lock(&job->lock);
+
+		if (failed) job->write_failed=true;
+		job->bytes_out+=slot->out.pos;
+		job->lines+=slot->lines;
+		job->records+=slot->records;
+		job->errors+=slot->errors;
+
+		/* the buffer stays allocated for the chunk that reuses the slot */
+		slot->done=false;
+		job->next_write++;
+		pthread_cond_broadcast(&job->cond);
+	}
+
+	job->writing=false;
+}
+
+static void *worker(void *arg)
+{
+	job_t *job=(job_t*)arg;
+	dynbuffer_t record=dynbuffer_init();
+	chunk_slot_t *slot;
+	size_t chunk;
+
+	/* settings are per thread in this build */
+	json_max_depth=job->max_depth;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		while (job->next_claim<job->nchunks && job->next_claim>=job->next_write+job->window) {
+			pthread_cond_wait(&job->cond, &job->lock);
+		}
+		if (job->next_claim>=job->nchunks) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+		chunk=job->next_claim++;
+		slot=&job->slots[chunk % job->window];
+		pthread_mutex_unlock(&job->lock);
+
+		encode_chunk(job, chunk, slot, &record);
+
+		pthread_mutex_lock(&job->lock);
+		slot->done=true;
+		write_ready(job);
+		pthread_cond_broadcast(&job->cond);
+		pthread_mutex_unlock(&job->lock);
+	}
+
+	dynbuffer_destroy(&record);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+			"Usage: ndjson2copy [-j threads] [-c chunk_kb] [-e errors_shown] [-d max_depth] input.ndjson [output.copy]\n"
+			"Writes COPY ... WITH BINARY data of one json column, to stdout without output.copy.\n"
+			"max_depth is at most %d, the most pgjson.max_depth can be set to.\n", JSON_MAX_DEPTH_LIMIT);
+}
+
+int main(int argc, char **argv)
+{
+	job_t job;
+	dynbuffer_t header=dynbuffer_init();
+	pthread_t *threads;
+	struct stat st;
+	void *mapping=NULL;
+	int nthreads=(int)sysconf(_SC_NPROCESSORS_ONLN);
+	int fd, opt, i;
+	double started, seconds;
+
+	memset(&job, 0, sizeof(job));
+	job.chunksize=DEFAULT_CHUNK_SIZE;
+	job.errors_shown_max=DEFAULT_ERRORS_SHOWN;
+	job.max_depth=JSON_DEFAULT_MAX_DEPTH;
+
+	while ((opt=getopt(argc, argv, "j:c:e:d:"))!=-1) {
+		switch (opt) {
+		case 'j': nthreads=atoi(optarg); break;
+		case 'c': job.chunksize=(size_t)atol(optarg)*1024; break;
+		case 'e': job.errors_shown_max=(uint64_t)atol(optarg); break;
+		case 'd': job.max_depth=atoi(optarg); break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (optind>=argc || argc-optind>2 || nthreads<1 || job.chunksize<1
+			|| job.max_depth<1 || job.max_depth>JSON_MAX_DEPTH_LIMIT) {
+		usage();
+		return 2;
+	}
+
+	fd=open(argv[optind], O_RDONLY);
+	if (fd<0 || fstat(fd, &st)<0) {
+		fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+		return 2;
+	}
+	job.inputlen=st.st_size;
+	if (job.inputlen) {
+		mapping=mmap(NULL, job.inputlen, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping==MAP_FAILED) {
+			fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+			return 2;
+		}
+		madvise(mapping, job.inputlen, MADV_SEQUENTIAL);
+	}
+	job.input=(const uint8_t*)mapping;
+	job.nchunks=(job.inputlen+job.chunksize-1)/job.chunksize;
+
+	if (argc-optind==2) {
+		job.output=fopen(argv[optind+1], "wb");
+		if (!job.output) {
+			fprintf(stderr, "%s: %s\n", argv[optind+1], strerror(errno));
+			return 2;
+		}
+	} else {
+		job.output=stdout;
+	}
+
+	/* signature, flags, header extension length */
+	dynbuffer_append(&header, COPY_SIGNATURE, sizeof(COPY_SIGNATURE));
+	put_int32(&header, 0);
+	put_int32(&header, 0);
+	fwrite(header.contents, 1, header.pos, job.output);
+	job.bytes_out=header.pos;
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	job.window=(size_t)nthreads*WINDOW_PER_WORKER;
+	job.slots=(chunk_slot_t*)calloc(job.window, sizeof(chunk_slot_t));
+	threads=(pthread_t*)malloc(sizeof(pthread_t)*nthreads);
+
+	started=now();
+	for (i=0; i<nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, worker, &job)!=0) {
+			fprintf(stderr, "could not start worker threads\n");
+			return 2;
+		}
+	}
+	for (i=0; i<nthreads; i++) pthread_join(threads[i], NULL);
+	seconds=now()-started;
+
+	/* trailer: a field count of -1 */
+	header.pos=0;
+	put_int16(&header, -1);
+	fwrite(header.contents, 1, header.pos, job.output);
+	job.bytes_out+=header.pos;
+	if (fflush(job.output)!=0 || ferror(job.output)) job.write_failed=true;
+
+	fprintf(stderr, "%llu records, %llu errors, %.1f MB in, %.1f MB out, %d threads, %.2f s, %.1f MB/s, %.0f records/s\n",
+			(unsigned long long)job.records, (unsigned long long)job.errors,
+			job.inputlen/1048576.0, job.bytes_out/1048576.0, nthreads, seconds,
+			seconds>0 ? job.inputlen/1048576.0/seconds : 0.0,
+			seconds>0 ? job.records/seconds : 0.0);
+
+	if (job.write_failed) {
+		fprintf(stderr, "error writing output: %s\n", strerror(errno));
+		return 2;
+	}
+
+	for (i=0; i<(int)job.window; i++) {
+		dynbuffer_destroy(&job.slots[i].out);
+		dynbuffer_destroy(&job.slots[i].bad);
+	}
+	free(job.slots);
+	free(threads);
+	dynbuffer_destroy(&header);
+	if (job.output!=stdout) fclose(job.output);
+	if (mapping) munmap(mapping, job.inputlen);
+	close(fd);
+
+	return job.errors ? 1 : 0;
+}
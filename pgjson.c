@@ -1,13 +1,232 @@
 #include <postgres.h>
 #include <fmgr.h>
+#include <funcapi.h>
+#if PG_VERSION_NUM >= 130000
+#include <access/detoast.h>
+#endif
+#include <access/htup.h>
+#if PG_VERSION_NUM >= 90300
+#include <access/htup_details.h>
+#endif
+#if PG_VERSION_NUM < 130000
+#include <access/tuptoaster.h>
+#endif
+#include <access/xact.h>
+#include <catalog/pg_type.h>
+#include <executor/executor.h>
+#include <libpq/libpq-fs.h>
+#include <libpq/pqformat.h>
+#include <mb/pg_wchar.h>
+#include <miscadmin.h>
+#include <storage/large_object.h>
+#include <utils/acl.h>
+#include <utils/array.h>
+#include <utils/guc.h>
+#include <utils/lsyscache.h>
+#include <utils/typcache.h>
 
 #include "jsonlib/dynbuffer.h"
 #include "jsonlib/jsonutil.h"
+#include "jsonlib/jsonbinary.h"
+#include "jsonlib/jsonnumber.h"
+
+#define PG_GETARG_JSON_BINARY(n, data, length) \
+	{ \
+		void *datum_=pgjson_detoast(PG_GETARG_DATUM(n)); \
+		data=(uint8_t*)VARDATA_ANY(datum_); \
+		length=VARSIZE_ANY_EXHDR(datum_); \
+	}
+
+#ifndef TupleDescAttr
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+#ifndef VARATT_IS_EXTERNAL_ONDISK
+#define VARATT_IS_EXTERNAL_ONDISK(PTR) VARATT_IS_EXTERNAL(PTR)
+#endif
 
 #ifdef PG_MODULE_MAGIC
 PG_MODULE_MAGIC;
 #endif
 
+void _PG_init(void);
+
+/* pgjson.ascii_output */
+static bool pgjson_ascii_output=true;
+
+/*** detoast cache ***/
+/**
+ * Several accessors on the same document in a query (doc->'a', doc->'b',
+ * ...) would each detoast it.  The last few documents detoasted are kept
+ * until the end of the query instead.  A document is identified by its
+ * toasted form: the pointer to an out of line value, or the bytes of a
+ * compressed one, which are far cheaper to compare than to decompress.
+ * Values that need no detoasting are not cached, nor are values larger
+ * than PGJSON_DETOAST_CACHE_MAX_VALUE, so the cache holds at most a few
+ * times that; those are detoasted per call and freed with the calling
+ * context as usual.  Only accessors use the cache: output functions see
+ * each document once.  Values returned must not be freed, nor used after
+ * anything that can end a query (such as running SQL) has run.
+ */
+#define PGJSON_DETOAST_CACHE_SIZE 4
+#define PGJSON_DETOAST_CACHE_MAX_VALUE (8*1024*1024)
+
+typedef struct {
+	struct varlena *key;	/* the toasted form */
+	struct varlena *value;	/* detoasted */
+} pgjson_detoast_entry_t;
+
+static MemoryContext pgjson_detoast_context=NULL;
+static pgjson_detoast_entry_t pgjson_detoast_entries[PGJSON_DETOAST_CACHE_SIZE];
+static int pgjson_detoast_next=0;	/* entry to replace next */
+static int64 pgjson_detoast_hits=0;
+static int64 pgjson_detoast_misses=0;
+static ExecutorEnd_hook_type pgjson_prev_ExecutorEnd=NULL;
+
+static void *pgjson_detoast(Datum datum)
+{
+	struct varlena *attr=(struct varlena*)DatumGetPointer(datum);
+	pgjson_detoast_entry_t *entry;
+	MemoryContext oldcontext;
+	Size keylen;
+	int i;
+
+	if (!VARATT_IS_EXTERNAL_ONDISK(attr) && !VARATT_IS_COMPRESSED(attr)) return PG_DETOAST_DATUM_PACKED(datum);
+	if (toast_raw_datum_size(datum)>PGJSON_DETOAST_CACHE_MAX_VALUE) return PG_DETOAST_DATUM_PACKED(datum);
+
+	keylen=VARSIZE_ANY(attr);
+	for (i=0; i<PGJSON_DETOAST_CACHE_SIZE; i++) {
+		entry=&pgjson_detoast_entries[i];
+		if (entry->key && VARSIZE_ANY(entry->key)==keylen && memcmp(entry->key, attr, keylen)==0) {
+			pgjson_detoast_hits++;
+			return entry->value;
+		}
+	}
+	pgjson_detoast_misses++;
+
+	/* under TopTransactionContext, so an aborted query cannot leave it
+	 * behind; pgjson_detoast_xact forgets it then */
+	if (!pgjson_detoast_context) {
+		pgjson_detoast_context=AllocSetContextCreate(TopTransactionContext,
+				"pgjson detoast cache",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+	}
+
+	entry=&pgjson_detoast_entries[pgjson_detoast_next];
+	pgjson_detoast_next=(pgjson_detoast_next+1) % PGJSON_DETOAST_CACHE_SIZE;
+	if (entry->key) {
+		pfree(entry->key);
+		pfree(entry->value);
+	}
+
+	oldcontext=MemoryContextSwitchTo(pgjson_detoast_context);
+	entry->value=(struct varlena*)PG_DETOAST_DATUM_PACKED(datum);
+	entry->key=(struct varlena*)palloc(keylen);
+	memcpy(entry->key, attr, keylen);
+	MemoryContextSwitchTo(oldcontext);
+
+	return entry->value;
+}
+
+/**
+ * Forget the cache, freeing it unless its context has gone already
+ */
+static void pgjson_detoast_reset(bool delete_context)
+{
+	if (delete_context && pgjson_detoast_context) MemoryContextDelete(pgjson_detoast_context);
+	pgjson_detoast_context=NULL;
+	memset(pgjson_detoast_entries, 0, sizeof(pgjson_detoast_entries));
+	pgjson_detoast_next=0;
+}
+
+static void pgjson_detoast_ExecutorEnd(QueryDesc *queryDesc)
+{
+	pgjson_detoast_reset(true);
+	if (pgjson_prev_ExecutorEnd) pgjson_prev_ExecutorEnd(queryDesc);
+	else standard_ExecutorEnd(queryDesc);
+}
+
+static void pgjson_detoast_xact(XactEvent event, void *arg)
+{
+	/* TopTransactionContext goes at the end of the transaction */
+	if (event==XACT_EVENT_COMMIT || event==XACT_EVENT_ABORT || event==XACT_EVENT_PREPARE) pgjson_detoast_reset(false);
+}
+
+/**
+ * Module load: define the pgjson.max_depth setting, which jsonlib's parser
+ * reads through json_max_depth, and pgjson.ascii_output, which selects how
+ * json text is written (see pgjson_set_ascii_output), and install the
+ * hooks that clear the detoast cache
+ */
+void
+_PG_init(void)
+{
+	DefineCustomIntVariable("pgjson.max_depth",
+			"Maximum nesting depth of json text accepted by the parser.",
+			NULL,
+			&json_max_depth,
+			JSON_DEFAULT_MAX_DEPTH,
+			1,
+			JSON_MAX_DEPTH_LIMIT,
+			PGC_USERSET,
+			0,
+#if PG_VERSION_NUM >= 90100
+			NULL,
+#endif
+			NULL,
+			NULL);
+
+	DefineCustomBoolVariable("pgjson.ascii_output",
+			"Escape all non-ASCII characters in json text output.",
+			"If off, UTF-8 characters are written as they are.  Ignored unless the database encoding is UTF8.",
+			&pgjson_ascii_output,
+			true,
+			PGC_USERSET,
+			0,
+#if PG_VERSION_NUM >= 90100
+			NULL,
+#endif
+			NULL,
+			NULL);
+
+	pgjson_prev_ExecutorEnd=ExecutorEnd_hook;
+	ExecutorEnd_hook=pgjson_detoast_ExecutorEnd;
+	RegisterXactCallback(pgjson_detoast_xact, NULL);
+}
+
+/* json_detoast_cache_stats() as (hits int8, misses int8) */
+PG_FUNCTION_INFO_V1(pgjson_json_detoast_cache_stats);
+Datum
+pgjson_json_detoast_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc tupdesc;
+	Datum values[2];
+	bool nulls[2]={false, false};
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc)!=TYPEFUNC_COMPOSITE) {
+		ereport(ERROR, (
+				errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				errmsg("function returning record called in context that cannot accept type record")
+				));
+	}
+	tupdesc=BlessTupleDesc(tupdesc);
+
+	values[0]=Int64GetDatum(pgjson_detoast_hits);
+	values[1]=Int64GetDatum(pgjson_detoast_misses);
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/**
+ * Set jsonlib's output mode before transcoding to json text.  Characters
+ * can only be written as they are if the database encoding is UTF-8.
+ */
+static void pgjson_set_ascii_output(bool ascii_only)
+{
+	json_ascii_output=ascii_only || GetDatabaseEncoding()!=PG_UTF8;
+}
+
 #define PG_RETURN_DYNBUFFER(dynbuffer) \
 	{ \
 		dynbuffer_ensure(&dynbuffer, 0); \
@@ -15,8 +234,56 @@ PG_MODULE_MAGIC;
 		PG_RETURN_POINTER(dynbuffer_allocbuffer(&dynbuffer)); \
 	}
 
+Datum pgjson_json_out(PG_FUNCTION_ARGS);
+
+/**
+ * Report json text that failed to parse.  The parsers do not track
+ * positions, so the text is parsed again to say where it went wrong.
+ * message, from the failed parse, is only used if that finds nothing.
+ */
+static void pgjson_parse_error(uint8_t *source, size_t length, const char *message)
+{
+	dynbuffer_t diagnosis=dynbuffer_init();
+
+	if (json_diagnose_json(source, length, &diagnosis)) message=(char*)diagnosis.contents;
+	ereport(ERROR, (
+			errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			errmsg("JSON parse error: %s", message)
+			));
+}
+
+/**
+ * The lexer, parsers and transcoders get their scratch space (string
+ * buffers, parse stacks, tables and packed arrays being built) with
+ * JSON_malloc in the current memory context.  Functions that parse keep a
+ * context for it in fn_extra, reset at the start of each call, so that a
+ * bulk load reuses the same blocks row after row and a call that errors
+ * out leaves nothing behind for the next.  Switches to it and returns the
+ * context to switch back to.  A result dynbuffer must be allocated first:
+ * it grows in the context it was allocated in.
+ */
+static MemoryContext pgjson_switch_to_scratch(FunctionCallInfo fcinfo)
+{
+	MemoryContext scratch;
+
+	if (!fcinfo->flinfo) return CurrentMemoryContext;
+
+	scratch=(MemoryContext)fcinfo->flinfo->fn_extra;
+	if (scratch) {
+		MemoryContextReset(scratch);
+	} else {
+		scratch=AllocSetContextCreate(fcinfo->flinfo->fn_mcxt,
+				"pgjson scratch",
+				ALLOCSET_DEFAULT_MINSIZE,
+				ALLOCSET_DEFAULT_INITSIZE,
+				ALLOCSET_DEFAULT_MAXSIZE);
+		fcinfo->flinfo->fn_extra=scratch;
+	}
+	return MemoryContextSwitchTo(scratch);
+}
+
 /*** general json functions (not related to datatype) ***/
-/* JsonNormalize(text) as text */
+/* JsonNormalize(text [, ascii_only bool]) as text */
 PG_FUNCTION_INFO_V1(pgjson_json_normalize);
 Datum
 pgjson_json_normalize(PG_FUNCTION_ARGS)
@@ -24,23 +291,41 @@ pgjson_json_normalize(PG_FUNCTION_ARGS)
 	void *input_data;
 	size_t input_length;
 	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	MemoryContext oldcontext;
 	bool success;
 
 	input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
 	input_length=VARSIZE_ANY_EXHDR(input_data);
 
+	pgjson_set_ascii_output(PG_NARGS()>1 ? PG_GETARG_BOOL(1) : pgjson_ascii_output);
+	dynbuffer_ensure_exact(&buffer, input_length+1);
+	oldcontext=pgjson_switch_to_scratch(fcinfo);
 	success=json_transcode_json_to_json((uint8_t*)VARDATA_ANY(input_data), input_length, &buffer);
+	MemoryContextSwitchTo(oldcontext);
 	if (!success) {
-		ereport(ERROR, (
-				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				errmsg("JSON parse error: %s", (char*)buffer.contents)
-				));
+		pgjson_parse_error((uint8_t*)VARDATA_ANY(input_data), input_length, (char*)buffer.contents);
 		return 0;
 	}
 
 	PG_RETURN_DYNBUFFER(buffer);
 }
 
+/* json_is_valid(text) as bool */
+PG_FUNCTION_INFO_V1(pgjson_json_is_valid);
+Datum
+pgjson_json_is_valid(PG_FUNCTION_ARGS)
+{
+	void *input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
+	MemoryContext oldcontext;
+	bool valid;
+
+	oldcontext=pgjson_switch_to_scratch(fcinfo);
+	valid=json_validate_json((uint8_t*)VARDATA_ANY(input_data), VARSIZE_ANY_EXHDR(input_data));
+	MemoryContextSwitchTo(oldcontext);
+
+	PG_RETURN_BOOL(valid);
+}
+
 /*** json io ***/
 PG_FUNCTION_INFO_V1(pgjson_json_in);
 Datum
@@ -49,14 +334,16 @@ pgjson_json_in(PG_FUNCTION_ARGS)
 	char *input_text=PG_GETARG_CSTRING(0);
 	size_t input_length=strlen(input_text);
 	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	MemoryContext oldcontext;
 	bool success;
 
+	/* the binary is rarely longer than the text */
+	dynbuffer_ensure_exact(&buffer, input_length+1);
+	oldcontext=pgjson_switch_to_scratch(fcinfo);
 	success=json_transcode_json_to_binary((uint8_t*)input_text, input_length, &buffer);
+	MemoryContextSwitchTo(oldcontext);
 	if (!success) {
-		ereport(ERROR, (
-				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-				errmsg("JSON parse error: %s for input %s", (char*)buffer.contents, input_text)
-				));
+		pgjson_parse_error((uint8_t*)input_text, input_length, (char*)buffer.contents);
 		return 0;
 	}
 
@@ -75,6 +362,7 @@ pgjson_json_out(PG_FUNCTION_ARGS)
 	input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
 	input_length=VARSIZE_ANY_EXHDR(input_data);
 
+	pgjson_set_ascii_output(pgjson_ascii_output);
 	success=json_transcode_binary_to_json((uint8_t*)VARDATA_ANY(input_data), input_length, &buffer);
 	if (!success) {
 		ereport(ERROR, (
@@ -85,21 +373,139 @@ pgjson_json_out(PG_FUNCTION_ARGS)
 	}
 
 	dynbuffer_append_byte(&buffer, 0);
+	/* give back what the estimate or the last doubling overshot */
+	if (buffer.capacity-buffer.pos > buffer.capacity/4) dynbuffer_resize(&buffer, buffer.pos);
 	PG_RETURN_CSTRING(buffer.contents);
 }
 
+/* json_out_chunks(json [, chunk_size int4]) as setof text */
+#define PGJSON_DEFAULT_CHUNK 65536
+
+typedef struct {
+	void *input_data;
+	json_from_binary_stream_t *stream;
+	size_t chunk;
+	bool done;
+} pgjson_out_chunks_t;
+
+/**
+ * The text of a document as a series of pieces of about chunk_size bytes,
+ * so that a document too big to hold as text can still be written out.
+ * Only the binary and the current piece are in memory.
+ */
+PG_FUNCTION_INFO_V1(pgjson_json_out_chunks);
+Datum
+pgjson_json_out_chunks(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	pgjson_out_chunks_t *state;
+	MemoryContext oldcontext;
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	int32 chunk;
+	bool success;
+
+	if (SRF_IS_FIRSTCALL()) {
+		chunk=PG_NARGS()>1 ? PG_GETARG_INT32(1) : PGJSON_DEFAULT_CHUNK;
+		if (chunk<=0) {
+			ereport(ERROR, (
+					errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("chunk size must be positive")
+					));
+		}
+
+		funcctx=SRF_FIRSTCALL_INIT();
+		oldcontext=MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* the binary and the walk over it last until the last chunk */
+		state=(pgjson_out_chunks_t*)palloc(sizeof(pgjson_out_chunks_t));
+		state->input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
+		state->chunk=chunk;
+		state->done=false;
+		pgjson_set_ascii_output(pgjson_ascii_output);
+		state->stream=json_transcode_binary_to_json_begin((uint8_t*)VARDATA_ANY(state->input_data), VARSIZE_ANY_EXHDR(state->input_data));
+		funcctx->user_fctx=state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx=SRF_PERCALL_SETUP();
+	state=(pgjson_out_chunks_t*)funcctx->user_fctx;
+
+	if (state->done) {
+		json_transcode_binary_to_json_end(state->stream);
+		SRF_RETURN_DONE(funcctx);
+	}
+
+	/* the piece is returned from the per call context, while the stack of
+	 * the walk grows in the multi call context */
+	dynbuffer_ensure(&buffer, state->chunk);
+	oldcontext=MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+	success=json_transcode_binary_to_json_next(state->stream, &buffer, state->chunk, &state->done);
+	MemoryContextSwitchTo(oldcontext);
+	if (!success) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Corrupt binary json data")
+				));
+	}
+
+	dynbuffer_ensure(&buffer, 0);
+	SET_VARSIZE(dynbuffer_allocbuffer(&buffer), buffer.pos + VARHDRSZ);
+	SRF_RETURN_NEXT(funcctx, PointerGetDatum(dynbuffer_allocbuffer(&buffer)));
+}
+
+/*
+ * The binary wire format is a version byte (JSONBINARY_WIRE_VERSION)
+ * followed by the stored binary value, so clients and COPY BINARY can load
+ * documents already encoded (see jsonlib/jsonlib.h) without the server
+ * lexing any text.  A change to the stored format gets a new version, and
+ * recv can convert from the old one.
+ */
 PG_FUNCTION_INFO_V1(pgjson_json_recv);
 Datum
 pgjson_json_recv(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	StringInfo buf=(StringInfo)PG_GETARG_POINTER(0);
+	const char *data;
+	int version;
+	int length;
+	bytea *result;
+
+	version=pq_getmsgbyte(buf);
+	if (version!=JSONBINARY_WIRE_VERSION) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				errmsg("unsupported binary json version %d", version)
+				));
+	}
+
+	/* the value comes from outside, so nothing may read it unchecked */
+	length=buf->len - buf->cursor;
+	data=pq_getmsgbytes(buf, length);
+	if (!json_verify_binary((uint8_t*)data, length)) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+				errmsg("Corrupt binary json data")
+				));
+	}
+
+	result=(bytea*)palloc(length + VARHDRSZ);
+	SET_VARSIZE(result, length + VARHDRSZ);
+	memcpy(VARDATA(result), data, length);
+	PG_RETURN_POINTER(result);
 }
 
 PG_FUNCTION_INFO_V1(pgjson_json_send);
 Datum
 pgjson_json_send(PG_FUNCTION_ARGS)
 {
-	PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	StringInfoData buf;
+	void *input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
+
+	pq_begintypsend(&buf);
+	pq_sendbyte(&buf, JSONBINARY_WIRE_VERSION);
+	pq_sendbytes(&buf, (char*)VARDATA_ANY(input_data), VARSIZE_ANY_EXHDR(input_data));
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
 }
 
 /* json support functions */
@@ -110,3 +516,686 @@ pgjson_json_as_binary(PG_FUNCTION_ARGS)
 {
 	PG_RETURN_DATUM(PG_GETARG_DATUM(0));
 }
+
+/*** json construction from sql values ***/
+
+/**
+ * How a sql value is written when building json directly from Datums
+ */
+typedef enum {
+	JSONBUILD_STRING=0,	/* text of the type output function as a string */
+	JSONBUILD_NUMBER,	/* text of the type output function as a number */
+	JSONBUILD_INTEGER,	/* int2/int4/int8, formatted without the output function */
+	JSONBUILD_BOOL,
+	JSONBUILD_JSON,		/* our own json type, binary copied verbatim */
+	JSONBUILD_RECORD,	/* composite type, written as a nested object */
+	JSONBUILD_ARRAY		/* sql array, written as (nested) json arrays */
+} jsonbuild_kind_t;
+
+typedef struct jsonbuild_converter_s {
+	Oid typid;	/* domains resolved to their base type */
+	jsonbuild_kind_t kind;
+	FmgrInfo outfunc;
+	/* JSONBUILD_ARRAY only */
+	struct jsonbuild_converter_s *element;
+	int16 elemlen;
+	bool elembyval;
+	char elemalign;
+} jsonbuild_converter_t;
+
+/**
+ * Cached shape of a row type.  The labels of all attributes are encoded once
+ * into a single label block so that each row only has to append values.
+ * Dropped attributes have an empty label range.
+ */
+typedef struct jsonbuild_shape_s {
+	struct jsonbuild_shape_s *next;
+	Oid tuptype;
+	int32 tuptypmod;
+	int natts;
+	uint8_t *labels;
+	uint32_t *label_offsets;	/* natts+1 offsets into labels */
+	jsonbuild_converter_t *converters;
+	Datum *values;
+	bool *nulls;
+} jsonbuild_shape_t;
+
+/**
+ * Per call site cache kept in fn_extra
+ */
+typedef struct {
+	MemoryContext mcxt;
+	jsonbuild_shape_t *shapes;
+	int nargs;
+	jsonbuild_converter_t *args;
+} jsonbuild_cache_t;
+
+static void jsonbuild_write_record(jsonbuild_cache_t *cache, dynbuffer_t *dest, HeapTupleHeader td);
+
+static jsonbuild_cache_t *jsonbuild_get_cache(FunctionCallInfo fcinfo)
+{
+	jsonbuild_cache_t *cache=(jsonbuild_cache_t*)fcinfo->flinfo->fn_extra;
+
+	if (!cache) {
+		cache=(jsonbuild_cache_t*)MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt, sizeof(jsonbuild_cache_t));
+		cache->mcxt=fcinfo->flinfo->fn_mcxt;
+		fcinfo->flinfo->fn_extra=cache;
+	}
+	return cache;
+}
+
+static void jsonbuild_init_converter(jsonbuild_converter_t *conv, Oid typid, MemoryContext mcxt)
+{
+	Oid outfuncoid, elemtype;
+	bool isvarlena;
+
+	/* a domain is written as its base type */
+	typid=getBaseType(typid);
+	conv->typid=typid;
+	getTypeOutputInfo(typid, &outfuncoid, &isvarlena);
+	fmgr_info_cxt(outfuncoid, &conv->outfunc, mcxt);
+
+	elemtype=get_element_type(typid);
+	if (elemtype!=InvalidOid) {
+		conv->kind=JSONBUILD_ARRAY;
+		get_typlenbyvalalign(elemtype, &conv->elemlen, &conv->elembyval, &conv->elemalign);
+		conv->element=(jsonbuild_converter_t*)MemoryContextAllocZero(mcxt, sizeof(jsonbuild_converter_t));
+		jsonbuild_init_converter(conv->element, elemtype, mcxt);
+		return;
+	}
+
+	switch (typid) {
+	case BOOLOID:
+		conv->kind=JSONBUILD_BOOL;
+		break;
+	case INT2OID:
+	case INT4OID:
+	case INT8OID:
+		conv->kind=JSONBUILD_INTEGER;
+		break;
+	case FLOAT4OID:
+	case FLOAT8OID:
+	case NUMERICOID:
+		conv->kind=JSONBUILD_NUMBER;
+		break;
+	default:
+		if (conv->outfunc.fn_addr==pgjson_json_out) conv->kind=JSONBUILD_JSON;
+		else if (type_is_rowtype(typid)) conv->kind=JSONBUILD_RECORD;
+		else conv->kind=JSONBUILD_STRING;
+	}
+}
+
+static void jsonbuild_write_datum(jsonbuild_cache_t *cache, dynbuffer_t *dest, jsonbuild_converter_t *conv, Datum value, bool isnull);
+
+/**
+ * Write dimension dim of an array, starting at element *index, as a json
+ * array whose elements are the arrays of the next dimension or, for the
+ * last one, the elements themselves
+ */
+static void jsonbuild_write_array_dim(jsonbuild_cache_t *cache, dynbuffer_t *dest, jsonbuild_converter_t *conv,
+		int dim, int ndims, int *dims, Datum *values, bool *nulls, int *index)
+{
+	uint32_t startpos;
+	int i;
+
+	startpos=jsonbinary_begin_container(dest);
+	for (i=0; i<dims[dim]; i++) {
+		if (dim+1<ndims) {
+			jsonbuild_write_array_dim(cache, dest, conv, dim+1, ndims, dims, values, nulls, index);
+		} else {
+			jsonbuild_write_datum(cache, dest, conv->element, values[*index], nulls[*index]);
+			(*index)++;
+		}
+	}
+	jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, startpos);
+}
+
+static void jsonbuild_write_datum(jsonbuild_cache_t *cache, dynbuffer_t *dest, jsonbuild_converter_t *conv, Datum value, bool isnull)
+{
+	ArrayType *array;
+	Datum *elements;
+	bool *elementnulls;
+	int nelements, index=0;
+	char intbuf[JSONNUMBER_FORMAT_MAX];
+	char *text;
+	void *json_data;
+	int len;
+
+	if (isnull) {
+		jsonbinary_write_ss(dest, JSONBINARY_SS_DATA_NULL);
+		return;
+	}
+
+	switch (conv->kind) {
+	case JSONBUILD_BOOL:
+		jsonbinary_write_ss(dest, DatumGetBool(value) ? JSONBINARY_SS_DATA_TRUE : JSONBINARY_SS_DATA_FALSE);
+		break;
+	case JSONBUILD_INTEGER:
+		if (conv->typid==INT2OID) len=jsonnumber_format_int64(DatumGetInt16(value), intbuf);
+		else if (conv->typid==INT4OID) len=jsonnumber_format_int64(DatumGetInt32(value), intbuf);
+		else len=jsonnumber_format_int64(DatumGetInt64(value), intbuf);
+		jsonbinary_write_value(dest, JSONBINARY_TYPE_NUMBER, (uint8_t*)intbuf, len);
+		break;
+	case JSONBUILD_NUMBER:
+		text=OutputFunctionCall(&conv->outfunc, value);
+		/* NaN and Infinity have no json number representation */
+		if ((text[0]>='0' && text[0]<='9') || (text[0]=='-' && text[1]>='0' && text[1]<='9'))
+			jsonbinary_write_value(dest, JSONBINARY_TYPE_NUMBER, (uint8_t*)text, strlen(text));
+		else
+			jsonbinary_write_value(dest, JSONBINARY_TYPE_STRING, (uint8_t*)text, strlen(text));
+		pfree(text);
+		break;
+	case JSONBUILD_JSON:
+		json_data=PG_DETOAST_DATUM_PACKED(value);
+		dynbuffer_append(dest, VARDATA_ANY(json_data), VARSIZE_ANY_EXHDR(json_data));
+		break;
+	case JSONBUILD_RECORD:
+		jsonbuild_write_record(cache, dest, DatumGetHeapTupleHeader(value));
+		break;
+	case JSONBUILD_ARRAY:
+		array=DatumGetArrayTypeP(value);
+		if (ARR_NDIM(array)==0) {
+			jsonbinary_finalize_container(dest, JSONBINARY_TYPE_ARRAY, jsonbinary_begin_container(dest));
+			break;
+		}
+		deconstruct_array(array, ARR_ELEMTYPE(array), conv->elemlen, conv->elembyval, conv->elemalign,
+				&elements, &elementnulls, &nelements);
+		jsonbuild_write_array_dim(cache, dest, conv, 0, ARR_NDIM(array), ARR_DIMS(array), elements, elementnulls, &index);
+		pfree(elements);
+		pfree(elementnulls);
+		break;
+	default:
+		text=OutputFunctionCall(&conv->outfunc, value);
+		jsonbinary_write_value(dest, JSONBINARY_TYPE_STRING, (uint8_t*)text, strlen(text));
+		pfree(text);
+	}
+}
+
+static jsonbuild_shape_t *jsonbuild_get_shape(jsonbuild_cache_t *cache, TupleDesc tupdesc, Oid tuptype, int32 tuptypmod)
+{
+	jsonbuild_shape_t *shape;
+	MemoryContext oldcontext;
+	dynbuffer_t labels=dynbuffer_init();
+	Form_pg_attribute att;
+	int i;
+
+	for (shape=cache->shapes; shape; shape=shape->next) {
+		if (shape->tuptype==tuptype && shape->tuptypmod==tuptypmod) return shape;
+	}
+
+	/* build a new shape in the long lived context */
+	oldcontext=MemoryContextSwitchTo(cache->mcxt);
+
+	shape=(jsonbuild_shape_t*)palloc0(sizeof(jsonbuild_shape_t));
+	shape->tuptype=tuptype;
+	shape->tuptypmod=tuptypmod;
+	shape->natts=tupdesc->natts;
+	shape->label_offsets=(uint32_t*)palloc((tupdesc->natts+1) * sizeof(uint32_t));
+	shape->converters=(jsonbuild_converter_t*)palloc0(tupdesc->natts * sizeof(jsonbuild_converter_t));
+	shape->values=(Datum*)palloc(tupdesc->natts * sizeof(Datum));
+	shape->nulls=(bool*)palloc(tupdesc->natts * sizeof(bool));
+
+	for (i=0; i<tupdesc->natts; i++) {
+		att=TupleDescAttr(tupdesc, i);
+		shape->label_offsets[i]=labels.pos;
+		if (att->attisdropped) continue;
+
+		jsonbinary_write_label(&labels, (uint8_t*)NameStr(att->attname), strlen(NameStr(att->attname)));
+		jsonbuild_init_converter(&shape->converters[i], att->atttypid, cache->mcxt);
+	}
+	shape->label_offsets[tupdesc->natts]=labels.pos;
+	shape->labels=labels.contents;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	shape->next=cache->shapes;
+	cache->shapes=shape;
+	return shape;
+}
+
+static void jsonbuild_write_record(jsonbuild_cache_t *cache, dynbuffer_t *dest, HeapTupleHeader td)
+{
+	Oid tuptype=HeapTupleHeaderGetTypeId(td);
+	int32 tuptypmod=HeapTupleHeaderGetTypMod(td);
+	TupleDesc tupdesc;
+	HeapTupleData tmptup;
+	jsonbuild_shape_t *shape;
+	uint32_t startpos;
+	uint32_t labelstart, labelend;
+	int i;
+
+	tupdesc=lookup_rowtype_tupdesc(tuptype, tuptypmod);
+	shape=jsonbuild_get_shape(cache, tupdesc, tuptype, tuptypmod);
+
+	tmptup.t_len=HeapTupleHeaderGetDatumLength(td);
+	tmptup.t_data=td;
+	heap_deform_tuple(&tmptup, tupdesc, shape->values, shape->nulls);
+
+	startpos=jsonbinary_begin_container(dest);
+	for (i=0; i<shape->natts; i++) {
+		labelstart=shape->label_offsets[i];
+		labelend=shape->label_offsets[i+1];
+		if (labelstart==labelend) continue;	/* dropped */
+
+		dynbuffer_append(dest, shape->labels+labelstart, labelend-labelstart);
+		jsonbuild_write_datum(cache, dest, &shape->converters[i], shape->values[i], shape->nulls[i]);
+	}
+	jsonbinary_finalize_container(dest, JSONBINARY_TYPE_OBJECT, startpos);
+
+	ReleaseTupleDesc(tupdesc);
+}
+
+/* row_to_json(record) as json */
+PG_FUNCTION_INFO_V1(pgjson_row_to_json);
+Datum
+pgjson_row_to_json(PG_FUNCTION_ARGS)
+{
+	HeapTupleHeader td=PG_GETARG_HEAPTUPLEHEADER(0);
+	jsonbuild_cache_t *cache=jsonbuild_get_cache(fcinfo);
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+
+	jsonbuild_write_record(cache, &buffer, td);
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/* json_build_object(VARIADIC "any") as json */
+PG_FUNCTION_INFO_V1(pgjson_json_build_object);
+Datum
+pgjson_json_build_object(PG_FUNCTION_ARGS)
+{
+	jsonbuild_cache_t *cache=jsonbuild_get_cache(fcinfo);
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	bool variadic=false;
+	ArrayType *array;
+	Oid elemtype;
+	int16 elemlen;
+	bool elembyval;
+	char elemalign;
+	Datum *values;
+	bool *nulls;
+	int nargs;
+	jsonbuild_converter_t *keyconv, *valueconv;
+	uint32_t startpos;
+	char *key;
+	Oid typid;
+	int i;
+
+#if PG_VERSION_NUM >= 90300
+	/* VARIADIC ARRAY[...] passes the arguments as the elements of one array */
+	variadic=get_fn_expr_variadic(fcinfo->flinfo);
+#endif
+	if (variadic) {
+		if (PG_ARGISNULL(0)) PG_RETURN_NULL();
+		array=PG_GETARG_ARRAYTYPE_P(0);
+		elemtype=ARR_ELEMTYPE(array);
+		get_typlenbyvalalign(elemtype, &elemlen, &elembyval, &elemalign);
+		deconstruct_array(array, elemtype, elemlen, elembyval, elemalign, &values, &nulls, &nargs);
+	} else {
+		nargs=PG_NARGS();
+		values=(Datum*)palloc(sizeof(Datum) * (nargs+1));
+		nulls=(bool*)palloc(sizeof(bool) * (nargs+1));
+		for (i=0; i<nargs; i++) {
+			nulls[i]=PG_ARGISNULL(i);
+			values[i]=nulls[i] ? (Datum)0 : PG_GETARG_DATUM(i);
+		}
+	}
+
+	if (nargs%2) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("json_build_object requires an even number of arguments")
+				));
+	}
+
+	/* argument types are fixed for the call site; the elements of a
+	 * VARIADIC array share one converter */
+	if (!cache->args) {
+		if (variadic) {
+			cache->args=(jsonbuild_converter_t*)MemoryContextAllocZero(cache->mcxt, sizeof(jsonbuild_converter_t));
+			jsonbuild_init_converter(&cache->args[0], elemtype, cache->mcxt);
+			cache->nargs=1;
+		} else {
+			cache->args=(jsonbuild_converter_t*)MemoryContextAllocZero(cache->mcxt, (nargs+1) * sizeof(jsonbuild_converter_t));
+			for (i=0; i<nargs; i++) {
+				typid=get_fn_expr_argtype(fcinfo->flinfo, i);
+				if (typid==InvalidOid) {
+					ereport(ERROR, (
+							errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+							errmsg("could not determine data type of json_build_object argument %d", i+1)
+							));
+				}
+				jsonbuild_init_converter(&cache->args[i], typid, cache->mcxt);
+			}
+			cache->nargs=nargs;
+		}
+	}
+
+	startpos=jsonbinary_begin_container(&buffer);
+	for (i=0; i<nargs; i+=2) {
+		if (nulls[i]) {
+			ereport(ERROR, (
+					errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					errmsg("json_build_object key %d is null", i/2+1)
+					));
+		}
+
+		keyconv=variadic ? &cache->args[0] : &cache->args[i];
+		valueconv=variadic ? &cache->args[0] : &cache->args[i+1];
+
+		key=OutputFunctionCall(&keyconv->outfunc, values[i]);
+		jsonbinary_write_label(&buffer, (uint8_t*)key, strlen(key));
+		pfree(key);
+
+		jsonbuild_write_datum(cache, &buffer, valueconv, values[i+1], nulls[i+1]);
+	}
+	jsonbinary_finalize_container(&buffer, JSONBINARY_TYPE_OBJECT, startpos);
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/*** json array functions ***/
+static void pgjson_check_array_status(json_array_status_t status)
+{
+	switch (status) {
+	case JSON_ARRAY_OK:
+		return;
+	case JSON_ARRAY_NOT_ARRAY:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("json value is not an array")
+				));
+		break;
+	case JSON_ARRAY_NOT_NUMERIC:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("json array contains a non numeric element")
+				));
+		break;
+	default:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Corrupt binary json data")
+				));
+	}
+}
+
+/* json_array_length(json) as int4 */
+PG_FUNCTION_INFO_V1(pgjson_json_array_length);
+Datum
+pgjson_json_array_length(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	uint32_t count;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_length(data, length, &count));
+
+	PG_RETURN_INT32(count);
+}
+
+/* json_array_sum(json) as float8 */
+PG_FUNCTION_INFO_V1(pgjson_json_array_sum);
+Datum
+pgjson_json_array_sum(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	double sum;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_sum(data, length, &sum));
+
+	PG_RETURN_FLOAT8(sum);
+}
+
+/* json_array_min(json) as float8 */
+PG_FUNCTION_INFO_V1(pgjson_json_array_min);
+Datum
+pgjson_json_array_min(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	uint32_t count;
+	double minvalue, maxvalue;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_minmax(data, length, &count, &minvalue, &maxvalue));
+	if (!count) PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(minvalue);
+}
+
+/* json_array_max(json) as float8 */
+PG_FUNCTION_INFO_V1(pgjson_json_array_max);
+Datum
+pgjson_json_array_max(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	uint32_t count;
+	double minvalue, maxvalue;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_minmax(data, length, &count, &minvalue, &maxvalue));
+	if (!count) PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(maxvalue);
+}
+
+/* json_array_contains(json, float8) as bool */
+PG_FUNCTION_INFO_V1(pgjson_json_array_contains);
+Datum
+pgjson_json_array_contains(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	bool found;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_contains_number(data, length, PG_GETARG_FLOAT8(1), &found));
+
+	PG_RETURN_BOOL(found);
+}
+
+/* json_array_element(json, int4) as json */
+PG_FUNCTION_INFO_V1(pgjson_json_array_element);
+Datum
+pgjson_json_array_element(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	int32 index=PG_GETARG_INT32(1);
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	bool found;
+
+	if (index<0) PG_RETURN_NULL();
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	pgjson_check_array_status(json_array_element(data, length, index, &buffer, &found));
+	if (!found) PG_RETURN_NULL();
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/*** json paths ***/
+/* json_get(json, text) as json */
+PG_FUNCTION_INFO_V1(pgjson_json_get);
+Datum
+pgjson_json_get(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	text *path=PG_GETARG_TEXT_PP(1);
+	uint8_t *pathdata=(uint8_t*)VARDATA_ANY(path);
+	size_t pathlength=VARSIZE_ANY_EXHDR(path);
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	bool found;
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	switch (json_path_get(data, length, pathdata, pathlength, &buffer, &found)) {
+	case JSON_PATH_OK:
+		break;
+	case JSON_PATH_SYNTAX:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid json path: \"%.*s\"", (int)pathlength, pathdata)
+				));
+		break;
+	default:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Corrupt binary json data")
+				));
+	}
+	if (!found) PG_RETURN_NULL();
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/* json_project(json, text[]) as json */
+PG_FUNCTION_INFO_V1(pgjson_json_project);
+Datum
+pgjson_json_project(PG_FUNCTION_ARGS)
+{
+	uint8_t *data;
+	size_t length;
+	ArrayType *patharray=PG_GETARG_ARRAYTYPE_P(1);
+	Datum *pathdatums;
+	bool *pathnulls;
+	int npathdatums, i, npaths=0;
+	const uint8_t **paths;
+	size_t *pathlengths;
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	bool found;
+
+	deconstruct_array(patharray, TEXTOID, -1, false, 'i', &pathdatums, &pathnulls, &npathdatums);
+	paths=(const uint8_t**)palloc(sizeof(uint8_t*) * (npathdatums+1));
+	pathlengths=(size_t*)palloc(sizeof(size_t) * (npathdatums+1));
+	for (i=0; i<npathdatums; i++) {
+		text *path;
+		if (pathnulls[i]) continue;
+		path=DatumGetTextPP(pathdatums[i]);
+		paths[npaths]=(uint8_t*)VARDATA_ANY(path);
+		pathlengths[npaths]=VARSIZE_ANY_EXHDR(path);
+		npaths++;
+	}
+
+	PG_GETARG_JSON_BINARY(0, data, length);
+	switch (json_project(data, length, paths, pathlengths, npaths, &buffer, &found)) {
+	case JSON_PATH_OK:
+		break;
+	case JSON_PATH_SYNTAX:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid json path in projection")
+				));
+		break;
+	default:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("Corrupt binary json data")
+				));
+	}
+	if (!found) PG_RETURN_NULL();
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/* jsontext_extract(text, text) as json */
+PG_FUNCTION_INFO_V1(pgjson_jsontext_extract);
+Datum
+pgjson_jsontext_extract(PG_FUNCTION_ARGS)
+{
+	void *input_data=PG_DETOAST_DATUM_PACKED(PG_GETARG_DATUM(0));
+	text *path=PG_GETARG_TEXT_PP(1);
+	uint8_t *pathdata=(uint8_t*)VARDATA_ANY(path);
+	size_t pathlength=VARSIZE_ANY_EXHDR(path);
+	dynbuffer_t extracted=dynbuffer_init();
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	MemoryContext oldcontext, scratch;
+	json_path_status_t status;
+	bool found, success=false;
+
+	/* extracted is scratch too */
+	oldcontext=pgjson_switch_to_scratch(fcinfo);
+	status=json_text_extract((uint8_t*)VARDATA_ANY(input_data), VARSIZE_ANY_EXHDR(input_data), pathdata, pathlength, &extracted, &found);
+	if (status==JSON_PATH_OK && found) {
+		/* only the extracted text is fully parsed */
+		scratch=MemoryContextSwitchTo(oldcontext);
+		dynbuffer_ensure_exact(&buffer, extracted.pos+1);
+		MemoryContextSwitchTo(scratch);
+		success=json_transcode_json_to_binary(extracted.contents, extracted.pos, &buffer);
+	}
+	MemoryContextSwitchTo(oldcontext);
+
+	switch (status) {
+	case JSON_PATH_OK:
+		break;
+	case JSON_PATH_SYNTAX:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("invalid json path: \"%.*s\"", (int)pathlength, pathdata)
+				));
+		break;
+	default:
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("JSON parse error while extracting \"%.*s\"", (int)pathlength, pathdata)
+				));
+	}
+	if (!found) PG_RETURN_NULL();
+	if (!success) {
+		pgjson_parse_error(extracted.contents, extracted.pos, (char*)buffer.contents);
+	}
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
+
+/* json_from_lo(oid) as json */
+PG_FUNCTION_INFO_V1(pgjson_json_from_lo);
+Datum
+pgjson_json_from_lo(PG_FUNCTION_ARGS)
+{
+	Oid loid=PG_GETARG_OID(0);
+	LargeObjectDesc *lobj;
+	json_to_binary_push_t *push;
+	dynbuffer_t buffer=dynbuffer_init_allocheader(VARHDRSZ);
+	char chunk[BLCKSZ];
+	int len;
+	MemoryContext oldcontext;
+	bool success=true;
+
+	lobj=inv_open(loid, INV_READ, CurrentMemoryContext);
+	#if PG_VERSION_NUM >= 90000 && PG_VERSION_NUM < 110000
+	/* later versions check in inv_open */
+	if (!lo_compat_privileges &&
+			pg_largeobject_aclcheck_snapshot(loid, GetUserId(), ACL_SELECT, lobj->snapshot)!=ACLCHECK_OK) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				errmsg("permission denied for large object %u", loid)
+				));
+	}
+	#endif
+
+	/* only the binary output and a token split between reads are held */
+	dynbuffer_ensure(&buffer, sizeof(chunk));
+	oldcontext=pgjson_switch_to_scratch(fcinfo);
+	push=json_transcode_json_to_binary_begin(&buffer);
+	while (success && (len=inv_read(lobj, chunk, sizeof(chunk)))>0) {
+		success=json_transcode_json_to_binary_push(push, (uint8_t*)chunk, len);
+	}
+	success=json_transcode_json_to_binary_end(push) && success;
+	MemoryContextSwitchTo(oldcontext);
+	inv_close(lobj);
+
+	if (!success) {
+		ereport(ERROR, (
+				errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				errmsg("JSON parse error: %s in large object %u", (char*)buffer.contents, loid)
+				));
+	}
+
+	PG_RETURN_DYNBUFFER(buffer);
+}
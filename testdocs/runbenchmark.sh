@@ -46,6 +46,14 @@ generate_serialize() {
    done
 }
 
+generate_serialize_utf8() {
+   local i
+   echo "set pgjson.ascii_output=off;"
+   for i in $(range $ITERATIONS); do
+      echo "select Length(doc::text), docname from jsontest_json_big;"
+   done
+}
+
 generate_roundtrip() {
    local i
    for i in $(range $ITERATIONS); do
@@ -64,6 +72,7 @@ echo '
    select docname "Document Name", Length(doc) "Original Size", 
       Length(JsonAsBinary(doc::json)) "Binary Size",
       Length(JsonNormalize(doc)) "Normalized Size",
+      Octet_Length(JsonNormalize(doc, false)) "UTF-8 Normalized Size",
       ((Length(JsonNormalize(doc)) - Length(JsonAsBinary(doc::json)))::double precision / Length(JsonNormalize(doc))::double precision)*100 "Percentage Savings"
    from jsontest_source;
 ' | $PSQL
@@ -79,6 +88,9 @@ generate_parse_to_binary | time $PSQL > $td/results-parsebinary.txt
 echo "Serialize from Binary:" >&2
 generate_serialize | time $PSQL > $td/results-serialize.txt
 
+echo "Serialize from Binary (UTF-8 output):" >&2
+generate_serialize_utf8 | time $PSQL > $td/results-serialize-utf8.txt
+
 echo "Normalize Text:" >&2
 generate_parse_normalize | time $PSQL > $td/results-parsenormalize.txt
 